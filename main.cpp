@@ -14,6 +14,18 @@ range of 0.0 to 1.0 using the GLM_FORCE_DEPTH_ZERO_TO_ONE definition
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/hash.hpp>
+#include <glm/gtc/packing.hpp>
+#include <cstddef>
+/*
+stb_image allocates through these so a decode can write its output straight into
+mapped staging memory, see decodeRgba8Into.
+*/
+void* stbDecodeMalloc(size_t size);
+void* stbDecodeRealloc(void* pointer, size_t size);
+void stbDecodeFree(void* pointer);
+#define STBI_MALLOC(size) stbDecodeMalloc(size)
+#define STBI_REALLOC(pointer, size) stbDecodeRealloc(pointer, size)
+#define STBI_FREE(pointer) stbDecodeFree(pointer)
 #include <stb_image.h>
 #include <tiny_obj_loader.h>
 
@@ -30,30 +42,297 @@ range of 0.0 to 1.0 using the GLM_FORCE_DEPTH_ZERO_TO_ONE definition
 #include <fstream>
 #include <array>
 #include <unordered_map>
+#include <filesystem>
+#include <span>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <charconv>
+#include <string_view>
+#include <numeric>
+#include <tuple>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <functional>
+#include <condition_variable>
+#include <exception>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_ENCODER_SSE2
+#endif
+
+/*
+While a thread has a decode target set, the first stb allocation of exactly
+target.size bytes returns target.data instead of heap memory. For PNGs, and any
+file already in the requested channel count, that is the output image. Frees of the
+target are ignored and a realloc moves its contents to the heap. Heap blocks carry
+their size in front (16 bytes keeps malloc's alignment) so stbHeapBytes can track
+how much the decoder holds, for the decode benchmark.
+*/
+struct StbDecodeTarget
+{
+	uint8_t* data{ nullptr };
+	size_t size{ 0 };
+	bool claimed{ false };
+};
+thread_local StbDecodeTarget stbDecodeTarget;
+std::atomic<size_t> stbHeapBytes{ 0 };
+std::atomic<size_t> stbHeapPeakBytes{ 0 };
+constexpr size_t STB_HEAP_HEADER{ 16 };
+
+void* stbDecodeMalloc(size_t size)
+{
+	StbDecodeTarget& target{ stbDecodeTarget };
+	if (target.data && !target.claimed && size == target.size)
+	{
+		target.claimed = true;
+		return target.data;
+	}
+	uint8_t* block{ static_cast<uint8_t*>(malloc(size + STB_HEAP_HEADER)) };
+	if (!block)
+	{
+		return nullptr;
+	}
+	memcpy(block, &size, sizeof(size));
+	size_t held{ stbHeapBytes += size };
+	size_t peak{ stbHeapPeakBytes.load() };
+	while (held > peak && !stbHeapPeakBytes.compare_exchange_weak(peak, held))
+	{
+	}
+	return block + STB_HEAP_HEADER;
+}
+
+void stbDecodeFree(void* pointer)
+{
+	if (!pointer || pointer == stbDecodeTarget.data)
+	{
+		return;
+	}
+	uint8_t* block{ static_cast<uint8_t*>(pointer) - STB_HEAP_HEADER };
+	size_t size;
+	memcpy(&size, block, sizeof(size));
+	stbHeapBytes -= size;
+	free(block);
+}
+
+void* stbDecodeRealloc(void* pointer, size_t size)
+{
+	if (!pointer)
+	{
+		return stbDecodeMalloc(size);
+	}
+	size_t oldSize{ stbDecodeTarget.size };
+	if (pointer != stbDecodeTarget.data)
+	{
+		memcpy(&oldSize, static_cast<uint8_t*>(pointer) - STB_HEAP_HEADER, sizeof(oldSize));
+	}
+	void* moved{ stbDecodeMalloc(size) };
+	if (!moved)
+	{
+		return nullptr;
+	}
+	memcpy(moved, pointer, std::min(oldSize, size));
+	stbDecodeFree(pointer);
+	return moved;
+}
+
+/*
+Decodes path as RGBA8 into destination, which has to hold width * height * 4 bytes
+as reported by stbi_info. Without an extra heap copy when stb lets us, see
+StbDecodeTarget, with one memcpy otherwise. Returns false if the file can't be
+decoded or no longer has that size.
+*/
+inline bool decodeRgba8Into(const std::string& path, uint8_t* destination, uint32_t width, uint32_t height)
+{
+	size_t size{ static_cast<size_t>(width) * height * 4 };
+	stbDecodeTarget = { destination, size, false };
+	int decodedWidth;
+	int decodedHeight;
+	int channels;
+	stbi_uc* pixels{ stbi_load(path.c_str(), &decodedWidth, &decodedHeight, &channels, STBI_rgb_alpha) };
+	bool decoded{ pixels && static_cast<uint32_t>(decodedWidth) == width && static_cast<uint32_t>(decodedHeight) == height };
+	if (decoded && pixels != destination)
+	{
+		memcpy(destination, pixels, size);
+	}
+	stbi_image_free(pixels);
+	stbDecodeTarget = {};
+	return decoded;
+}
 
 const uint32_t WIDTH{ 800 };
 const uint32_t HEIGHT{ 600 };
 const std::string MODEL_PATH = "models/viking_room.obj";
 const std::string TEXTURE_PATH = "textures/viking_room.png";
 /*
+TEXTURE_PATH is baked into a KTX2 file with the complete mip chain the first time it
+is loaded (and whenever the source is newer). Later launches copy every level with
+one vkCmdCopyBufferToImage instead of decoding the PNG and blitting the mip chain.
+*/
+const std::string TEXTURE_KTX2_PATH = "textures/viking_room.ktx2";
+const bool enableKtx2Textures{ true };
+/*
+Formats tried for the texture when KTX2 textures are on, best first. The first one
+the device can sample and filter is baked and uploaded, RGBA8 is the fallback when
+none of them is. BC7 and BC3 keep alpha at 1 byte per texel, BC1_RGB halves that
+again but drops alpha, so only list it for opaque textures.
+*/
+const std::vector<VkFormat> TEXTURE_FORMAT_CANDIDATES{ VK_FORMAT_BC7_SRGB_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK };
+/*
+Stream the KTX2 texture in: only the mip levels of at most TEXTURE_STREAMING_RESIDENT_SIZE
+texels a side are uploaded before the first frame. A background thread reads the
+larger levels into a staging buffer, smallest first, and each frame copies whatever
+has arrived and lowers the minLod clamp of its sampler to the new top level.
+*/
+const bool enableTextureStreaming{ true };
+const uint32_t TEXTURE_STREAMING_RESIDENT_SIZE{ 64 };
+/*
+Textures decoded from TEXTURE_PATH get their mip chain from shaders/mipmap.comp, one
+dispatch for all levels instead of a blit and two barriers per level, built into
+shaders/mipmap.spv with the project. Needs a Vulkan 1.1 device and dynamic indexing of
+storage image arrays; without them, or with --blit-mipmaps, the blit chain is used.
+*/
+const bool enableComputeMipmaps{ true };
+// levels the shader has bindings for, enough for 32768 texels a side
+const uint32_t COMPUTE_MIPMAP_MAX_LEVELS{ 16 };
+/*
+The welded vertex and index arrays of MODEL_PATH are cached next to the source in a
+small binary file. On later launches the file is memory-mapped and copied straight
+into the staging buffers, skipping the OBJ parse and the vertex dedup entirely.
+*/
+const std::string MESH_CACHE_PATH = MODEL_PATH + ".meshcache";
+const bool enableMeshCache{ true };
+/*
+Upload the model as PackedVertex (12 bytes) instead of Vertex (32 bytes), drawn with
+shaders/shader_compact.vert. The default of --compact-vertices.
+*/
+const bool enableCompactVertices{ false };
+/*
+Meshes with at most 65536 vertices always get 16-bit indices. Larger ones are split
+into ranges of triangles that each reference a window of less than 65536 vertices
+and drawn with one vkCmdDrawIndexed per range, the window start going into
+vertexOffset. Without splitting large meshes keep 32-bit indices.
+*/
+const bool enableIndexSplitting{ true };
+/*
+Level of detail chain. Every LOD simplifies the previous one to half its triangles,
+or less when that would move the surface further than its target error (relative
+to the size of the model). All LODs share the vertex buffer and are packed one
+after the other into the index buffer. Each frame the coarsest LOD whose error
+projects to no more than LOD_PIXEL_ERROR pixels on screen is drawn.
+*/
+const std::array<float, 4> LOD_TARGET_ERRORS{ 0.002f, 0.008f, 0.03f, 0.1f };
+const float LOD_PIXEL_ERROR{ 1.0f };
+/*
+Every LOD is cut into meshlets of at most 64 vertices and 124 triangles, each with
+a bounding sphere and a cone containing its triangle normals. recordCommandBuffer
+skips the meshlets outside the view frustum or facing away from the camera and
+merges the remaining ones into as few draws as possible.
+*/
+const bool enableMeshletCulling{ true };
+const uint32_t MESHLET_MAX_VERTICES{ 64 };
+const uint32_t MESHLET_MAX_TRIANGLES{ 124 };
+/*
+On devices with VK_EXT_mesh_shader the visible meshlets are drawn by
+shaders/shader.mesh instead, one task per meshlet. Devices without the extension
+keep using the CPU culled index buffer draws. The mesh shader draws one object with
+the DrawUniforms of the first, so it only runs where the meshlets are culled: with
+--objects above 1 or --cache-command-buffers every object is an index buffer draw
+again, see drawsWholeLods. --push-transforms doesn't change it, the first object
+keeps its DrawUniforms. The default of --mesh-shading.
+*/
+const bool enableMeshShading{ false };
+// below this many triangle corners welding on one thread is faster than starting workers
+const size_t PARALLEL_WELD_MIN_CORNERS{ 1 << 20 };
+/*
+Copy the startup resources on a transfer-only queue family when the device has one
+and let the first frames wait for just the uploads they draw with, see submitUpload.
+Needs timeline semaphores (Vulkan 1.2), without them every upload waits for its copy.
+*/
+const bool enableAsyncUploads{ true };
+/*
+The multisampled color and the depth attachment only live within the render pass:
+the color is resolved into the swap chain image and neither is stored. Create them
+as transient attachments in lazily allocated memory where the device has it, which
+tile based GPUs never back with real memory. Elsewhere they stay device local.
+*/
+const bool enableTransientAttachments{ true };
+/*
+Premultiply model, view and projection once per draw on the CPU and hand the vertex
+shader the result, plus a draw ID, as push constants. Without it every draw binds its
+DrawUniforms and every vertex multiplies the model with the FrameUniforms matrices.
+The default of --push-transforms and --ubo-transforms.
+*/
+const bool enablePushConstantTransforms{ true };
+/*
+Synchronize the frames in flight on one timeline semaphore counting the submitted
+frames instead of a fence per frame. Waiting for a frame slot becomes waiting for a
+frame number, and so does releasing what a frame used, see frameComplete. Needs
+timeline semaphores (Vulkan 1.2), without them the fences stay.
+*/
+const bool enableTimelineFrameSync{ true };
+/*
+The mesh shader path needs SPIR-V 1.4 and the async uploads and the frame sync
+timeline semaphores, all from Vulkan 1.2; the compute mip generator needs Vulkan 1.1.
+*/
+const uint32_t VULKAN_API_VERSION{ enableMeshShading || enableAsyncUploads || enableTimelineFrameSync ? VK_API_VERSION_1_2 :
+	enableComputeMipmaps ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0 };
+/*
+DeviceMemoryAllocator takes buffers and images out of blocks of this size (an eighth
+of the heap for heaps smaller than 8 blocks, but not below the minimum). Resources of
+half a block or more get their own allocation. Nodes of the buddy allocator are at
+least DEVICE_MEMORY_MIN_NODE_SIZE, which also covers every alignment a uniform or
+vertex buffer asks for.
+*/
+const VkDeviceSize DEVICE_MEMORY_BLOCK_SIZE{ 64ull << 20 };
+const VkDeviceSize DEVICE_MEMORY_MIN_BLOCK_SIZE{ 4ull << 20 };
+const VkDeviceSize DEVICE_MEMORY_MIN_NODE_SIZE{ 256 };
+/*
+All uploads go through one staging ring of this size, see StagingRing. It holds the
+source texture with its mip chain; bigger uploads, and the streamed texture levels,
+get a temporary staging buffer instead.
+*/
+const VkDeviceSize STAGING_RING_SIZE{ 32ull << 20 };
+/*
+Uniform data of one frame in flight, see UniformArena. FrameUniforms and DrawUniforms
+take 256 bytes at most alignments, so this leaves room for a few hundred draws or passes.
+*/
+const VkDeviceSize UNIFORM_ARENA_FRAME_SIZE{ 64ull << 10 };
+/*
 We choose the number 2 because we don’t want the CPU to get too far ahead
 of the GPU. With 2 frames in flight, the CPU and the GPU can be working
 on their own tasks at the same time. If the CPU finishes early, it will wait
 till the GPU finishes rendering before submitting more work. With 3 or more
 frames in flight, the CPU could get ahead of the GPU, adding frames of latency.
 Generally, extra latency isn’t desired.
+The default of --frames-in-flight, see RenderSettings.
 */
-const int MAX_FRAMES_IN_FLIGHT{ 2 };
+const uint32_t DEFAULT_FRAMES_IN_FLIGHT{ 2 };
 //All of the useful standard validation is bundled into
 //a layer included in the SDK that is known as VK_LAYER_KHRONOS_validation.
 const std::vector<const char*> validationLayers{ "VK_LAYER_KHRONOS_validation" };
 const std::vector<const char*> deviceExtensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
-struct UniformBufferObject
+struct FrameUniforms
 {
 	/*
 	The data in the matrices is binary compatible with the way the shader expects
-	it, so we can later just memcpy a UniformBufferObject to a VkBuffer.
+	it, so we can later just memcpy a FrameUniforms to a VkBuffer.
 
 	Vulkan expects the data in your structure to be aligned in memory in a specific
 	way, for example:
@@ -65,9 +344,19 @@ struct UniformBufferObject
 	• A mat4 matrix must have the same alignment as a vec4.
 	You can find the full list of alignment requirements in the specification.
 	*/
-	alignas(16) glm::mat4 model;
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
+	// shader_compact.vert takes the color from here instead of from every vertex
+	alignas(16) glm::vec4 color;
+};
+
+/*
+The uniform data of one object, at binding 7 next to the FrameUniforms at binding 0.
+The push constant path passes the premultiplied matrix instead, see DrawPushConstants.
+*/
+struct DrawUniforms
+{
+	alignas(16) glm::mat4 model;
 };
 
 struct Vertex
@@ -156,6 +445,123 @@ struct Vertex
 	}
 };
 
+/*
+Compact vertex layout. Positions are stored as 16-bit unsigned normalized values
+relative to the mesh bounding box, the vertex fetch turns them into [0, 1] floats
+and the box transform is folded into the model matrix, so decoding costs nothing in
+the shader. The fourth position component only pads the texture coordinates to a
+4 byte boundary; three component 16-bit formats are rarely supported for vertex
+buffers. Texture coordinates use 16-bit unorm when they all lie in [0, 1], and half
+floats otherwise (tiling UVs). The color was the same for every vertex and moved to
+the uniform buffer.
+*/
+struct PackedVertex
+{
+	uint16_t pos[4];
+	uint16_t texCoord[2];
+
+	static VkVertexInputBindingDescription getBindingDescription()
+	{
+		VkVertexInputBindingDescription bindingDescription{};
+		bindingDescription.binding = 0;
+		bindingDescription.stride = sizeof(PackedVertex);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		return bindingDescription;
+	}
+
+	// Locations match Vertex, location 1 (color) is gone.
+	static std::array<VkVertexInputAttributeDescription, 2> getAttributeDescription(VkFormat texCoordFormat)
+	{
+		std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions{};
+		attributeDescriptions[0].binding = 0;
+		attributeDescriptions[0].location = 0;
+		attributeDescriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+		attributeDescriptions[0].offset = offsetof(PackedVertex, pos);
+
+		attributeDescriptions[1].binding = 0;
+		attributeDescriptions[1].location = 2;
+		attributeDescriptions[1].format = texCoordFormat;
+		attributeDescriptions[1].offset = offsetof(PackedVertex, texCoord);
+		return attributeDescriptions;
+	}
+};
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must stay tightly packed");
+
+struct QuantizedMesh
+{
+	std::vector<PackedVertex> vertices;
+	VkFormat texCoordFormat;
+	// object space position = positionOffset + decoded position * positionScale
+	glm::vec3 positionOffset;
+	glm::vec3 positionScale;
+	// largest difference to the float vertices, per component
+	float maxPositionError;
+	float maxTexCoordError;
+};
+
+inline QuantizedMesh quantizeVertices(std::span<const Vertex> vertexArray)
+{
+	QuantizedMesh mesh{};
+	glm::vec3 minimum{ std::numeric_limits<float>::max() };
+	glm::vec3 maximum{ std::numeric_limits<float>::lowest() };
+	bool texCoordsInUnitRange{ true };
+	for (const Vertex& vertex : vertexArray)
+	{
+		minimum = glm::min(minimum, vertex.pos);
+		maximum = glm::max(maximum, vertex.pos);
+		texCoordsInUnitRange &= vertex.texCoord.x >= 0.0f && vertex.texCoord.x <= 1.0f &&
+			vertex.texCoord.y >= 0.0f && vertex.texCoord.y <= 1.0f;
+	}
+	if (vertexArray.empty())
+	{
+		minimum = maximum = glm::vec3(0.0f);
+	}
+	mesh.positionOffset = minimum;
+	mesh.positionScale = maximum - minimum;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// a flat mesh would otherwise divide by zero, any scale decodes a 0 back to minimum
+		if (mesh.positionScale[axis] <= 0.0f)
+		{
+			mesh.positionScale[axis] = 1.0f;
+		}
+	}
+	mesh.texCoordFormat = texCoordsInUnitRange ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R16G16_SFLOAT;
+
+	auto toUnorm16{ [](float value) {
+		return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+	} };
+	mesh.vertices.resize(vertexArray.size());
+	for (size_t i = 0; i < vertexArray.size(); i++)
+	{
+		const Vertex& vertex{ vertexArray[i] };
+		PackedVertex& packed{ mesh.vertices[i] };
+		for (int axis = 0; axis < 3; axis++)
+		{
+			packed.pos[axis] = toUnorm16((vertex.pos[axis] - mesh.positionOffset[axis]) / mesh.positionScale[axis]);
+			float decoded{ mesh.positionOffset[axis] + packed.pos[axis] / 65535.0f * mesh.positionScale[axis] };
+			mesh.maxPositionError = std::max(mesh.maxPositionError, std::abs(decoded - vertex.pos[axis]));
+		}
+		packed.pos[3] = 0;
+		for (int axis = 0; axis < 2; axis++)
+		{
+			float decoded;
+			if (texCoordsInUnitRange)
+			{
+				packed.texCoord[axis] = toUnorm16(vertex.texCoord[axis]);
+				decoded = packed.texCoord[axis] / 65535.0f;
+			}
+			else
+			{
+				packed.texCoord[axis] = glm::packHalf1x16(vertex.texCoord[axis]);
+				decoded = glm::unpackHalf1x16(packed.texCoord[axis]);
+			}
+			mesh.maxTexCoordError = std::max(mesh.maxTexCoordError, std::abs(decoded - vertex.texCoord[axis]));
+		}
+	}
+	return mesh;
+}
+
 /*
 cppreference. com recommends the following approach combining the fields of a struct
 to create a decent quality hash function:
@@ -232,6 +638,11 @@ struct QueueFamilyIndices
 	account that there could be a distinct presentation queue
 	*/
 	std::optional<uint32_t> presentFamily;
+	/*
+	A family that can copy but not draw, on discrete GPUs usually the copy engines. The
+	uploads run there next to the rendering when it exists, see enableAsyncUploads.
+	*/
+	std::optional<uint32_t> transferFamily;
 
 	bool isComplete()
 	{
@@ -246,88 +657,4254 @@ struct SwapChainSupportDetails
 	std::vector<VkPresentModeKHR> presentModes;
 };
 
+/*
+64 bit content hash (xxHash64 construction). It runs at memory bandwidth, so hashing
+even a few hundred MB of OBJ text is much cheaper than parsing it again.
+*/
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0)
+{
+	constexpr uint64_t prime1{ 0x9E3779B185EBCA87ull };
+	constexpr uint64_t prime2{ 0xC2B2AE3D27D4EB4Full };
+	constexpr uint64_t prime3{ 0x165667B19E3779F9ull };
+	constexpr uint64_t prime4{ 0x85EBCA77C2B2AE63ull };
+	constexpr uint64_t prime5{ 0x27D4EB2F165667C5ull };
+	auto rotl{ [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); } };
+	auto read64{ [](const unsigned char* p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; } };
+	auto read32{ [](const unsigned char* p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; } };
+	auto round{ [&](uint64_t acc, uint64_t input) { return rotl(acc + input * prime2, 31) * prime1; } };
+	auto merge{ [&](uint64_t acc, uint64_t val) { return (acc ^ round(0, val)) * prime1 + prime4; } };
+
+	const unsigned char* p{ static_cast<const unsigned char*>(data) };
+	const unsigned char* end{ p + size };
+	uint64_t h;
+	if (size >= 32)
+	{
+		uint64_t v1{ seed + prime1 + prime2 };
+		uint64_t v2{ seed + prime2 };
+		uint64_t v3{ seed };
+		uint64_t v4{ seed - prime1 };
+		do
+		{
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= end - 32);
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge(h, v1);
+		h = merge(h, v2);
+		h = merge(h, v3);
+		h = merge(h, v4);
+	}
+	else
+	{
+		h = seed + prime5;
+	}
+	h += size;
+	for (; p + 8 <= end; p += 8)
+	{
+		h = rotl(h ^ round(0, read64(p)), 27) * prime1 + prime4;
+	}
+	if (p + 4 <= end)
+	{
+		h = rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+		p += 4;
+	}
+	for (; p < end; p++)
+	{
+		h = rotl(h ^ (*p * prime5), 11) * prime1;
+	}
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+	return h;
+}
 
-class HelloTriangleApplication
+/*
+Read-only memory mapping of a whole file. The OS pages the contents in on demand,
+so "loading" a large file costs nothing until the bytes are actually touched.
+*/
+struct MappedFile
 {
-public:
-	void run()
+	const unsigned char* data{ nullptr };
+	size_t size{ 0 };
+#ifdef _WIN32
+	HANDLE file{ INVALID_HANDLE_VALUE };
+	HANDLE mapping{ nullptr };
+#endif
+
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() { close(); }
+
+	bool open(const std::string& path)
 	{
-		initWindow();
-		initVulkan();
-		mainLoop();
-		cleanup();
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+		LARGE_INTEGER fileSize{};
+		GetFileSizeEx(file, &fileSize);
+		size = static_cast<size_t>(fileSize.QuadPart);
+		if (size == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping == nullptr)
+		{
+			close();
+			return false;
+		}
+		data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+		int fd{ ::open(path.c_str(), O_RDONLY) };
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat st {};
+		fstat(fd, &st);
+		size = static_cast<size_t>(st.st_size);
+		if (size > 0)
+		{
+			void* mapped{ mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) };
+			data = mapped == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(mapped);
+		}
+		::close(fd);
+#endif
+		if (data == nullptr)
+		{
+			close();
+			return false;
+		}
+		return true;
 	}
 
-private:
-	GLFWwindow* window;
-	VkInstance instance;
-	VkDebugUtilsMessengerEXT debugMessenger;
-	VkSurfaceKHR surface;
-	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
-	VkDevice device;
-	VkQueue graphicsQueue;
-	VkQueue presentQueue;
-	VkSwapchainKHR swapChain;
-	std::vector<VkImage> swapChainImages;
-	VkFormat swapChainImageFormat;
-	VkExtent2D swapChainExtent;
-	std::vector<VkImageView> swapChainImageViews;
-	VkRenderPass renderPass;
-	VkDescriptorSetLayout descriptorSetLayout;
-	VkDescriptorPool descriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets;
-	VkPipelineLayout pipelineLayout;
-	VkPipeline graphicsPipeline;
-	std::vector<VkFramebuffer> swapChainFramebuffers;
-	VkCommandPool commandPool;
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
-	std::vector<void*> uniformBuffersMapped;
-	std::vector<VkCommandBuffer> commandBuffers;
-	std::vector<VkSemaphore> imageAvailableSemaphores;
-	std::vector<VkSemaphore> renderFinishedSemaphores;
-	std::vector<VkFence> inFlightFences;
-	bool framebufferResized{ false };
-	uint32_t currentFrame{ 0 };
-	uint32_t mipLevels;
-	VkImage textureImage;
-	VkDeviceMemory textureImageMemory;
-	VkImageView textureImageView;
-	VkSampler textureSampler;
-	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
-	VkImageView depthImageView;
-	VkSampleCountFlagBits msaaSamples{ VK_SAMPLE_COUNT_1_BIT };
-	VkImage colorImage;
-	VkDeviceMemory colorImageMemory;
-	VkImageView colorImageView;
+	void close()
+	{
+#ifdef _WIN32
+		if (data != nullptr) UnmapViewOfFile(data);
+		if (mapping != nullptr) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (data != nullptr) munmap(const_cast<unsigned char*>(data), size);
+#endif
+		data = nullptr;
+		size = 0;
+	}
+};
 
-	void initWindow()
+/*
+Layout of a mesh cache file:
+	MeshCacheHeader
+	Vertex   vertices[vertexCount]
+	uint32_t indices[indexCount]     all LODs, one after the other
+	MeshLod  lods[lodCount]
+The header is 64 bytes so the vertex array that follows it stays aligned inside the
+(page aligned) mapping. Bump MESH_CACHE_VERSION whenever the layout of the file or of
+Vertex changes; the vertexSize field catches accidental struct changes as well.
+*/
+constexpr uint32_t MESH_CACHE_MAGIC{ 0x4853454D }; // "MESH"
+constexpr uint32_t MESH_CACHE_VERSION{ 3 };
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexSize;
+	uint32_t vertexCount;
+	uint64_t indexCount;
+	// invalidation data of the source file the cache was built from
+	uint64_t sourceSize;
+	int64_t sourceWriteTime;
+	uint64_t sourceHash;
+	// how long parsing and welding the source took, for the startup report
+	uint64_t sourceLoadMicroseconds;
+	uint32_t lodCount;
+	uint32_t reserved;
+};
+static_assert(sizeof(MeshCacheHeader) == 64, "mesh cache header must stay 64 bytes");
+
+/*
+Runs work(0) .. work(threadCount - 1) at the same time, work(0) on the calling thread,
+and returns once all of them have finished.
+*/
+template<typename Work>
+void runOnThreads(uint32_t threadCount, Work&& work)
+{
+	std::vector<std::thread> workers;
+	for (uint32_t i = 1; i < threadCount; i++)
 	{
-		glfwInit();
+		workers.emplace_back([&work, i]() { work(i); });
+	}
+	work(0);
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+}
 
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // we don't want to create a opengl context
-		//glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE); // window resizing is more involved so disable it
+/*
+runOnThreads for work that comes back every frame: the threads are started once and
+wait for the next run instead of being created and joined each time. run(threadCount,
+work) runs work(0) .. work(threadCount - 1), work(0) on the calling thread, and returns
+once all of them have finished, rethrowing the first exception one of them threw.
+*/
+class WorkerPool
+{
+public:
+	explicit WorkerPool(uint32_t threadCount)
+	{
+		for (uint32_t i = 1; i < threadCount; i++)
+		{
+			threads.emplace_back([this, i]() { workerLoop(i); });
+		}
+	}
 
-		window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr); // 1st nullptr is for monitor, 2nd for opengl
-		glfwSetWindowUserPointer(window, this);
-		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
 
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	uint32_t size() const
+	{
+		return static_cast<uint32_t>(threads.size()) + 1;
 	}
 
-	void initVulkan()
+	void run(uint32_t threadCount, const std::function<void(uint32_t)>& work)
 	{
-		/*
-		The very first thing you need to do is initialize the Vulkan library by creating
-		an instance. The instance is the connection between your application and
-		the Vulkan library and creating it involves specifying some details about your
-		application to the driver.
-		*/
-		createInstance();
+		threadCount = std::clamp(threadCount, 1u, size());
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			this->work = &work;
+			activeThreads = threadCount;
+			running = threadCount - 1;
+			error = nullptr;
+			generation++;
+		}
+		wake.notify_all();
+		try
+		{
+			work(0);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			error = std::current_exception();
+		}
+		std::unique_lock<std::mutex> lock{ mutex };
+		done.wait(lock, [this]() { return running == 0; });
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+private:
+	void workerLoop(uint32_t index)
+	{
+		uint64_t seen{ 0 };
+		while (true)
+		{
+			const std::function<void(uint32_t)>* job;
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+				wake.wait(lock, [&]() { return stopping || generation != seen; });
+				if (stopping)
+				{
+					return;
+				}
+				seen = generation;
+				if (index >= activeThreads)
+				{
+					continue;
+				}
+				job = work;
+			}
+			std::exception_ptr thrown;
+			try
+			{
+				(*job)(index);
+			}
+			catch (...)
+			{
+				thrown = std::current_exception();
+			}
+			std::lock_guard<std::mutex> lock{ mutex };
+			if (thrown && !error)
+			{
+				error = thrown;
+			}
+			if (--running == 0)
+			{
+				done.notify_one();
+			}
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(uint32_t)>* work{ nullptr };
+	uint32_t activeThreads{ 0 };
+	uint32_t running{ 0 };
+	uint64_t generation{ 0 };
+	bool stopping{ false };
+	std::exception_ptr error;
+};
+
+/*
+Parallel replacement for tinyobj::LoadObj. The file is memory-mapped and cut into one
+chunk per thread, with every chunk boundary moved forward to the next line break so
+no record is split between two workers. Each worker parses the v/vt/vn/f records of
+its chunk into private arrays, then the per-chunk counts are prefix summed and every
+worker copies its data into its slice of the final attrib/indices arrays. Faces are
+triangulated as a fan, like LoadObj does by default, and everything else (groups,
+materials, smoothing groups, comments) is skipped since loadModel ignores it anyway.
+
+OBJ indices are 1-based, or negative to count back from the last element defined so
+far. A negative index can only be resolved once the worker knows how many elements
+the previous chunks defined, so until the merge it is kept relative to the start of
+its chunk and flagged in relativeMask.
+*/
+struct ObjCorner
+{
+	// position, texcoord and normal index, -1 when the corner has no such attribute
+	int index[3];
+	uint32_t relativeMask;
+};
+
+struct ObjChunk
+{
+	std::vector<float> positions;
+	std::vector<float> texcoords;
+	std::vector<float> normals;
+	std::vector<ObjCorner> corners;
+	size_t faceCount{ 0 };
+	std::string error;
+	// line of the error, counted from the start of the chunk
+	size_t errorLine{ 0 };
+	// first element of each array in the merged output
+	size_t positionBase{ 0 };
+	size_t texcoordBase{ 0 };
+	size_t normalBase{ 0 };
+	size_t cornerBase{ 0 };
+	size_t faceBase{ 0 };
+};
+
+inline const char* skipObjSpaces(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t'))
+	{
+		++p;
+	}
+	return p;
+}
+
+/*
+std::from_chars is locale independent and a lot faster than strtof/stringstream, but it
+rejects the leading '+' that some exporters write.
+*/
+inline const char* parseObjFloat(const char* p, const char* end, float& value)
+{
+	p = skipObjSpaces(p, end);
+	if (p < end && *p == '+')
+	{
+		++p;
+	}
+	auto [next, ec] { std::from_chars(p, end, value) };
+	return ec == std::errc{} ? next : nullptr;
+}
+
+inline const char* parseObjInt(const char* p, const char* end, int& value)
+{
+	if (p < end && *p == '+')
+	{
+		++p;
+	}
+	auto [next, ec] { std::from_chars(p, end, value) };
+	return ec == std::errc{} ? next : nullptr;
+}
+
+// Turns an OBJ index into a 0-based one, see the comment above ObjCorner.
+inline void resolveObjIndex(ObjCorner& corner, uint32_t attribute, int index, size_t definedInChunk)
+{
+	if (index > 0)
+	{
+		corner.index[attribute] = index - 1;
+	}
+	else
+	{
+		corner.index[attribute] = static_cast<int>(definedInChunk) + index;
+		corner.relativeMask |= 1u << attribute;
+	}
+}
+
+inline void parseObjChunk(const char* begin, const char* end, ObjChunk& chunk)
+{
+	std::vector<ObjCorner> face;
+	size_t lineNumber{ 0 };
+	const char* line{ begin };
+	while (line < end)
+	{
+		const char* lineEnd{ static_cast<const char*>(memchr(line, '\n', end - line)) };
+		if (lineEnd == nullptr)
+		{
+			lineEnd = end;
+		}
+		++lineNumber;
+		const char* p{ skipObjSpaces(line, lineEnd) };
+		const char* next{ lineEnd + 1 };
+
+		if (lineEnd - p >= 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			float xyz[3];
+			p += 1;
+			for (float& component : xyz)
+			{
+				if (p != nullptr) p = parseObjFloat(p, lineEnd, component);
+			}
+			if (p == nullptr)
+			{
+				chunk.error = "malformed vertex position";
+				chunk.errorLine = lineNumber;
+				return;
+			}
+			chunk.positions.insert(chunk.positions.end(), xyz, xyz + 3);
+		}
+		else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+		{
+			float uv[2];
+			p += 2;
+			for (float& component : uv)
+			{
+				if (p != nullptr) p = parseObjFloat(p, lineEnd, component);
+			}
+			if (p == nullptr)
+			{
+				chunk.error = "malformed texture coordinate";
+				chunk.errorLine = lineNumber;
+				return;
+			}
+			chunk.texcoords.insert(chunk.texcoords.end(), uv, uv + 2);
+		}
+		else if (lineEnd - p >= 3 && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+		{
+			float normal[3];
+			p += 2;
+			for (float& component : normal)
+			{
+				if (p != nullptr) p = parseObjFloat(p, lineEnd, component);
+			}
+			if (p == nullptr)
+			{
+				chunk.error = "malformed vertex normal";
+				chunk.errorLine = lineNumber;
+				return;
+			}
+			chunk.normals.insert(chunk.normals.end(), normal, normal + 3);
+		}
+		else if (lineEnd - p >= 2 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+		{
+			// every corner is v, v/vt, v//vn or v/vt/vn
+			face.clear();
+			p = skipObjSpaces(p + 1, lineEnd);
+			while (p < lineEnd && *p != '\r' && *p != '#')
+			{
+				ObjCorner corner{ { -1, -1, -1 }, 0 };
+				int value;
+				p = parseObjInt(p, lineEnd, value);
+				if (p == nullptr || value == 0)
+				{
+					chunk.error = "malformed face";
+					chunk.errorLine = lineNumber;
+					return;
+				}
+				resolveObjIndex(corner, 0, value, chunk.positions.size() / 3);
+				if (p < lineEnd && *p == '/')
+				{
+					++p;
+					if (p < lineEnd && *p != '/')
+					{
+						p = parseObjInt(p, lineEnd, value);
+						if (p == nullptr || value == 0)
+						{
+							chunk.error = "malformed face";
+							chunk.errorLine = lineNumber;
+							return;
+						}
+						resolveObjIndex(corner, 1, value, chunk.texcoords.size() / 2);
+					}
+					if (p < lineEnd && *p == '/')
+					{
+						p = parseObjInt(p + 1, lineEnd, value);
+						if (p == nullptr || value == 0)
+						{
+							chunk.error = "malformed face";
+							chunk.errorLine = lineNumber;
+							return;
+						}
+						resolveObjIndex(corner, 2, value, chunk.normals.size() / 3);
+					}
+				}
+				face.push_back(corner);
+				p = skipObjSpaces(p, lineEnd);
+			}
+			if (face.size() < 3)
+			{
+				chunk.error = "face with less than 3 vertices";
+				chunk.errorLine = lineNumber;
+				return;
+			}
+			for (size_t i = 2; i < face.size(); i++)
+			{
+				chunk.corners.push_back(face[0]);
+				chunk.corners.push_back(face[i - 1]);
+				chunk.corners.push_back(face[i]);
+			}
+			chunk.faceCount += face.size() - 2;
+		}
+		line = next;
+	}
+}
+
+
+/*
+Fills attrib and a single shape the same way tinyobj::LoadObj(..., triangulate = true)
+does for the records we care about. threadCount 0 picks one thread per MB of the file,
+up to every hardware thread; an explicit count is used as is.
+*/
+inline bool loadObjParallel(tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes, std::string& err,
+	const std::string& path, uint32_t threadCount = 0)
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		err = "failed to open " + path;
+		return false;
+	}
+	const char* text{ reinterpret_cast<const char*>(file.data) };
+	const char* textEnd{ text + file.size };
+
+	if (threadCount == 0)
+	{
+		// Not worth waking up threads for less than 1MB per chunk.
+		threadCount = static_cast<uint32_t>(std::clamp<size_t>(file.size >> 20, 1, std::max(1u, std::thread::hardware_concurrency())));
+	}
+
+	std::vector<const char*> bounds(threadCount + 1);
+	bounds[0] = text;
+	bounds[threadCount] = textEnd;
+	for (uint32_t i = 1; i < threadCount; i++)
+	{
+		const char* p{ std::max(text + file.size * i / threadCount, bounds[i - 1]) };
+		const char* lineBreak{ static_cast<const char*>(memchr(p, '\n', textEnd - p)) };
+		bounds[i] = lineBreak == nullptr ? textEnd : lineBreak + 1;
+	}
+
+	std::vector<ObjChunk> chunks(threadCount);
+	runOnThreads(threadCount, [&](uint32_t i) { parseObjChunk(bounds[i], bounds[i + 1], chunks[i]); });
+
+	size_t positionCount{ 0 }, texcoordCount{ 0 }, normalCount{ 0 }, cornerCount{ 0 }, faceCount{ 0 };
+	for (auto& chunk : chunks)
+	{
+		if (!chunk.error.empty())
+		{
+			// add the lines of the chunks before this one
+			size_t line{ chunk.errorLine + static_cast<size_t>(std::count(text, bounds[&chunk - chunks.data()], '\n')) };
+			err = path + ":" + std::to_string(line) + ": " + chunk.error;
+			return false;
+		}
+		chunk.positionBase = positionCount;
+		chunk.texcoordBase = texcoordCount;
+		chunk.normalBase = normalCount;
+		chunk.cornerBase = cornerCount;
+		chunk.faceBase = faceCount;
+		positionCount += chunk.positions.size() / 3;
+		texcoordCount += chunk.texcoords.size() / 2;
+		normalCount += chunk.normals.size() / 3;
+		cornerCount += chunk.corners.size();
+		faceCount += chunk.faceCount;
+	}
+
+	attrib.vertices.resize(positionCount * 3);
+	attrib.texcoords.resize(texcoordCount * 2);
+	attrib.normals.resize(normalCount * 3);
+	shapes.resize(1);
+	shapes[0].mesh.indices.resize(cornerCount);
+	shapes[0].mesh.num_face_vertices.assign(faceCount, 3);
+
+	std::atomic<bool> outOfRange{ false };
+	runOnThreads(threadCount, [&](uint32_t i) {
+		const ObjChunk& chunk{ chunks[i] };
+		std::copy(chunk.positions.begin(), chunk.positions.end(), attrib.vertices.begin() + chunk.positionBase * 3);
+		std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib.texcoords.begin() + chunk.texcoordBase * 2);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), attrib.normals.begin() + chunk.normalBase * 3);
+		const int64_t bases[3]{ static_cast<int64_t>(chunk.positionBase), static_cast<int64_t>(chunk.texcoordBase),
+			static_cast<int64_t>(chunk.normalBase) };
+		const int64_t counts[3]{ static_cast<int64_t>(positionCount), static_cast<int64_t>(texcoordCount),
+			static_cast<int64_t>(normalCount) };
+		bool valid{ true };
+		tinyobj::index_t* out{ shapes[0].mesh.indices.data() + chunk.cornerBase };
+		for (const ObjCorner& corner : chunk.corners)
+		{
+			int64_t index[3];
+			for (uint32_t a = 0; a < 3; a++)
+			{
+				index[a] = corner.index[a] + ((corner.relativeMask >> a) & 1 ? bases[a] : 0);
+				// only the position is mandatory
+				valid &= index[a] < counts[a] && (index[a] >= 0 || (a > 0 && index[a] == -1 && !((corner.relativeMask >> a) & 1)));
+			}
+			out->vertex_index = static_cast<int>(index[0]);
+			out->texcoord_index = static_cast<int>(index[1]);
+			out->normal_index = static_cast<int>(index[2]);
+			++out;
+		}
+		if (!valid)
+		{
+			outOfRange = true;
+		}
+	});
+
+	if (outOfRange)
+	{
+		err = path + ": face index out of range";
+		return false;
+	}
+	return true;
+}
+
+/*
+Hash over all 32 bytes of vertex data. The fields are copied out one by one rather
+than hashing the struct memory directly, so padding that an aligned glm type might
+add never ends up in the hash, and -0.0f is folded into 0.0f to stay consistent
+with Vertex::operator== (adding 0.0f does exactly that).
+*/
+inline uint64_t hashVertex(const Vertex& vertex)
+{
+	const float fields[8]{
+		vertex.pos.x + 0.0f, vertex.pos.y + 0.0f, vertex.pos.z + 0.0f,
+		vertex.color.x + 0.0f, vertex.color.y + 0.0f, vertex.color.z + 0.0f,
+		vertex.texCoord.x + 0.0f, vertex.texCoord.y + 0.0f
+	};
+	return hashBytes(fields, sizeof(fields));
+}
+
+/*
+Flat open-addressing (linear probing) table mapping a vertex to its index in the
+welded vertex array. Slots only hold 32 bits of the hash and the vertex index, the
+vertices themselves are compared in place in the output array, so a probe touches
+8 bytes per slot instead of chasing a node pointer like std::unordered_map does.
+The table is sized up front for a load factor of at most 1/2, which keeps the
+probe sequences short without ever rehashing when maxVertices is an upper bound
+(the corner count is one).
+*/
+class VertexWeldTable
+{
+public:
+	explicit VertexWeldTable(size_t maxVertices)
+	{
+		size_t capacity{ 16 };
+		while (capacity < maxVertices * 2)
+		{
+			capacity *= 2;
+		}
+		slots.resize(capacity);
+		mask = capacity - 1;
+	}
+
+	/*
+	Returns the index of an equal vertex in weldedVertices, or appends the vertex and
+	returns its new index. This is the only lookup per corner.
+	*/
+	uint32_t weld(const Vertex& vertex, uint64_t hash, std::vector<Vertex>& weldedVertices)
+	{
+		uint32_t tag{ static_cast<uint32_t>(hash >> 32) };
+		for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+		{
+			Slot& entry{ slots[slot] };
+			if (entry.index == 0)
+			{
+				if (++count * 4 > slots.size() * 3)
+				{
+					grow(weldedVertices);
+					--count;
+					return weld(vertex, hash, weldedVertices);
+				}
+				entry.tag = tag;
+				entry.index = static_cast<uint32_t>(weldedVertices.size()) + 1;
+				weldedVertices.push_back(vertex);
+				return entry.index - 1;
+			}
+			if (entry.tag == tag && weldedVertices[entry.index - 1] == vertex)
+			{
+				return entry.index - 1;
+			}
+		}
+	}
+
+	uint32_t weld(const Vertex& vertex, std::vector<Vertex>& weldedVertices)
+	{
+		return weld(vertex, hashVertex(vertex), weldedVertices);
+	}
+
+private:
+	struct Slot
+	{
+		uint32_t tag{ 0 };
+		// index into the welded vertex array + 1, 0 marks an empty slot
+		uint32_t index{ 0 };
+	};
+	std::vector<Slot> slots;
+	size_t mask;
+	size_t count{ 0 };
+
+	// Only reached when the caller's size estimate was too low.
+	void grow(const std::vector<Vertex>& weldedVertices)
+	{
+		std::vector<Slot> old(slots.size() * 2);
+		old.swap(slots);
+		mask = slots.size() - 1;
+		for (const Slot& entry : old)
+		{
+			if (entry.index != 0)
+			{
+				size_t slot{ hashVertex(weldedVertices[entry.index - 1]) & mask };
+				while (slots[slot].index != 0)
+				{
+					slot = (slot + 1) & mask;
+				}
+				slots[slot] = entry;
+			}
+		}
+	}
+};
+
+/*
+Welds one Vertex per corner into a unique vertex array plus an index per corner,
+giving exactly the same result as feeding the corners through a VertexWeldTable in
+order (vertices numbered by first use), but spread over threadCount threads:
+	1. every thread hashes a slice of the corners
+	2. the top hash bits pick a shard, and corner ids are scattered into one list per
+	   shard, each list still in corner order
+	3. every thread welds one shard with its own table, so no locking is needed since
+	   equal vertices always land in the same shard
+	4. a prefix sum over the "first use" flags turns the shard local ids into the
+	   global first-use numbering
+*/
+inline void weldVerticesParallel(std::span<const Vertex> corners, std::vector<Vertex>& weldedVertices,
+	std::vector<uint32_t>& cornerIndices, uint32_t threadCount = 0)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	const size_t cornerCount{ corners.size() };
+	const uint32_t shardCount{ threadCount };
+	auto sliceBegin{ [&](uint32_t t) { return cornerCount * t / threadCount; } };
+	auto shardOf{ [&](uint64_t hash) { return static_cast<uint32_t>(((hash >> 32) * shardCount) >> 32); } };
+
+	std::vector<uint64_t> hashes(cornerCount);
+	// shardCounts[t * shardCount + s]: corners of slice t that belong to shard s
+	std::vector<size_t> shardCounts(static_cast<size_t>(threadCount) * shardCount);
+	runOnThreads(threadCount, [&](uint32_t t) {
+		for (size_t i = sliceBegin(t); i < sliceBegin(t + 1); i++)
+		{
+			hashes[i] = hashVertex(corners[i]);
+			shardCounts[t * shardCount + shardOf(hashes[i])]++;
+		}
+	});
+
+	// exclusive prefix sum in shard-major order, so every shard list is contiguous
+	std::vector<size_t> shardBegin(shardCount + 1);
+	std::vector<size_t> scatterOffsets(shardCounts.size());
+	size_t offset{ 0 };
+	for (uint32_t s = 0; s < shardCount; s++)
+	{
+		shardBegin[s] = offset;
+		for (uint32_t t = 0; t < threadCount; t++)
+		{
+			scatterOffsets[t * shardCount + s] = offset;
+			offset += shardCounts[t * shardCount + s];
+		}
+	}
+	shardBegin[shardCount] = offset;
+
+	std::vector<uint32_t> shardCorners(cornerCount);
+	runOnThreads(threadCount, [&](uint32_t t) {
+		size_t* offsets{ scatterOffsets.data() + t * shardCount };
+		for (size_t i = sliceBegin(t); i < sliceBegin(t + 1); i++)
+		{
+			shardCorners[offsets[shardOf(hashes[i])]++] = static_cast<uint32_t>(i);
+		}
+	});
+
+	// localIndex[i]: index of corner i's vertex among the unique vertices of its shard
+	std::vector<uint32_t> localIndex(cornerCount);
+	std::vector<uint8_t> firstUse(cornerCount);
+	std::vector<std::vector<uint32_t>> shardFirstCorner(shardCount);
+	runOnThreads(threadCount, [&](uint32_t s) {
+		size_t shardSize{ shardBegin[s + 1] - shardBegin[s] };
+		std::vector<Vertex> shardVertices;
+		shardVertices.reserve(shardSize);
+		VertexWeldTable table{ shardSize };
+		for (size_t k = shardBegin[s]; k < shardBegin[s + 1]; k++)
+		{
+			uint32_t corner{ shardCorners[k] };
+			uint32_t local{ table.weld(corners[corner], hashes[corner], shardVertices) };
+			if (local == shardFirstCorner[s].size())
+			{
+				shardFirstCorner[s].push_back(corner);
+				firstUse[corner] = 1;
+			}
+			localIndex[corner] = local;
+		}
+	});
+
+	std::vector<uint32_t> globalIndex(cornerCount);
+	uint32_t uniqueCount{ 0 };
+	for (size_t i = 0; i < cornerCount; i++)
+	{
+		globalIndex[i] = uniqueCount;
+		uniqueCount += firstUse[i];
+	}
+
+	weldedVertices.resize(uniqueCount);
+	cornerIndices.resize(cornerCount);
+	runOnThreads(threadCount, [&](uint32_t s) {
+		for (uint32_t corner : shardFirstCorner[s])
+		{
+			weldedVertices[globalIndex[corner]] = corners[corner];
+		}
+	});
+	runOnThreads(threadCount, [&](uint32_t t) {
+		for (size_t i = sliceBegin(t); i < sliceBegin(t + 1); i++)
+		{
+			uint32_t s{ shardOf(hashes[i]) };
+			cornerIndices[i] = globalIndex[shardFirstCorner[s][localIndex[i]]];
+		}
+	});
+}
+
+/*
+Post-transform vertex cache simulation. GPUs reuse the vertex shader results of
+recently seen indices; a FIFO of VERTEX_CACHE_SIZE entries is the usual model for
+that. ACMR (average cache miss ratio) is the number of vertex shader invocations
+per triangle, 3 with no reuse at all and around 0.5 at best for a regular mesh.
+ATVR (average transformed vertex ratio) divides the invocations by the vertex count
+instead, so 1.0 means every vertex is shaded exactly once.
+*/
+const uint32_t VERTEX_CACHE_SIZE{ 16 };
+
+struct VertexCacheStats
+{
+	float acmr;
+	float atvr;
+};
+
+inline VertexCacheStats analyzeVertexCache(std::span<const uint32_t> indices, size_t vertexCount,
+	uint32_t cacheSize = VERTEX_CACHE_SIZE)
+{
+	// a vertex is in the FIFO when it entered less than cacheSize misses ago
+	std::vector<uint64_t> insertedAt(vertexCount, 0);
+	uint64_t misses{ 0 };
+	for (uint32_t index : indices)
+	{
+		if (insertedAt[index] == 0 || misses - insertedAt[index] >= cacheSize)
+		{
+			++misses;
+			insertedAt[index] = misses;
+		}
+	}
+	size_t triangleCount{ indices.size() / 3 };
+	return {
+		triangleCount == 0 ? 0.0f : static_cast<float>(misses) / triangleCount,
+		vertexCount == 0 ? 0.0f : static_cast<float>(misses) / vertexCount
+	};
+}
+
+/*
+Reorders the triangles for the post-transform cache with Tipsify (Sander, Nehab and
+Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"). The
+algorithm fans around one vertex at a time, emitting all of its remaining triangles,
+then continues with the vertex among the ones just emitted that is still in the
+cache and will stay there while its own remaining triangles are emitted. When no
+such vertex exists it backtracks through recently used vertices (the dead-end
+stack) and finally scans the vertices in input order. It runs in linear time.
+*/
+inline void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_SIZE)
+{
+	const size_t triangleCount{ indices.size() / 3 };
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// vertex -> triangle adjacency in one flat array
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (uint32_t index : indices)
+	{
+		liveTriangles[index]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEndStack;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+	uint32_t timestamp{ cacheSize + 1 };
+	size_t cursor{ 0 };
+
+	auto skipDeadEnd{ [&]() -> int64_t {
+		while (!deadEndStack.empty())
+		{
+			uint32_t vertex{ deadEndStack.back() };
+			deadEndStack.pop_back();
+			if (liveTriangles[vertex] > 0)
+			{
+				return vertex;
+			}
+		}
+		for (; cursor < vertexCount; cursor++)
+		{
+			if (liveTriangles[cursor] > 0)
+			{
+				return static_cast<int64_t>(cursor);
+			}
+		}
+		return -1;
+	} };
+
+	int64_t fanningVertex{ skipDeadEnd() };
+	while (fanningVertex >= 0)
+	{
+		candidates.clear();
+		for (uint32_t a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; a++)
+		{
+			uint32_t triangle{ adjacency[a] };
+			if (emitted[triangle])
+			{
+				continue;
+			}
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				uint32_t vertex{ indices[triangle * 3 + corner] };
+				output.push_back(vertex);
+				deadEndStack.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (timestamp - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = timestamp++;
+				}
+			}
+			emitted[triangle] = true;
+		}
+
+		// prefer the candidate that entered the cache earliest and still fits in it
+		int64_t best{ -1 };
+		int64_t bestPriority{ -1 };
+		for (uint32_t vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)
+			{
+				continue;
+			}
+			int64_t priority{ 0 };
+			if (timestamp - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+			{
+				priority = timestamp - cacheTime[vertex];
+			}
+			if (priority > bestPriority)
+			{
+				best = vertex;
+				bestPriority = priority;
+			}
+		}
+		fanningVertex = best >= 0 ? best : skipDeadEnd();
+	}
+	indices.swap(output);
+}
+
+/*
+Renumbers the vertices in the order the (already cache optimized) index buffer first
+uses them, so the vertex fetches walk through the vertex buffer mostly sequentially.
+Vertices no triangle refers to are dropped.
+*/
+template<typename VertexType>
+void optimizeVertexFetch(std::vector<VertexType>& vertexArray, std::vector<uint32_t>& indexArray)
+{
+	constexpr uint32_t unused{ std::numeric_limits<uint32_t>::max() };
+	std::vector<uint32_t> remap(vertexArray.size(), unused);
+	std::vector<VertexType> reordered;
+	reordered.reserve(vertexArray.size());
+	for (uint32_t& index : indexArray)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertexArray[index]);
+		}
+		index = remap[index];
+	}
+	vertexArray.swap(reordered);
+}
+
+/*
+Quadric error metric (Garland and Heckbert). A quadric is the sum of squared
+distances to a set of planes, so error(p) tells how far p lies from the surface the
+quadric was accumulated from.
+*/
+struct Quadric
+{
+	float a00{ 0 }, a11{ 0 }, a22{ 0 }, a10{ 0 }, a20{ 0 }, a21{ 0 };
+	float b0{ 0 }, b1{ 0 }, b2{ 0 };
+	float c{ 0 };
+
+	// plane n.p + d = 0 with a unit normal, weighted by w
+	static Quadric fromPlane(const glm::vec3& n, float d, float w)
+	{
+		Quadric q;
+		q.a00 = w * n.x * n.x;
+		q.a11 = w * n.y * n.y;
+		q.a22 = w * n.z * n.z;
+		q.a10 = w * n.y * n.x;
+		q.a20 = w * n.z * n.x;
+		q.a21 = w * n.z * n.y;
+		q.b0 = w * n.x * d;
+		q.b1 = w * n.y * d;
+		q.b2 = w * n.z * d;
+		q.c = w * d * d;
+		return q;
+	}
+
+	Quadric& operator+=(const Quadric& other)
+	{
+		a00 += other.a00; a11 += other.a11; a22 += other.a22;
+		a10 += other.a10; a20 += other.a20; a21 += other.a21;
+		b0 += other.b0; b1 += other.b1; b2 += other.b2;
+		c += other.c;
+		return *this;
+	}
+
+	float error(const glm::vec3& p) const
+	{
+		float rx{ a00 * p.x + a10 * p.y + a20 * p.z };
+		float ry{ a10 * p.x + a11 * p.y + a21 * p.z };
+		float rz{ a20 * p.x + a21 * p.y + a22 * p.z };
+		float e{ p.x * rx + p.y * ry + p.z * rz + 2.0f * (p.x * b0 + p.y * b1 + p.z * b2) + c };
+		return std::abs(e);
+	}
+};
+
+/*
+Edge collapse simplification of an indexed triangle mesh that only writes a new index
+buffer: every collapse moves a vertex onto one of its neighbours, so all LODs can
+share the original vertex buffer. The approach follows meshoptimizer's simplifier:
+	- vertices with the same position but different attributes (UV seams) are
+	  "wedges" of one position, linked in a ring through wedge[]
+	- every position is classified as manifold (interior, one wedge), border (on an
+	  open edge), seam (two wedges along a seam edge) or locked (anything more
+	  complex). Borders and seams may only collapse along themselves, onto a vertex
+	  of the same kind or a locked one, which keeps outlines and UV charts intact
+	- each pass collects the cheapest collapse per edge, sorts them by quadric error
+	  and performs as many as possible without touching a vertex twice or flipping a
+	  triangle, until targetIndexCount is reached or the next collapse would exceed
+	  targetError
+Errors are relative to the largest side of the mesh bounding box; resultError
+returns the largest error of all collapses in mesh units.
+*/
+inline std::vector<uint32_t> simplifyMesh(std::span<const Vertex> vertexArray, std::span<const uint32_t> indexArray,
+	size_t targetIndexCount, float targetError, float& resultError)
+{
+	enum VertexKind : uint8_t { Manifold, Border, Seam, Locked };
+	constexpr bool canCollapse[4][4]{
+		{ true, true, true, true },
+		{ false, true, false, true },
+		{ false, false, true, true },
+		{ false, false, false, false }
+	};
+	// open edges weigh more than surface planes, or borders would erode first
+	constexpr float edgeWeight{ 10.0f };
+
+	const size_t vertexCount{ vertexArray.size() };
+	resultError = 0.0f;
+
+	glm::vec3 minimum{ std::numeric_limits<float>::max() };
+	glm::vec3 maximum{ std::numeric_limits<float>::lowest() };
+	for (const Vertex& vertex : vertexArray)
+	{
+		minimum = glm::min(minimum, vertex.pos);
+		maximum = glm::max(maximum, vertex.pos);
+	}
+	float scale{ std::max({ maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z, 1e-20f }) };
+	std::vector<glm::vec3> positions(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		positions[i] = (vertexArray[i].pos - minimum) / scale;
+	}
+
+	// remap[v]: first vertex with the same position, wedge[v]: next vertex in the ring
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<uint32_t> wedge(vertexCount);
+	{
+		std::vector<uint32_t> order(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; i++)
+		{
+			order[i] = i;
+		}
+		auto key{ [&](uint32_t v) { return std::array<float, 3>{ positions[v].x, positions[v].y, positions[v].z }; } };
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return key(a) < key(b) || (key(a) == key(b) && a < b); });
+		for (size_t begin = 0, end = 0; begin < vertexCount; begin = end)
+		{
+			while (end < vertexCount && key(order[end]) == key(order[begin]))
+			{
+				end++;
+			}
+			for (size_t k = begin; k < end; k++)
+			{
+				remap[order[k]] = order[begin];
+				wedge[order[k]] = order[k + 1 < end ? k + 1 : begin];
+			}
+		}
+	}
+
+	std::vector<uint32_t> result(indexArray.begin(), indexArray.end());
+
+	// vertex -> triangle adjacency of the current index buffer
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	auto buildAdjacency{ [&]() {
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index : result)
+		{
+			adjacencyOffsets[index + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	} };
+	// true when a triangle has the directed edge a -> b
+	auto hasEdge{ [&](uint32_t a, uint32_t b) {
+		for (uint32_t k = adjacencyOffsets[a]; k < adjacencyOffsets[a + 1]; k++)
+		{
+			const uint32_t* triangle{ &result[adjacency[k] * 3] };
+			for (int corner = 0; corner < 3; corner++)
+			{
+				if (triangle[corner] == a && triangle[(corner + 1) % 3] == b)
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	} };
+
+	buildAdjacency();
+
+	// classification, done once on the input like meshoptimizer does
+	std::vector<uint8_t> kind(vertexCount, Locked);
+	{
+		struct OpenEdges { uint32_t outCount{ 0 }, inCount{ 0 }, outTarget{ 0 }, inSource{ 0 }; };
+		auto openEdges{ [&](uint32_t v) {
+			OpenEdges open;
+			for (uint32_t k = adjacencyOffsets[v]; k < adjacencyOffsets[v + 1]; k++)
+			{
+				const uint32_t* triangle{ &result[adjacency[k] * 3] };
+				for (int corner = 0; corner < 3; corner++)
+				{
+					if (triangle[corner] != v)
+					{
+						continue;
+					}
+					uint32_t next{ triangle[(corner + 1) % 3] };
+					uint32_t previous{ triangle[(corner + 2) % 3] };
+					if (!hasEdge(next, v))
+					{
+						open.outCount++;
+						open.outTarget = next;
+					}
+					if (!hasEdge(v, previous))
+					{
+						open.inCount++;
+						open.inSource = previous;
+					}
+				}
+			}
+			return open;
+		} };
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			if (remap[v] != v)
+			{
+				continue;
+			}
+			uint8_t k{ Locked };
+			if (wedge[v] == v)
+			{
+				OpenEdges open{ openEdges(v) };
+				if (open.outCount == 0 && open.inCount == 0)
+				{
+					k = Manifold;
+				}
+				else if (open.outCount == 1 && open.inCount == 1)
+				{
+					k = Border;
+				}
+			}
+			else if (wedge[wedge[v]] == v)
+			{
+				// both wedges have one open edge in and out, and they run along the same positions
+				uint32_t w{ wedge[v] };
+				OpenEdges openV{ openEdges(v) };
+				OpenEdges openW{ openEdges(w) };
+				if (openV.outCount == 1 && openV.inCount == 1 && openW.outCount == 1 && openW.inCount == 1 &&
+					remap[openV.outTarget] == remap[openW.inSource] && remap[openV.inSource] == remap[openW.outTarget])
+				{
+					k = Seam;
+				}
+			}
+			for (uint32_t w = v; ; )
+			{
+				kind[w] = k;
+				w = wedge[w];
+				if (w == v)
+				{
+					break;
+				}
+			}
+		}
+	}
+
+	// quadrics per position: triangle planes weighted by area, plus open edges
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i + 3 <= result.size(); i += 3)
+	{
+		const uint32_t* triangle{ &result[i] };
+		glm::vec3 p0{ positions[triangle[0]] }, p1{ positions[triangle[1]] }, p2{ positions[triangle[2]] };
+		glm::vec3 normal{ glm::cross(p1 - p0, p2 - p0) };
+		float doubleArea{ glm::length(normal) };
+		if (doubleArea > 0.0f)
+		{
+			normal /= doubleArea;
+		}
+		Quadric plane{ Quadric::fromPlane(normal, -glm::dot(normal, p0), doubleArea * 0.5f) };
+		for (int corner = 0; corner < 3; corner++)
+		{
+			quadrics[remap[triangle[corner]]] += plane;
+
+			uint32_t a{ triangle[corner] };
+			uint32_t b{ triangle[(corner + 1) % 3] };
+			if (hasEdge(b, a))
+			{
+				continue;
+			}
+			// plane through the open edge, perpendicular to the triangle
+			glm::vec3 edge{ positions[b] - positions[a] };
+			float length{ glm::length(edge) };
+			glm::vec3 edgeNormal{ glm::cross(edge, normal) };
+			float normalLength{ glm::length(edgeNormal) };
+			if (normalLength > 0.0f)
+			{
+				edgeNormal /= normalLength;
+				Quadric edgePlane{ Quadric::fromPlane(edgeNormal, -glm::dot(edgeNormal, positions[a]), length * edgeWeight) };
+				quadrics[remap[a]] += edgePlane;
+				quadrics[remap[b]] += edgePlane;
+			}
+		}
+	}
+
+	// moving position from onto position to must not turn any remaining triangle around
+	auto flipsTriangle{ [&](uint32_t from, uint32_t to) {
+		for (uint32_t v = from; ; )
+		{
+			for (uint32_t k = adjacencyOffsets[v]; k < adjacencyOffsets[v + 1]; k++)
+			{
+				const uint32_t* triangle{ &result[adjacency[k] * 3] };
+				glm::vec3 before[3], after[3];
+				bool collapses{ false };
+				for (int corner = 0; corner < 3; corner++)
+				{
+					uint32_t position{ remap[triangle[corner]] };
+					collapses |= position == to;
+					before[corner] = positions[position];
+					after[corner] = position == from ? positions[to] : before[corner];
+				}
+				if (collapses)
+				{
+					continue;
+				}
+				glm::vec3 normalBefore{ glm::cross(before[1] - before[0], before[2] - before[0]) };
+				glm::vec3 normalAfter{ glm::cross(after[1] - after[0], after[2] - after[0]) };
+				if (glm::dot(normalBefore, normalAfter) <= 0.0f)
+				{
+					return true;
+				}
+			}
+			v = wedge[v];
+			if (v == from)
+			{
+				return false;
+			}
+		}
+	} };
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		float error;
+	};
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> collapseRemap(vertexCount);
+	std::vector<uint8_t> collapseLocked(vertexCount);
+	const float errorLimit{ targetError * targetError };
+	float maxError{ 0.0f };
+
+	while (result.size() > targetIndexCount)
+	{
+		// cheapest allowed direction of every edge
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			uint32_t a{ result[i] };
+			uint32_t b{ result[i - i % 3 + (i % 3 + 1) % 3] };
+			uint32_t ra{ remap[a] }, rb{ remap[b] };
+			bool open{ !hasEdge(b, a) };
+			// closed edges show up in two triangles, only look at them once
+			if (!open && ra > rb)
+			{
+				continue;
+			}
+			Collapse best{ 0, 0, std::numeric_limits<float>::max() };
+			for (auto [from, to] : { std::pair{ a, b }, { b, a } })
+			{
+				uint8_t kindFrom{ kind[from] };
+				if (!canCollapse[kindFrom][kind[to]] || (kindFrom != Manifold && !open))
+				{
+					continue;
+				}
+				Quadric q{ quadrics[remap[from]] };
+				q += quadrics[remap[to]];
+				float error{ q.error(positions[to]) };
+				if (error < best.error)
+				{
+					best = { from, to, error };
+				}
+			}
+			if (best.error != std::numeric_limits<float>::max())
+			{
+				collapses.push_back(best);
+			}
+		}
+		if (collapses.empty())
+		{
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			collapseRemap[v] = v;
+		}
+		std::fill(collapseLocked.begin(), collapseLocked.end(), 0);
+		size_t triangleGoal{ (result.size() - targetIndexCount) / 3 };
+		size_t trianglesRemoved{ 0 };
+		size_t performed{ 0 };
+		for (const Collapse& collapse : collapses)
+		{
+			if (collapse.error > errorLimit || trianglesRemoved >= triangleGoal)
+			{
+				break;
+			}
+			uint32_t from{ remap[collapse.from] }, to{ remap[collapse.to] };
+			if (collapseLocked[from] || collapseLocked[to] || flipsTriangle(from, to))
+			{
+				continue;
+			}
+			if (kind[collapse.from] == Seam)
+			{
+				// the other wedge moves along the matching seam edge onto the other wedge of to
+				uint32_t otherFrom{ wedge[collapse.from] };
+				uint32_t otherTo{ collapse.to };
+				bool found{ wedge[collapse.to] == collapse.to };
+				for (uint32_t k = adjacencyOffsets[otherFrom]; k < adjacencyOffsets[otherFrom + 1]; k++)
+				{
+					const uint32_t* triangle{ &result[adjacency[k] * 3] };
+					for (int corner = 0; corner < 3; corner++)
+					{
+						if (remap[triangle[corner]] == to && triangle[corner] != collapse.to)
+						{
+							otherTo = triangle[corner];
+							found = true;
+						}
+					}
+				}
+				if (!found)
+				{
+					continue;
+				}
+				collapseRemap[collapse.from] = collapse.to;
+				collapseRemap[otherFrom] = otherTo;
+				trianglesRemoved += 1;
+			}
+			else
+			{
+				// manifold and border positions only have the one wedge
+				collapseRemap[collapse.from] = collapse.to;
+				trianglesRemoved += kind[collapse.from] == Border ? 1 : 2;
+			}
+			quadrics[to] += quadrics[from];
+			collapseLocked[from] = 1;
+			collapseLocked[to] = 1;
+			maxError = std::max(maxError, collapse.error);
+			performed++;
+		}
+		if (performed == 0)
+		{
+			break;
+		}
+
+		size_t write{ 0 };
+		for (size_t i = 0; i + 3 <= result.size(); i += 3)
+		{
+			uint32_t v0{ collapseRemap[result[i]] }, v1{ collapseRemap[result[i + 1]] }, v2{ collapseRemap[result[i + 2]] };
+			if (remap[v0] != remap[v1] && remap[v0] != remap[v2] && remap[v1] != remap[v2])
+			{
+				result[write++] = v0;
+				result[write++] = v1;
+				result[write++] = v2;
+			}
+		}
+		result.resize(write);
+		buildAdjacency();
+	}
+
+	resultError = std::sqrt(maxError) * scale;
+	return result;
+}
+
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// distance the surface may have moved from the full detail mesh, in model units
+	float error;
+	uint32_t reserved;
+};
+
+/*
+A range of the index buffer that is drawn with one vkCmdDrawIndexed. vertexOffset is
+added to every index by the GPU, which lets each range store indices relative to the
+first vertex it uses.
+*/
+struct SubMesh
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t vertexOffset;
+};
+
+struct IndexBufferLayout
+{
+	VkIndexType indexType;
+	// only used with VK_INDEX_TYPE_UINT16, 32-bit buffers are uploaded as they are
+	std::vector<uint16_t> indices16;
+	std::vector<SubMesh> subMeshes;
+	/*
+	Set when the mesh was split: vertex i of the new vertex buffer is vertex
+	vertexRemap[i] of the old one. Vertices used by more than one sub-mesh appear
+	once per sub-mesh.
+	*/
+	std::vector<uint32_t> vertexRemap;
+};
+
+/*
+Picks the narrowest index type for a mesh. Up to 65536 vertices the indices simply
+get narrowed. Larger meshes are split when allowed: triangles are taken in index
+buffer order (which keeps the vertex cache order) and a new sub-mesh starts whenever
+the next triangle would bring the current one over 65536 distinct vertices. Every
+sub-mesh gets its own contiguous range of the vertex buffer, numbered in first-use
+order, and draws with vertexOffset pointing at the start of that range.
+*/
+inline IndexBufferLayout chooseIndexBufferLayout(std::span<const uint32_t> indexArray, size_t vertexCount, bool allowSplit)
+{
+	constexpr uint32_t maxSubMeshVertices{ 1 << 16 };
+	IndexBufferLayout layout{};
+	if (vertexCount > maxSubMeshVertices && !allowSplit)
+	{
+		layout.indexType = VK_INDEX_TYPE_UINT32;
+		layout.subMeshes = { { 0, static_cast<uint32_t>(indexArray.size()), 0 } };
+		return layout;
+	}
+	layout.indexType = VK_INDEX_TYPE_UINT16;
+	layout.indices16.resize(indexArray.size());
+	if (vertexCount <= maxSubMeshVertices)
+	{
+		std::transform(indexArray.begin(), indexArray.end(), layout.indices16.begin(),
+			[](uint32_t index) { return static_cast<uint16_t>(index); });
+		layout.subMeshes = { { 0, static_cast<uint32_t>(indexArray.size()), 0 } };
+		return layout;
+	}
+
+	// subMeshOf[v] is the last sub-mesh vertex v was added to, localIndex[v] its index there
+	constexpr uint32_t none{ std::numeric_limits<uint32_t>::max() };
+	std::vector<uint32_t> subMeshOf(vertexCount, none);
+	std::vector<uint32_t> localIndex(vertexCount);
+	uint32_t subMeshVertices{ 0 };
+	layout.subMeshes.push_back({ 0, 0, 0 });
+	for (uint32_t i = 0; i + 3 <= indexArray.size(); i += 3)
+	{
+		uint32_t current{ static_cast<uint32_t>(layout.subMeshes.size() - 1) };
+		uint32_t added{ 0 };
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			// a repeated vertex inside one (degenerate) triangle is only counted once
+			uint32_t index{ indexArray[i + corner] };
+			bool repeated{ (corner > 0 && index == indexArray[i]) || (corner > 1 && index == indexArray[i + 1]) };
+			added += subMeshOf[index] != current && !repeated;
+		}
+		if (subMeshVertices + added > maxSubMeshVertices)
+		{
+			layout.subMeshes.push_back({ i, 0, static_cast<int32_t>(layout.vertexRemap.size()) });
+			subMeshVertices = 0;
+			++current;
+		}
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			uint32_t index{ indexArray[i + corner] };
+			if (subMeshOf[index] != current)
+			{
+				subMeshOf[index] = current;
+				localIndex[index] = subMeshVertices++;
+				layout.vertexRemap.push_back(index);
+			}
+			layout.indices16[i + corner] = static_cast<uint16_t>(localIndex[index]);
+		}
+		layout.subMeshes.back().indexCount += 3;
+	}
+	return layout;
+}
+
+/*
+A meshlet is a run of consecutive triangles of the index buffer that uses at most
+MESHLET_MAX_VERTICES distinct vertices. The index buffer is in vertex cache order,
+so neighbouring triangles mostly land in the same meshlet, which keeps the bounds
+tight and lets visible meshlets that follow each other be drawn as one range.
+*/
+struct Meshlet
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// vertexOffset of the sub-mesh the meshlet was cut from
+	int32_t vertexOffset;
+	// bounding sphere in model space
+	glm::vec3 center;
+	float radius;
+	/*
+	All triangles face away from a camera at position c when
+	dot(normalize(coneApex - c), coneAxis) >= coneCutoff. Meshlets whose normals
+	spread too far for the test to ever pass get a zero axis.
+	*/
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// Meshlet as shader.mesh reads it from its storage buffer.
+struct GpuMeshlet
+{
+	// first entry in MeshletBuild::vertices
+	uint32_t vertexOffset;
+	// first byte in MeshletBuild::triangles
+	uint32_t triangleOffset;
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+struct MeshletBuild
+{
+	std::vector<Meshlet> meshlets;
+	// the rest is only needed by the mesh shader path
+	std::vector<GpuMeshlet> gpuMeshlets;
+	// vertex buffer index of every meshlet vertex
+	std::vector<uint32_t> vertices;
+	// three meshlet local vertex indices per triangle, padded to whole words at the end
+	std::vector<uint8_t> triangles;
+};
+
+/*
+Bounds as in meshoptimizer's meshopt_computeClusterBounds: the sphere is centred on
+the bounding box, the cone axis is the average triangle normal and its apex is moved
+back along the axis until every triangle plane lies in front of it.
+*/
+inline void computeMeshletBounds(std::span<const Vertex> vertices, std::span<const uint32_t> triangleIndices,
+	int32_t vertexOffset, Meshlet& meshlet)
+{
+	glm::vec3 minPos{ std::numeric_limits<float>::max() };
+	glm::vec3 maxPos{ std::numeric_limits<float>::lowest() };
+	for (uint32_t index : triangleIndices)
+	{
+		minPos = glm::min(minPos, vertices[index + vertexOffset].pos);
+		maxPos = glm::max(maxPos, vertices[index + vertexOffset].pos);
+	}
+	meshlet.center = (minPos + maxPos) * 0.5f;
+	meshlet.radius = 0.0f;
+	for (uint32_t index : triangleIndices)
+	{
+		meshlet.radius = std::max(meshlet.radius, glm::distance(vertices[index + vertexOffset].pos, meshlet.center));
+	}
+
+	std::array<glm::vec3, MESHLET_MAX_TRIANGLES> normals;
+	glm::vec3 normalSum{ 0.0f };
+	size_t triangleCount{ triangleIndices.size() / 3 };
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		const glm::vec3& p0{ vertices[triangleIndices[i * 3] + vertexOffset].pos };
+		glm::vec3 normal{ glm::cross(vertices[triangleIndices[i * 3 + 1] + vertexOffset].pos - p0,
+			vertices[triangleIndices[i * 3 + 2] + vertexOffset].pos - p0) };
+		float length{ glm::length(normal) };
+		// degenerate triangles are never rasterized, they don't constrain the cone
+		normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+		normalSum += normals[i];
+	}
+	meshlet.coneApex = meshlet.center;
+	meshlet.coneAxis = glm::vec3(0.0f);
+	meshlet.coneCutoff = 1.0f;
+	float sumLength{ glm::length(normalSum) };
+	if (sumLength == 0.0f)
+	{
+		return;
+	}
+	glm::vec3 axis{ normalSum / sumLength };
+	float minDot{ 1.0f };
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		if (normals[i] != glm::vec3(0.0f))
+		{
+			minDot = std::min(minDot, glm::dot(normals[i], axis));
+		}
+	}
+	// a cone wider than ~84 degrees hardly ever culls and its apex would be far away
+	if (minDot <= 0.1f)
+	{
+		return;
+	}
+	float maxT{ 0.0f };
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		if (normals[i] != glm::vec3(0.0f))
+		{
+			const glm::vec3& p0{ vertices[triangleIndices[i * 3] + vertexOffset].pos };
+			maxT = std::max(maxT, glm::dot(meshlet.center - p0, normals[i]) / glm::dot(normals[i], axis));
+		}
+	}
+	meshlet.coneApex = meshlet.center - axis * maxT;
+	meshlet.coneAxis = axis;
+	meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+/*
+Cuts the triangles of one sub-mesh into meshlets and appends them to build.
+indexArray holds the indices of the sub-mesh as drawn, i.e. before vertexOffset is
+added, starting at firstIndex in the index buffer. It is rewritten in meshlet order
+so every meshlet is one contiguous index range.
+
+Like meshoptimizer's meshopt_buildMeshlets a meshlet grows through the triangles
+that touch it, preferring those that add the fewest new vertices and whose normal is
+closest to the meshlet's average normal, which keeps the normal cones narrow enough
+to cull anything. Triangles count as touching when they share a vertex position, so
+texture seams don't cut the meshlets apart. When nothing touches the meshlet any
+more the next unused triangle in index buffer (vertex cache) order is taken.
+*/
+inline void buildMeshlets(std::span<const Vertex> vertices, std::span<uint32_t> indexArray, uint32_t firstIndex,
+	int32_t vertexOffset, MeshletBuild& build)
+{
+	uint32_t triangleCount{ static_cast<uint32_t>(indexArray.size() / 3) };
+	if (triangleCount == 0)
+	{
+		return;
+	}
+	uint32_t vertexCount{ *std::max_element(indexArray.begin(), indexArray.end()) + 1 };
+
+	// position[v] is the first vertex with the same position as vertex v
+	std::vector<uint32_t> byPosition(vertexCount);
+	std::iota(byPosition.begin(), byPosition.end(), 0);
+	auto positionLess = [&](uint32_t a, uint32_t b)
+	{
+		const glm::vec3& pa{ vertices[a + vertexOffset].pos };
+		const glm::vec3& pb{ vertices[b + vertexOffset].pos };
+		return std::tie(pa.x, pa.y, pa.z, a) < std::tie(pb.x, pb.y, pb.z, b);
+	};
+	std::sort(byPosition.begin(), byPosition.end(), positionLess);
+	std::vector<uint32_t> position(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		bool samePosition{ i > 0 && vertices[byPosition[i] + vertexOffset].pos == vertices[byPosition[i - 1] + vertexOffset].pos };
+		position[byPosition[i]] = samePosition ? position[byPosition[i - 1]] : byPosition[i];
+	}
+
+	// the triangles around every position, adjacency[adjacencyOffsets[p]] up to adjacency[adjacencyOffsets[p + 1]]
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t index : indexArray.first(triangleCount * 3))
+	{
+		adjacencyOffsets[position[index] + 1]++;
+	}
+	std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+	// unused triangles around every position, positions without any are skipped when looking for neighbours
+	std::vector<uint32_t> liveTriangles(vertexCount);
+	for (uint32_t p = 0; p < vertexCount; p++)
+	{
+		liveTriangles[p] = adjacencyOffsets[p + 1] - adjacencyOffsets[p];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (uint32_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacency[adjacencyFill[position[indexArray[i]]]++] = i / 3;
+	}
+
+	std::vector<glm::vec3> normals(triangleCount);
+	for (uint32_t triangle = 0; triangle < triangleCount; triangle++)
+	{
+		const glm::vec3& p0{ vertices[indexArray[triangle * 3] + vertexOffset].pos };
+		glm::vec3 normal{ glm::cross(vertices[indexArray[triangle * 3 + 1] + vertexOffset].pos - p0,
+			vertices[indexArray[triangle * 3 + 2] + vertexOffset].pos - p0) };
+		float length{ glm::length(normal) };
+		normals[triangle] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+	}
+
+	constexpr uint8_t none{ 0xff };
+	std::vector<uint8_t> localIndex(vertexCount, none);
+	std::vector<uint8_t> used(triangleCount, 0);
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint32_t> meshletTriangles;
+	glm::vec3 normalSum{ 0.0f };
+	std::vector<uint32_t> reordered;
+	reordered.reserve(triangleCount * 3);
+
+	auto newVertices = [&](uint32_t triangle)
+	{
+		uint32_t a{ indexArray[triangle * 3] }, b{ indexArray[triangle * 3 + 1] }, c{ indexArray[triangle * 3 + 2] };
+		return static_cast<uint32_t>(localIndex[a] == none) + (localIndex[b] == none && b != a) +
+			(localIndex[c] == none && c != a && c != b);
+	};
+	auto addTriangle = [&](uint32_t triangle)
+	{
+		used[triangle] = 1;
+		for (uint32_t corner = 0; corner < 3; corner++)
+		{
+			uint32_t index{ indexArray[triangle * 3 + corner] };
+			liveTriangles[position[index]]--;
+			if (localIndex[index] == none)
+			{
+				localIndex[index] = static_cast<uint8_t>(meshletVertices.size());
+				meshletVertices.push_back(index);
+			}
+		}
+		meshletTriangles.push_back(triangle);
+		normalSum += normals[triangle];
+	};
+	auto finishMeshlet = [&]()
+	{
+		uint32_t start{ static_cast<uint32_t>(reordered.size()) };
+		for (uint32_t triangle : meshletTriangles)
+		{
+			for (uint32_t corner = 0; corner < 3; corner++)
+			{
+				reordered.push_back(indexArray[triangle * 3 + corner]);
+				build.triangles.push_back(localIndex[indexArray[triangle * 3 + corner]]);
+			}
+		}
+		Meshlet meshlet{ firstIndex + start, static_cast<uint32_t>(reordered.size()) - start, vertexOffset };
+		computeMeshletBounds(vertices, std::span<const uint32_t>(reordered).subspan(start), vertexOffset, meshlet);
+		build.meshlets.push_back(meshlet);
+		build.gpuMeshlets.push_back({ static_cast<uint32_t>(build.vertices.size()),
+			static_cast<uint32_t>(build.triangles.size() - meshletTriangles.size() * 3),
+			static_cast<uint32_t>(meshletVertices.size()), static_cast<uint32_t>(meshletTriangles.size()) });
+		for (uint32_t index : meshletVertices)
+		{
+			build.vertices.push_back(index + vertexOffset);
+			localIndex[index] = none;
+		}
+		meshletVertices.clear();
+		meshletTriangles.clear();
+		normalSum = glm::vec3(0.0f);
+	};
+
+	uint32_t nextUnused{ 0 };
+	for (uint32_t added = 0; added < triangleCount; added++)
+	{
+		constexpr uint32_t noTriangle{ std::numeric_limits<uint32_t>::max() };
+		uint32_t best{ noTriangle };
+		float bestScore{ std::numeric_limits<float>::max() };
+		float axisLength{ glm::length(normalSum) };
+		glm::vec3 axis{ axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f) };
+		// newest vertices first, they are on the border; a triangle that fits perfectly ends the search
+		for (auto vertex = meshletVertices.rbegin(); vertex != meshletVertices.rend() && bestScore > 0.01f; ++vertex)
+		{
+			uint32_t p{ position[*vertex] };
+			if (liveTriangles[p] == 0)
+			{
+				continue;
+			}
+			for (uint32_t i = adjacencyOffsets[p]; i < adjacencyOffsets[p + 1]; i++)
+			{
+				uint32_t triangle{ adjacency[i] };
+				uint32_t extra{ used[triangle] ? none : newVertices(triangle) };
+				if (extra == none || meshletVertices.size() + extra > MESHLET_MAX_VERTICES)
+				{
+					continue;
+				}
+				float score{ extra + (1.0f - glm::dot(normals[triangle], axis)) };
+				if (score < bestScore)
+				{
+					best = triangle;
+					bestScore = score;
+				}
+			}
+		}
+		if (best == noTriangle)
+		{
+			while (used[nextUnused])
+			{
+				nextUnused++;
+			}
+			best = nextUnused;
+			if (meshletVertices.size() + newVertices(best) > MESHLET_MAX_VERTICES)
+			{
+				finishMeshlet();
+			}
+		}
+		addTriangle(best);
+		if (meshletTriangles.size() == MESHLET_MAX_TRIANGLES)
+		{
+			finishMeshlet();
+		}
+	}
+	if (!meshletTriangles.empty())
+	{
+		finishMeshlet();
+	}
+	std::copy(reordered.begin(), reordered.end(), indexArray.begin());
+	build.triangles.resize((build.triangles.size() + 3) & ~size_t{ 3 });
+}
+
+/*
+Textures can be baked into KTX2 files that already contain every mip level, so
+loading them is a single copy instead of a decode plus a chain of blits. Only the
+subset of KTX2 that the baker writes is read back: one 2D image (no array layers,
+faces or depth), no supercompression.
+*/
+constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER{ 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+struct Ktx2Header
+{
+	uint8_t identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header layout");
+
+// one per mip level right after the header, level 0 first
+struct Ktx2LevelIndex
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+struct TextureFormatInfo
+{
+	uint32_t blockWidth;
+	uint32_t blockHeight;
+	uint32_t bytesPerBlock;
+};
+
+// Formats the baker writes and the loader accepts; blockWidth is 0 for anything else.
+inline TextureFormatInfo textureFormatInfo(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+		return { 1, 1, 4 };
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		return { 4, 4, 8 };
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return { 4, 4, 16 };
+	default:
+		return { 0, 0, 0 };
+	}
+}
+
+inline uint64_t textureLevelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+	TextureFormatInfo info{ textureFormatInfo(format) };
+	return static_cast<uint64_t>((width + info.blockWidth - 1) / info.blockWidth) *
+		((height + info.blockHeight - 1) / info.blockHeight) * info.bytesPerBlock;
+}
+
+inline bool isSrgbTextureFormat(VkFormat format)
+{
+	return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ||
+		format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+// bytes per sample of the depth formats findDepthFormat picks from, stencil padded like most GPUs store it
+inline uint32_t depthFormatBytes(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_D16_UNORM:
+		return 2;
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return 8;
+	default:
+		return 4;
+	}
+}
+
+inline const char* depthFormatName(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_D16_UNORM:
+		return "D16";
+	case VK_FORMAT_D32_SFLOAT:
+		return "D32";
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return "D32S8";
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+		return "D24S8";
+	default:
+		return "unknown";
+	}
+}
+
+// the names --present-mode takes
+inline const char* presentModeName(VkPresentModeKHR presentMode)
+{
+	switch (presentMode)
+	{
+	case VK_PRESENT_MODE_FIFO_KHR:
+		return "fifo";
+	case VK_PRESENT_MODE_MAILBOX_KHR:
+		return "mailbox";
+	case VK_PRESENT_MODE_IMMEDIATE_KHR:
+		return "immediate";
+	case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+		return "relaxed";
+	default:
+		return "unknown";
+	}
+}
+
+inline const char* textureFormatName(VkFormat format)
+{
+	switch (format)
+	{
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_R8G8B8A8_UNORM:
+		return "rgba8";
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		return "bc1";
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+		return "bc3";
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return "bc7";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+The data format descriptor KTX2 requires: a single Khronos basic descriptor block.
+Uncompressed formats get one sample per channel, block-compressed ones one sample
+per 64-bit half of the block, with the color model naming the compression scheme.
+Only the formats of textureFormatInfo are described.
+*/
+inline std::vector<uint32_t> makeKtx2Dfd(VkFormat format)
+{
+	constexpr uint32_t modelRgbsda{ 1 };
+	constexpr uint32_t modelBc1{ 128 };
+	constexpr uint32_t modelBc3{ 130 };
+	constexpr uint32_t modelBc7{ 135 };
+	constexpr uint32_t primariesBt709{ 1 };
+	constexpr uint32_t transferLinear{ 1 };
+	constexpr uint32_t transferSrgb{ 2 };
+	constexpr uint32_t channelAlpha{ 15 };
+	// sample qualifier: the channel is stored linearly even though the transfer function is sRGB
+	constexpr uint32_t qualifierLinear{ 0x10 };
+	bool srgb{ isSrgbTextureFormat(format) };
+	TextureFormatInfo info{ textureFormatInfo(format) };
+
+	std::vector<uint32_t> dfd{ 0, 0, 0, 0, 0, 0, 0 };
+	auto addSample{ [&](uint32_t channelType, uint32_t bitOffset, uint32_t bitLength, uint32_t upper)
+		{
+			if (srgb && channelType == channelAlpha)
+			{
+				channelType |= qualifierLinear;
+			}
+			dfd.push_back(bitOffset | (bitLength - 1) << 16 | channelType << 24);
+			dfd.push_back(0);
+			dfd.push_back(0);
+			dfd.push_back(upper);
+		} };
+	uint32_t model{ modelRgbsda };
+	switch (format)
+	{
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		model = modelBc1;
+		addSample(0, 0, 64, UINT32_MAX);
+		break;
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+		model = modelBc3;
+		addSample(channelAlpha, 0, 64, UINT32_MAX);
+		addSample(0, 64, 64, UINT32_MAX);
+		break;
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		model = modelBc7;
+		addSample(0, 0, 128, UINT32_MAX);
+		break;
+	default:
+		for (uint32_t channel = 0; channel < 4; channel++)
+		{
+			addSample(channel == 3 ? channelAlpha : channel, channel * 8, 8, 255);
+		}
+		break;
+	}
+	dfd[0] = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+	// vendor Khronos, descriptor type basic, version 2, block size
+	dfd[2] = 2 | (dfd[0] - 4) << 16;
+	dfd[3] = model | primariesBt709 << 8 | (srgb ? transferSrgb : transferLinear) << 16;
+	// texel block dimensions are stored minus one, so 0 means 1x1
+	dfd[4] = (info.blockWidth - 1) | (info.blockHeight - 1) << 8;
+	dfd[5] = info.bytesPerBlock;
+	return dfd;
+}
+
+/*
+Writes levels (level 0 first) as a KTX2 file. The level data is stored smallest
+level first as the specification asks for, each level aligned to 16 bytes which
+covers the required alignment of every block size used here.
+*/
+inline bool writeKtx2(const std::string& path, VkFormat format, uint32_t width, uint32_t height,
+	std::span<const std::vector<uint8_t>> levels)
+{
+	std::vector<uint32_t> dfd{ makeKtx2Dfd(format) };
+	Ktx2Header header{};
+	std::copy(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), header.identifier);
+	header.vkFormat = format;
+	header.typeSize = 1;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.faceCount = 1;
+	header.levelCount = static_cast<uint32_t>(levels.size());
+	header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + levels.size() * sizeof(Ktx2LevelIndex));
+	header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+	std::vector<Ktx2LevelIndex> levelIndex(levels.size());
+	uint64_t offset{ header.dfdByteOffset + header.dfdByteLength };
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		offset = (offset + 15) & ~uint64_t{ 15 };
+		levelIndex[i] = { offset, levels[i].size(), levels[i].size() };
+		offset += levels[i].size();
+	}
+
+	std::string tempPath{ path + ".tmp" };
+	std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+	if (!file.is_open())
+	{
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(levelIndex.data()), levelIndex.size() * sizeof(Ktx2LevelIndex));
+	file.write(reinterpret_cast<const char*>(dfd.data()), dfd.size() * sizeof(uint32_t));
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		static const char padding[16]{};
+		file.write(padding, levelIndex[i].byteOffset - file.tellp());
+		file.write(reinterpret_cast<const char*>(levels[i].data()), levels[i].size());
+	}
+	file.close();
+	std::error_code ec;
+	if (!file)
+	{
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	std::filesystem::rename(tempPath, path, ec);
+	return !ec;
+}
+
+// A mapped KTX2 file, levels[i] points at the data of mip level i.
+struct Ktx2File
+{
+	MappedFile file;
+	VkFormat format{ VK_FORMAT_UNDEFINED };
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+	std::vector<std::span<const uint8_t>> levels;
+
+	bool open(const std::string& path)
+	{
+		levels.clear();
+		if (!file.open(path) || file.size < sizeof(Ktx2Header))
+		{
+			return false;
+		}
+		Ktx2Header header;
+		memcpy(&header, file.data, sizeof(header));
+		format = static_cast<VkFormat>(header.vkFormat);
+		width = header.pixelWidth;
+		height = header.pixelHeight;
+		uint32_t maxLevels{ static_cast<uint32_t>(std::floor(std::log2(std::max({ width, height, 1u })))) + 1 };
+		if (!std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), header.identifier) ||
+			textureFormatInfo(format).blockWidth == 0 || width == 0 || height == 0 || header.pixelDepth != 0 ||
+			header.layerCount > 1 || header.faceCount != 1 || header.supercompressionScheme != 0 ||
+			header.levelCount == 0 || header.levelCount > maxLevels ||
+			file.size < sizeof(Ktx2Header) + header.levelCount * sizeof(Ktx2LevelIndex))
+		{
+			file.close();
+			return false;
+		}
+		for (uint32_t i = 0; i < header.levelCount; i++)
+		{
+			Ktx2LevelIndex level;
+			memcpy(&level, file.data + sizeof(Ktx2Header) + i * sizeof(Ktx2LevelIndex), sizeof(level));
+			uint64_t expectedSize{ textureLevelSize(format, std::max(width >> i, 1u), std::max(height >> i, 1u)) };
+			if (level.byteLength != expectedSize || level.byteOffset > file.size || file.size - level.byteOffset < level.byteLength)
+			{
+				levels.clear();
+				file.close();
+				return false;
+			}
+			levels.push_back({ file.data + level.byteOffset, static_cast<size_t>(level.byteLength) });
+		}
+		return true;
+	}
+
+	void close()
+	{
+		levels.clear();
+		file.close();
+	}
+};
+
+inline float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+/*
+Halves an RGBA8 sRGB image with a 2x2 box filter. The color channels are averaged in
+linear space (averaging the sRGB values darkens every level a bit more), alpha as it
+is. Like the blit chain a dimension of 1 stays 1 and the last row or column of an
+odd dimension is dropped.
+
+This is the straightforward version, kept as the reference runMipmapBenchmark checks
+downsampleRgba8Srgb against.
+*/
+inline std::vector<uint8_t> downsampleRgba8SrgbReference(std::span<const uint8_t> source, uint32_t width, uint32_t height)
+{
+	static const std::array<float, 256> toLinear{ []
+		{
+			std::array<float, 256> table;
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				table[i] = srgbToLinear(i / 255.0f);
+			}
+			return table;
+		}() };
+	uint32_t mipWidth{ std::max(width / 2, 1u) };
+	uint32_t mipHeight{ std::max(height / 2, 1u) };
+	std::vector<uint8_t> mip(static_cast<size_t>(mipWidth) * mipHeight * 4);
+	for (uint32_t y = 0; y < mipHeight; y++)
+	{
+		const uint8_t* row0{ source.data() + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4 };
+		const uint8_t* row1{ source.data() + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4 };
+		for (uint32_t x = 0; x < mipWidth; x++)
+		{
+			uint32_t x0{ std::min(x * 2, width - 1) * 4 };
+			uint32_t x1{ std::min(x * 2 + 1, width - 1) * 4 };
+			uint8_t* texel{ mip.data() + (static_cast<size_t>(y) * mipWidth + x) * 4 };
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				float linear{ (toLinear[row0[x0 + c]] + toLinear[row0[x1 + c]] + toLinear[row1[x0 + c]] + toLinear[row1[x1 + c]]) * 0.25f };
+				texel[c] = static_cast<uint8_t>(linearToSrgb(linear) * 255.0f + 0.5f);
+			}
+			texel[3] = static_cast<uint8_t>((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) / 4);
+		}
+	}
+	return mip;
+}
+
+/*
+Lookup tables of the fast downsampler. toSrgb maps a linear value quantized to 16 bits
+to its sRGB byte, which replaces the pow of linearToSrgb. 16 bits are fine enough that
+the result only differs from the reference when the exact value lies within 1/131070
+of a rounding boundary, and then by one step.
+*/
+struct SrgbTables
+{
+	std::array<float, 256> toLinear;
+	std::vector<uint8_t> toSrgb;
+};
+
+inline const SrgbTables& srgbTables()
+{
+	static const SrgbTables tables{ []
+		{
+			SrgbTables result;
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				result.toLinear[i] = srgbToLinear(i / 255.0f);
+			}
+			result.toSrgb.resize(65536);
+			for (uint32_t i = 0; i < 65536; i++)
+			{
+				result.toSrgb[i] = static_cast<uint8_t>(linearToSrgb(i / 65535.0f) * 255.0f + 0.5f);
+			}
+			return result;
+		}() };
+	return tables;
+}
+
+// One output row of downsampleRgba8Srgb from the two source rows under it.
+inline void downsampleRowRgba8Srgb(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* mipRow, uint32_t mipWidth)
+{
+	const SrgbTables& tables{ srgbTables() };
+	const float* toLinear{ tables.toLinear.data() };
+	const uint8_t* toSrgb{ tables.toSrgb.data() };
+	for (uint32_t x = 0; x < mipWidth; x++)
+	{
+		uint32_t x0{ std::min(x * 2, width - 1) * 4 };
+		uint32_t x1{ std::min(x * 2 + 1, width - 1) * 4 };
+		uint8_t* texel{ mipRow + static_cast<size_t>(x) * 4 };
+#ifdef TEXTURE_ENCODER_SSE2
+		// the three colors of a texel in one register, the 0.25 and the table scale in one multiply
+		auto linear{ [toLinear](const uint8_t* p) { return _mm_set_ps(0.0f, toLinear[p[2]], toLinear[p[1]], toLinear[p[0]]); } };
+		__m128 sum{ _mm_add_ps(_mm_add_ps(linear(row0 + x0), linear(row0 + x1)), _mm_add_ps(linear(row1 + x0), linear(row1 + x1))) };
+		alignas(16) int32_t index[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvtps_epi32(_mm_mul_ps(sum, _mm_set1_ps(65535.0f * 0.25f))));
+		texel[0] = toSrgb[index[0]];
+		texel[1] = toSrgb[index[1]];
+		texel[2] = toSrgb[index[2]];
+#else
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			float sum{ toLinear[row0[x0 + c]] + toLinear[row0[x1 + c]] + toLinear[row1[x0 + c]] + toLinear[row1[x1 + c]] };
+			texel[c] = toSrgb[static_cast<uint32_t>(sum * (65535.0f * 0.25f) + 0.5f)];
+		}
+#endif
+		texel[3] = static_cast<uint8_t>((row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3] + 2) / 4);
+	}
+}
+
+// below this many output texels a level is downsampled on the calling thread only
+const size_t PARALLEL_MIPMAP_MIN_TEXELS{ 1 << 16 };
+const uint32_t MIPMAP_ROWS_PER_TASK{ 16 };
+
+/*
+Same filter as downsampleRgba8SrgbReference, but the sRGB conversions are table
+lookups, the color sums use SSE2 where available and large levels are split across
+threads in bands of MIPMAP_ROWS_PER_TASK rows. maxThreads 0 means one per core.
+Writes the level to mip, which has to hold its (width / 2) * (height / 2) texels.
+*/
+inline void downsampleRgba8SrgbInto(std::span<const uint8_t> source, uint32_t width, uint32_t height, uint8_t* mip,
+	uint32_t maxThreads = 0)
+{
+	uint32_t mipWidth{ std::max(width / 2, 1u) };
+	uint32_t mipHeight{ std::max(height / 2, 1u) };
+	uint32_t bandCount{ (mipHeight + MIPMAP_ROWS_PER_TASK - 1) / MIPMAP_ROWS_PER_TASK };
+	uint32_t threadCount{ 1 };
+	if (static_cast<size_t>(mipWidth) * mipHeight >= PARALLEL_MIPMAP_MIN_TEXELS)
+	{
+		threadCount = std::min(maxThreads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : maxThreads, bandCount);
+	}
+	std::atomic<uint32_t> nextBand{ 0 };
+	runOnThreads(threadCount, [&](uint32_t)
+		{
+			for (uint32_t band{ nextBand++ }; band < bandCount; band = nextBand++)
+			{
+				uint32_t endRow{ std::min((band + 1) * MIPMAP_ROWS_PER_TASK, mipHeight) };
+				for (uint32_t y = band * MIPMAP_ROWS_PER_TASK; y < endRow; y++)
+				{
+					const uint8_t* row0{ source.data() + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4 };
+					const uint8_t* row1{ source.data() + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4 };
+					downsampleRowRgba8Srgb(row0, row1, width, mip + static_cast<size_t>(y) * mipWidth * 4, mipWidth);
+				}
+			}
+		});
+}
+
+inline std::vector<uint8_t> downsampleRgba8Srgb(std::span<const uint8_t> source, uint32_t width, uint32_t height,
+	uint32_t maxThreads = 0)
+{
+	std::vector<uint8_t> mip(static_cast<size_t>(std::max(width / 2, 1u)) * std::max(height / 2, 1u) * 4);
+	downsampleRgba8SrgbInto(source, width, height, mip.data(), maxThreads);
+	return mip;
+}
+
+// The full mip chain of an RGBA8 sRGB image, level 0 first.
+inline std::vector<std::vector<uint8_t>> buildMipChainRgba8Srgb(std::vector<uint8_t> level0, uint32_t width, uint32_t height,
+	uint32_t maxThreads = 0)
+{
+	std::vector<std::vector<uint8_t>> levels;
+	levels.push_back(std::move(level0));
+	while (width > 1 || height > 1)
+	{
+		levels.push_back(downsampleRgba8Srgb(levels.back(), width, height, maxThreads));
+		width = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+	return levels;
+}
+
+/*
+Block compression encoder used when baking. All three formats work on 4x4 blocks:
+BC1 stores two RGB565 endpoints and a 2-bit index per texel (8 bytes), BC3 adds a
+BC4 alpha block with two 8-bit endpoints and 3-bit indices (16 bytes) and BC7 is
+written in mode 6 only: one RGBA 7.7.7.7 endpoint pair with a p-bit each and 4-bit
+indices (16 bytes). Mode 6 handles smooth blocks and alpha well and keeps the
+encoder small; the partitioned modes would only buy a little PSNR on hard edges.
+
+Every encoder fits a line through the block colors (principal axis), projects the
+texels onto it to pick the indices, then refits the endpoints to those indices with
+least squares and keeps whichever quantized result has the lower error. The projection
+and error loops over the 16 texels use SSE2 where available. Encoding sRGB formats
+happens on the encoded values, like the hardware interpolates them.
+*/
+struct TextureBlock
+{
+	// the 16 texels of the block as 0..255 floats, one array per channel (r, g, b, a)
+	alignas(16) float channel[4][16];
+};
+
+inline void loadTextureBlock(std::span<const uint8_t> rgba, uint32_t width, uint32_t height,
+	uint32_t blockX, uint32_t blockY, TextureBlock& block)
+{
+	// blocks hanging over the edge of a small mip repeat the last row and column
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		uint32_t x{ std::min(blockX * 4 + i % 4, width - 1) };
+		uint32_t y{ std::min(blockY * 4 + i / 4, height - 1) };
+		const uint8_t* texel{ rgba.data() + (static_cast<size_t>(y) * width + x) * 4 };
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			block.channel[c][i] = texel[c];
+		}
+	}
+}
+
+// t[i] = dot(texel i - origin, axis) over channels [first, first + count), clamped to 0..maxT
+inline void projectTextureBlock(const TextureBlock& block, uint32_t first, uint32_t count,
+	const float origin[4], const float axis[4], float maxT, float t[16])
+{
+#ifdef TEXTURE_ENCODER_SSE2
+	for (uint32_t i = 0; i < 16; i += 4)
+	{
+		__m128 sum{ _mm_setzero_ps() };
+		for (uint32_t c = first; c < first + count; c++)
+		{
+			__m128 delta{ _mm_sub_ps(_mm_load_ps(&block.channel[c][i]), _mm_set1_ps(origin[c])) };
+			sum = _mm_add_ps(sum, _mm_mul_ps(delta, _mm_set1_ps(axis[c])));
+		}
+		_mm_storeu_ps(t + i, _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(maxT)));
+	}
+#else
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float sum{ 0.0f };
+		for (uint32_t c = first; c < first + count; c++)
+		{
+			sum += (block.channel[c][i] - origin[c]) * axis[c];
+		}
+		t[i] = std::clamp(sum, 0.0f, maxT);
+	}
+#endif
+}
+
+// Sum of squared differences over channels [first, first + count).
+inline float textureBlockError(const TextureBlock& a, const TextureBlock& b, uint32_t first, uint32_t count)
+{
+#ifdef TEXTURE_ENCODER_SSE2
+	__m128 sum{ _mm_setzero_ps() };
+	for (uint32_t c = first; c < first + count; c++)
+	{
+		for (uint32_t i = 0; i < 16; i += 4)
+		{
+			__m128 delta{ _mm_sub_ps(_mm_load_ps(&a.channel[c][i]), _mm_load_ps(&b.channel[c][i])) };
+			sum = _mm_add_ps(sum, _mm_mul_ps(delta, delta));
+		}
+	}
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, sum);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+	float sum{ 0.0f };
+	for (uint32_t c = first; c < first + count; c++)
+	{
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			float delta{ a.channel[c][i] - b.channel[c][i] };
+			sum += delta * delta;
+		}
+	}
+	return sum;
+#endif
+}
+
+/*
+Principal axis of the block colors over channels [first, first + count) by power
+iteration on the covariance matrix. Returns the mean in mean and a unit axis, or a
+zero axis for a block of one color.
+*/
+inline void textureBlockAxis(const TextureBlock& block, uint32_t first, uint32_t count, float mean[4], float axis[4])
+{
+	float covariance[4][4]{};
+	for (uint32_t c = first; c < first + count; c++)
+	{
+		mean[c] = std::accumulate(block.channel[c], block.channel[c] + 16, 0.0f) / 16.0f;
+	}
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		for (uint32_t c0 = first; c0 < first + count; c0++)
+		{
+			for (uint32_t c1 = c0; c1 < first + count; c1++)
+			{
+				covariance[c0][c1] += (block.channel[c0][i] - mean[c0]) * (block.channel[c1][i] - mean[c1]);
+			}
+		}
+	}
+	float length{ 0.0f };
+	for (uint32_t c = first; c < first + count; c++)
+	{
+		axis[c] = 1.0f;
+	}
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4]{};
+		for (uint32_t c0 = first; c0 < first + count; c0++)
+		{
+			for (uint32_t c1 = first; c1 < first + count; c1++)
+			{
+				next[c0] += covariance[std::min(c0, c1)][std::max(c0, c1)] * axis[c1];
+			}
+		}
+		length = 0.0f;
+		for (uint32_t c = first; c < first + count; c++)
+		{
+			length += next[c] * next[c];
+		}
+		length = std::sqrt(length);
+		if (length < 1e-6f)
+		{
+			break;
+		}
+		for (uint32_t c = first; c < first + count; c++)
+		{
+			axis[c] = next[c] / length;
+		}
+	}
+	if (length < 1e-6f)
+	{
+		std::fill(axis + first, axis + first + count, 0.0f);
+	}
+}
+
+/*
+Endpoints along the principal axis, at the extremes of the projected texels moved
+inwards by inset of the range, clamped to 0..255.
+*/
+inline void textureBlockEndpoints(const TextureBlock& block, uint32_t first, uint32_t count, float inset,
+	float endpoint0[4], float endpoint1[4])
+{
+	float mean[4];
+	float axis[4];
+	textureBlockAxis(block, first, count, mean, axis);
+	float minT{ std::numeric_limits<float>::max() };
+	float maxT{ std::numeric_limits<float>::lowest() };
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float t{ 0.0f };
+		for (uint32_t c = first; c < first + count; c++)
+		{
+			t += (block.channel[c][i] - mean[c]) * axis[c];
+		}
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+	float range{ (maxT - minT) * inset };
+	for (uint32_t c = first; c < first + count; c++)
+	{
+		endpoint0[c] = std::clamp(mean[c] + axis[c] * (minT + range), 0.0f, 255.0f);
+		endpoint1[c] = std::clamp(mean[c] + axis[c] * (maxT - range), 0.0f, 255.0f);
+	}
+}
+
+/*
+Least squares endpoints for fixed interpolation weights: minimizes the sum over the
+texels of |texel - ((1 - w) * endpoint0 + w * endpoint1)|^2. Returns false when all
+weights are equal and the system has no unique solution.
+*/
+inline bool refitTextureBlockEndpoints(const TextureBlock& block, uint32_t first, uint32_t count,
+	const float weights[16], float endpoint0[4], float endpoint1[4])
+{
+	float aa{ 0.0f }, ab{ 0.0f }, bb{ 0.0f };
+	float ax[4]{}, bx[4]{};
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float a{ 1.0f - weights[i] };
+		float b{ weights[i] };
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (uint32_t c = first; c < first + count; c++)
+		{
+			ax[c] += a * block.channel[c][i];
+			bx[c] += b * block.channel[c][i];
+		}
+	}
+	float determinant{ aa * bb - ab * ab };
+	if (std::abs(determinant) < 1e-6f)
+	{
+		return false;
+	}
+	for (uint32_t c = first; c < first + count; c++)
+	{
+		endpoint0[c] = std::clamp((bb * ax[c] - ab * bx[c]) / determinant, 0.0f, 255.0f);
+		endpoint1[c] = std::clamp((aa * bx[c] - ab * ax[c]) / determinant, 0.0f, 255.0f);
+	}
+	return true;
+}
+
+inline uint16_t packRgb565(const float color[3])
+{
+	uint32_t r{ static_cast<uint32_t>(color[0] * 31.0f / 255.0f + 0.5f) };
+	uint32_t g{ static_cast<uint32_t>(color[1] * 63.0f / 255.0f + 0.5f) };
+	uint32_t b{ static_cast<uint32_t>(color[2] * 31.0f / 255.0f + 0.5f) };
+	return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+inline void unpackRgb565(uint16_t packed, float color[3])
+{
+	uint32_t r{ packed >> 11u & 31u };
+	uint32_t g{ packed >> 5u & 63u };
+	uint32_t b{ packed & 31u };
+	color[0] = static_cast<float>(r << 3 | r >> 2);
+	color[1] = static_cast<float>(g << 2 | g >> 4);
+	color[2] = static_cast<float>(b << 3 | b >> 2);
+}
+
+/*
+Writes the 8-byte BC1 color block, always in four-color mode (color0 > color1) so
+it is decoded the same inside BC3. Returns the squared RGB error.
+*/
+inline float encodeBc1ColorBlock(const TextureBlock& block, uint8_t* output)
+{
+	// position along the endpoint line (0..3) to BC1 index: endpoints are 0 and 1, then the thirds
+	constexpr uint32_t indexOrder[4]{ 0, 2, 3, 1 };
+	float endpoint0[4];
+	float endpoint1[4];
+	textureBlockEndpoints(block, 0, 3, 1.0f / 16.0f, endpoint0, endpoint1);
+
+	float bestError{ std::numeric_limits<float>::max() };
+	uint16_t bestColors[2]{};
+	uint32_t bestSteps[16]{};
+	for (int iteration = 0; iteration < 2; iteration++)
+	{
+		uint16_t colors[2]{ packRgb565(endpoint0), packRgb565(endpoint1) };
+		float quantized0[4];
+		float quantized1[4];
+		unpackRgb565(colors[0], quantized0);
+		unpackRgb565(colors[1], quantized1);
+		float axis[4];
+		float lengthSquared{ 0.0f };
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			axis[c] = quantized1[c] - quantized0[c];
+			lengthSquared += axis[c] * axis[c];
+		}
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			axis[c] = lengthSquared > 0.0f ? axis[c] * 3.0f / lengthSquared : 0.0f;
+		}
+		float t[16];
+		projectTextureBlock(block, 0, 3, quantized0, axis, 3.0f, t);
+
+		uint32_t steps[16];
+		float weights[16];
+		TextureBlock decoded;
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			steps[i] = static_cast<uint32_t>(t[i] + 0.5f);
+			weights[i] = steps[i] / 3.0f;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				decoded.channel[c][i] = quantized0[c] + (quantized1[c] - quantized0[c]) * weights[i];
+			}
+		}
+		float error{ textureBlockError(block, decoded, 0, 3) };
+		if (error < bestError)
+		{
+			bestError = error;
+			std::copy(colors, colors + 2, bestColors);
+			std::copy(steps, steps + 16, bestSteps);
+		}
+		if (!refitTextureBlockEndpoints(block, 0, 3, weights, endpoint0, endpoint1))
+		{
+			break;
+		}
+	}
+
+	if (bestColors[0] < bestColors[1])
+	{
+		std::swap(bestColors[0], bestColors[1]);
+		for (uint32_t& step : bestSteps)
+		{
+			step = 3 - step;
+		}
+	}
+	uint32_t indices{ 0 };
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		// equal endpoints fall into three-color mode where only index 0 is the endpoint color
+		indices |= (bestColors[0] == bestColors[1] ? 0 : indexOrder[bestSteps[i]]) << (i * 2);
+	}
+	memcpy(output, &bestColors[0], 2);
+	memcpy(output + 2, &bestColors[1], 2);
+	memcpy(output + 4, &indices, 4);
+	return bestError;
+}
+
+// Writes the 8-byte BC4 block BC3 uses for alpha, in eight-value mode.
+inline void encodeBc3AlphaBlock(const TextureBlock& block, uint8_t* output)
+{
+	float minAlpha{ *std::min_element(block.channel[3], block.channel[3] + 16) };
+	float maxAlpha{ *std::max_element(block.channel[3], block.channel[3] + 16) };
+	output[0] = static_cast<uint8_t>(maxAlpha);
+	output[1] = static_cast<uint8_t>(minAlpha);
+	uint64_t indices{ 0 };
+	if (maxAlpha > minAlpha)
+	{
+		float origin[4]{ 0.0f, 0.0f, 0.0f, minAlpha };
+		float axis[4]{ 0.0f, 0.0f, 0.0f, 7.0f / (maxAlpha - minAlpha) };
+		float t[16];
+		projectTextureBlock(block, 3, 1, origin, axis, 7.0f, t);
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			// step 7 is alpha0 (index 0), step 0 alpha1 (index 1), the rest count down from index 7
+			uint32_t step{ static_cast<uint32_t>(t[i] + 0.5f) };
+			uint64_t index{ step == 7 ? 0u : step == 0 ? 1u : 8u - step };
+			indices |= index << (i * 3);
+		}
+	}
+	for (uint32_t i = 0; i < 6; i++)
+	{
+		output[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+	}
+}
+
+constexpr uint32_t BC7_WEIGHTS4[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Writes a 16-byte BC7 mode 6 block. Returns the squared RGBA error.
+inline float encodeBc7Block(const TextureBlock& block, uint8_t* output)
+{
+	// nearest 4-bit index for every weight 0..64
+	static const std::array<uint8_t, 65> indexForWeight{ []
+		{
+			std::array<uint8_t, 65> table;
+			for (uint32_t w = 0; w <= 64; w++)
+			{
+				uint32_t best{ 0 };
+				for (uint32_t i = 1; i < 16; i++)
+				{
+					if (std::abs(static_cast<int>(BC7_WEIGHTS4[i]) - static_cast<int>(w)) <
+						std::abs(static_cast<int>(BC7_WEIGHTS4[best]) - static_cast<int>(w)))
+					{
+						best = i;
+					}
+				}
+				table[w] = static_cast<uint8_t>(best);
+			}
+			return table;
+		}() };
+
+	float endpoint0[4];
+	float endpoint1[4];
+	textureBlockEndpoints(block, 0, 4, 0.0f, endpoint0, endpoint1);
+
+	float bestError{ std::numeric_limits<float>::max() };
+	uint32_t bestEndpoints[2][4]{};
+	uint32_t bestIndices[16]{};
+	for (int iteration = 0; iteration < 2; iteration++)
+	{
+		// every combination of the two p-bits, the shared low bit of each endpoint
+		for (uint32_t pbits = 0; pbits < 4; pbits++)
+		{
+			uint32_t endpoints[2][4];
+			float quantized[2][4];
+			float axis[4];
+			float lengthSquared{ 0.0f };
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				for (uint32_t e = 0; e < 2; e++)
+				{
+					uint32_t pbit{ pbits >> e & 1u };
+					float value{ e == 0 ? endpoint0[c] : endpoint1[c] };
+					uint32_t high{ static_cast<uint32_t>(std::clamp((value - pbit) * 0.5f + 0.5f, 0.0f, 127.0f)) };
+					endpoints[e][c] = high << 1 | pbit;
+					quantized[e][c] = static_cast<float>(endpoints[e][c]);
+				}
+				axis[c] = quantized[1][c] - quantized[0][c];
+				lengthSquared += axis[c] * axis[c];
+			}
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				axis[c] = lengthSquared > 0.0f ? axis[c] * 64.0f / lengthSquared : 0.0f;
+			}
+			float t[16];
+			projectTextureBlock(block, 0, 4, quantized[0], axis, 64.0f, t);
+
+			uint32_t indices[16];
+			TextureBlock decoded;
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				indices[i] = indexForWeight[static_cast<uint32_t>(t[i] + 0.5f)];
+				uint32_t weight{ BC7_WEIGHTS4[indices[i]] };
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					decoded.channel[c][i] = static_cast<float>(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+				}
+			}
+			float error{ textureBlockError(block, decoded, 0, 4) };
+			if (error < bestError)
+			{
+				bestError = error;
+				memcpy(bestEndpoints, endpoints, sizeof(endpoints));
+				std::copy(indices, indices + 16, bestIndices);
+			}
+		}
+		float weights[16];
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			weights[i] = BC7_WEIGHTS4[bestIndices[i]] / 64.0f;
+		}
+		if (!refitTextureBlockEndpoints(block, 0, 4, weights, endpoint0, endpoint1))
+		{
+			break;
+		}
+	}
+
+	// the most significant bit of the first index is implied 0, swap the endpoints to make it so
+	if (bestIndices[0] >= 8)
+	{
+		std::swap(bestEndpoints[0], bestEndpoints[1]);
+		for (uint32_t& index : bestIndices)
+		{
+			index = 15 - index;
+		}
+	}
+	uint64_t bits[2]{};
+	uint32_t position{ 0 };
+	auto write{ [&](uint64_t value, uint32_t count)
+		{
+			bits[position / 64] |= value << (position % 64);
+			if (position % 64 + count > 64)
+			{
+				bits[position / 64 + 1] |= value >> (64 - position % 64);
+			}
+			position += count;
+		} };
+	write(1u << 6, 7);
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		write(bestEndpoints[0][c] >> 1, 7);
+		write(bestEndpoints[1][c] >> 1, 7);
+	}
+	write(bestEndpoints[0][0] & 1u, 1);
+	write(bestEndpoints[1][0] & 1u, 1);
+	write(bestIndices[0], 3);
+	for (uint32_t i = 1; i < 16; i++)
+	{
+		write(bestIndices[i], 4);
+	}
+	memcpy(output, bits, 16);
+	return bestError;
+}
+
+inline bool isTextureEncoderFormat(VkFormat format)
+{
+	return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ||
+		format == VK_FORMAT_BC3_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+/*
+Encodes one RGBA8 mip level into format (one of isTextureEncoderFormat). The rows of
+blocks are handed out to all cores through an atomic counter.
+*/
+inline std::vector<uint8_t> encodeTextureLevel(VkFormat format, std::span<const uint8_t> rgba, uint32_t width, uint32_t height)
+{
+	if (format == VK_FORMAT_R8G8B8A8_SRGB)
+	{
+		return { rgba.begin(), rgba.end() };
+	}
+	uint32_t bytesPerBlock{ textureFormatInfo(format).bytesPerBlock };
+	uint32_t blocksX{ (width + 3) / 4 };
+	uint32_t blocksY{ (height + 3) / 4 };
+	std::vector<uint8_t> encoded(static_cast<size_t>(blocksX) * blocksY * bytesPerBlock);
+	std::atomic<uint32_t> nextRow{ 0 };
+	uint32_t threadCount{ std::min(std::max(1u, std::thread::hardware_concurrency()), blocksY) };
+	runOnThreads(threadCount, [&](uint32_t)
+		{
+			TextureBlock block;
+			for (uint32_t y{ nextRow++ }; y < blocksY; y = nextRow++)
+			{
+				for (uint32_t x = 0; x < blocksX; x++)
+				{
+					loadTextureBlock(rgba, width, height, x, y, block);
+					uint8_t* output{ encoded.data() + (static_cast<size_t>(y) * blocksX + x) * bytesPerBlock };
+					if (format == VK_FORMAT_BC1_RGB_SRGB_BLOCK)
+					{
+						encodeBc1ColorBlock(block, output);
+					}
+					else if (format == VK_FORMAT_BC3_SRGB_BLOCK)
+					{
+						encodeBc3AlphaBlock(block, output);
+						encodeBc1ColorBlock(block, output + 8);
+					}
+					else
+					{
+						encodeBc7Block(block, output);
+					}
+				}
+			}
+		});
+	return encoded;
+}
+
+/*
+Decodes a level written by encodeTextureLevel back to RGBA8, for the quality report.
+BC7 blocks in a mode other than 6 decode as opaque magenta.
+*/
+inline std::vector<uint8_t> decodeTextureLevel(VkFormat format, std::span<const uint8_t> data, uint32_t width, uint32_t height)
+{
+	if (format == VK_FORMAT_R8G8B8A8_SRGB)
+	{
+		return { data.begin(), data.end() };
+	}
+	uint32_t bytesPerBlock{ textureFormatInfo(format).bytesPerBlock };
+	uint32_t blocksX{ (width + 3) / 4 };
+	std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+	for (uint32_t y = 0; y < height; y++)
+	{
+		for (uint32_t x = 0; x < width; x++)
+		{
+			const uint8_t* input{ data.data() + (static_cast<size_t>(y / 4) * blocksX + x / 4) * bytesPerBlock };
+			uint32_t i{ (y % 4) * 4 + x % 4 };
+			uint8_t* texel{ rgba.data() + (static_cast<size_t>(y) * width + x) * 4 };
+			if (format == VK_FORMAT_BC7_SRGB_BLOCK)
+			{
+				uint64_t bits[2];
+				memcpy(bits, input, 16);
+				auto read{ [&](uint32_t position, uint32_t count)
+					{
+						uint64_t value{ bits[position / 64] >> (position % 64) };
+						if (position % 64 + count > 64)
+						{
+							value |= bits[position / 64 + 1] << (64 - position % 64);
+						}
+						return static_cast<uint32_t>(value & ((uint64_t{ 1 } << count) - 1));
+					} };
+				if ((bits[0] & 0x7F) != 1u << 6)
+				{
+					texel[0] = 255; texel[1] = 0; texel[2] = 255; texel[3] = 255;
+					continue;
+				}
+				uint32_t index{ i == 0 ? read(65, 3) : read(64 + i * 4, 4) };
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					uint32_t endpoint0{ read(7 + c * 14, 7) << 1 | read(63, 1) };
+					uint32_t endpoint1{ read(14 + c * 14, 7) << 1 | read(64, 1) };
+					uint32_t weight{ BC7_WEIGHTS4[index] };
+					texel[c] = static_cast<uint8_t>(((64 - weight) * endpoint0 + weight * endpoint1 + 32) >> 6);
+				}
+				continue;
+			}
+			const uint8_t* colorBlock{ format == VK_FORMAT_BC3_SRGB_BLOCK ? input + 8 : input };
+			uint16_t colors[2];
+			uint32_t indices;
+			memcpy(colors, colorBlock, 4);
+			memcpy(&indices, colorBlock + 4, 4);
+			float palette[4][3];
+			unpackRgb565(colors[0], palette[0]);
+			unpackRgb565(colors[1], palette[1]);
+			bool fourColors{ colors[0] > colors[1] || format == VK_FORMAT_BC3_SRGB_BLOCK };
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				palette[2][c] = fourColors ? (2.0f * palette[0][c] + palette[1][c]) / 3.0f : (palette[0][c] + palette[1][c]) / 2.0f;
+				palette[3][c] = fourColors ? (palette[0][c] + 2.0f * palette[1][c]) / 3.0f : 0.0f;
+			}
+			uint32_t index{ indices >> (i * 2) & 3u };
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				texel[c] = static_cast<uint8_t>(palette[index][c] + 0.5f);
+			}
+			texel[3] = 255;
+			if (format == VK_FORMAT_BC3_SRGB_BLOCK)
+			{
+				uint64_t alphaIndices{ 0 };
+				memcpy(&alphaIndices, input + 2, 6);
+				uint32_t alphaIndex{ static_cast<uint32_t>(alphaIndices >> (i * 3) & 7u) };
+				uint32_t alpha0{ input[0] };
+				uint32_t alpha1{ input[1] };
+				if (alphaIndex < 2)
+				{
+					texel[3] = static_cast<uint8_t>(alphaIndex == 0 ? alpha0 : alpha1);
+				}
+				else if (alpha0 > alpha1)
+				{
+					texel[3] = static_cast<uint8_t>(((8 - alphaIndex) * alpha0 + (alphaIndex - 1) * alpha1 + 3) / 7);
+				}
+				else
+				{
+					texel[3] = alphaIndex >= 6 ? (alphaIndex == 6 ? 0 : 255) :
+						static_cast<uint8_t>(((6 - alphaIndex) * alpha0 + (alphaIndex - 1) * alpha1 + 2) / 5);
+				}
+			}
+		}
+	}
+	return rgba;
+}
+
+/*
+Bakes a PNG/JPG (anything stb_image reads) into a KTX2 file with the complete mip
+chain in format, one of isTextureEncoderFormat. The mip chain is always built from
+the RGBA8 image and every level is compressed on its own.
+*/
+inline bool bakeKtx2(const std::string& sourcePath, const std::string& targetPath, VkFormat format = VK_FORMAT_R8G8B8A8_SRGB)
+{
+	if (!isTextureEncoderFormat(format))
+	{
+		std::cerr << "bakeKtx2: cannot encode " << textureFormatName(format) << std::endl;
+		return false;
+	}
+	auto start{ std::chrono::high_resolution_clock::now() };
+	int width;
+	int height;
+	int channels;
+	stbi_uc* pixels{ stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha) };
+	if (!pixels)
+	{
+		std::cerr << "failed to load " << sourcePath << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> level0(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	stbi_image_free(pixels);
+	auto decoded{ std::chrono::high_resolution_clock::now() };
+	std::vector<std::vector<uint8_t>> levels{ buildMipChainRgba8Srgb(std::move(level0), width, height) };
+	auto mipmapped{ std::chrono::high_resolution_clock::now() };
+	uint64_t texelCount{ 0 };
+	for (uint32_t i = 0; i < levels.size(); i++)
+	{
+		uint32_t levelWidth{ std::max(static_cast<uint32_t>(width) >> i, 1u) };
+		uint32_t levelHeight{ std::max(static_cast<uint32_t>(height) >> i, 1u) };
+		levels[i] = encodeTextureLevel(format, levels[i], levelWidth, levelHeight);
+		texelCount += static_cast<uint64_t>(levelWidth) * levelHeight;
+	}
+	auto encoded{ std::chrono::high_resolution_clock::now() };
+	if (!writeKtx2(targetPath, format, width, height, levels))
+	{
+		std::cerr << "failed to write " << targetPath << std::endl;
+		return false;
+	}
+	auto end{ std::chrono::high_resolution_clock::now() };
+	double encodeMs{ std::chrono::duration<double, std::milli>(encoded - mipmapped).count() };
+	std::cout << "bakeKtx2: " << sourcePath << " -> " << targetPath << ", " << width << "x" << height << " "
+		<< textureFormatName(format) << ", " << levels.size() << " levels, decode "
+		<< std::chrono::duration<double, std::milli>(decoded - start).count()
+		<< " ms, mip chain " << std::chrono::duration<double, std::milli>(mipmapped - decoded).count()
+		<< " ms, encode " << encodeMs << " ms";
+	if (format != VK_FORMAT_R8G8B8A8_SRGB)
+	{
+		std::cout << " (" << texelCount / (encodeMs * 1000.0) << " MPix/s)";
+	}
+	std::cout << ", write " << std::chrono::duration<double, std::milli>(end - encoded).count() << " ms" << std::endl;
+	return true;
+}
+
+// Where the texture is baked to for format: TEXTURE_KTX2_PATH for RGBA8, with the format in the name otherwise.
+inline std::string textureKtx2Path(VkFormat format)
+{
+	if (format == VK_FORMAT_R8G8B8A8_SRGB)
+	{
+		return TEXTURE_KTX2_PATH;
+	}
+	return std::filesystem::path{ TEXTURE_KTX2_PATH }.replace_extension(std::string{ "." } + textureFormatName(format) + ".ktx2").string();
+}
+
+/*
+Buddy allocator over one memory block. The block size is a power of two and a node of
+level l is size >> l bytes, starting at a multiple of its own size, so any alignment
+up to the node size comes for free. allocate splits the smallest free node that fits
+down to the level it needs, free merges a node with its buddy (offset ^ node size)
+for as long as that one is free as well. The price is internal fragmentation: a
+request is rounded up to the next power of two.
+*/
+class BuddyBlock
+{
+public:
+	BuddyBlock(VkDeviceSize size, VkDeviceSize minNodeSize)
+		: size{ size }, minNodeSize{ minNodeSize }
+	{
+		uint32_t levelCount{ 1 };
+		while ((size >> levelCount) >= minNodeSize)
+		{
+			levelCount++;
+		}
+		freeNodes.resize(levelCount);
+		freeNodes[0].insert(0);
+	}
+
+	// false when there is no free node big enough
+	bool allocate(VkDeviceSize requestSize, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		VkDeviceSize nodeSize{ minNodeSize };
+		while (nodeSize < requestSize || nodeSize < alignment)
+		{
+			nodeSize <<= 1;
+		}
+		if (nodeSize > size)
+		{
+			return false;
+		}
+		uint32_t level{ 0 };
+		while ((size >> level) > nodeSize)
+		{
+			level++;
+		}
+		uint32_t splitLevel{ level };
+		while (freeNodes[splitLevel].empty())
+		{
+			if (splitLevel == 0)
+			{
+				return false;
+			}
+			splitLevel--;
+		}
+		offset = *freeNodes[splitLevel].begin();
+		freeNodes[splitLevel].erase(freeNodes[splitLevel].begin());
+		// keep the lower half, the upper half of every split becomes a free buddy
+		while (splitLevel < level)
+		{
+			splitLevel++;
+			freeNodes[splitLevel].insert(offset + (size >> splitLevel));
+		}
+		allocatedLevels[offset] = level;
+		used += nodeSize;
+		return true;
+	}
+
+	void free(VkDeviceSize offset)
+	{
+		auto allocated{ allocatedLevels.find(offset) };
+		uint32_t level{ allocated->second };
+		allocatedLevels.erase(allocated);
+		used -= size >> level;
+		while (level > 0)
+		{
+			auto buddy{ freeNodes[level].find(offset ^ (size >> level)) };
+			if (buddy == freeNodes[level].end())
+			{
+				break;
+			}
+			offset = std::min(offset, *buddy);
+			freeNodes[level].erase(buddy);
+			level--;
+		}
+		freeNodes[level].insert(offset);
+	}
+
+	// bytes in allocated nodes, including the rounding up to powers of two
+	VkDeviceSize usedBytes() const
+	{
+		return used;
+	}
+
+	bool empty() const
+	{
+		return allocatedLevels.empty();
+	}
+
+private:
+	VkDeviceSize size;
+	VkDeviceSize minNodeSize;
+	// offsets of the free nodes per level, ordered so allocations pack towards the block start
+	std::vector<std::set<VkDeviceSize>> freeNodes;
+	std::unordered_map<VkDeviceSize, uint32_t> allocatedLevels;
+	VkDeviceSize used{ 0 };
+};
+
+struct MemoryBlock
+{
+	VkDeviceMemory memory{ VK_NULL_HANDLE };
+	uint8_t* mapped{ nullptr };
+	uint32_t pool{ 0 };
+	BuddyBlock buddy;
+};
+
+/*
+A piece of device memory handed out by DeviceMemoryAllocator. Resources are bound at
+memory + offset. For host visible memory mapped points at offset inside the block's
+persistent mapping, so nothing calls vkMapMemory on its own: a VkDeviceMemory can only
+be mapped once at a time and the block is shared.
+*/
+struct MemoryAllocation
+{
+	VkDeviceMemory memory{ VK_NULL_HANDLE };
+	VkDeviceSize offset{ 0 };
+	VkDeviceSize size{ 0 };
+	void* mapped{ nullptr };
+	// the block the allocation was taken from, null for a dedicated allocation
+	MemoryBlock* block{ nullptr };
+};
+
+// What DeviceMemoryAllocator::allocate needs to know about the resource.
+struct MemoryRequest
+{
+	VkMemoryRequirements requirements{};
+	uint32_t memoryType{ 0 };
+	// optimal tiling image, kept apart from buffers when bufferImageGranularity needs it
+	bool optimalImage{ false };
+	// from VkMemoryDedicatedRequirements, only queried on Vulkan 1.1 devices
+	bool prefersDedicated{ false };
+	bool requiresDedicated{ false };
+	// the resource, named in VkMemoryDedicatedAllocateInfo when the driver asked for its own allocation
+	VkBuffer buffer{ VK_NULL_HANDLE };
+	VkImage image{ VK_NULL_HANDLE };
+};
+
+struct MemoryStats
+{
+	// live VkDeviceMemory objects, blocks and dedicated allocations together
+	uint32_t deviceMemoryCount{ 0 };
+	uint32_t peakDeviceMemoryCount{ 0 };
+	uint32_t blockCount{ 0 };
+	VkDeviceSize blockBytes{ 0 };
+	// live sub-allocations, the bytes they asked for and the buddy nodes they occupy
+	uint32_t subAllocationCount{ 0 };
+	VkDeviceSize requestedBytes{ 0 };
+	VkDeviceSize nodeBytes{ 0 };
+	uint32_t dedicatedCount{ 0 };
+	VkDeviceSize dedicatedBytes{ 0 };
+	// totals over the run
+	uint64_t vkAllocateMemoryCalls{ 0 };
+	uint64_t allocateCalls{ 0 };
+	VkDeviceSize peakDeviceBytes{ 0 };
+};
+
+/*
+Sub-allocates buffers and images from large blocks, one set of blocks per memory type
+(and per linear/optimal kind when bufferImageGranularity is above 1, so a buffer and an
+optimal image never share a granularity page). Blocks are DEVICE_MEMORY_BLOCK_SIZE,
+or an eighth of the heap for small heaps, and host visible blocks stay mapped for
+their whole lifetime. Resources of half a block or more, resources the driver
+requires a dedicated allocation for and large ones it prefers one for get their own
+VkDeviceMemory. An emptied block is kept when it is the last one of its pool, so a
+swap chain resize frees and reallocates the attachments without a driver call.
+*/
+class DeviceMemoryAllocator
+{
+public:
+	void init(VkPhysicalDevice physicalDevice, VkDevice device, bool vulkan11)
+	{
+		this->device = device;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		bufferImageGranularity = properties.limits.bufferImageGranularity;
+		maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+		dedicatedQueries = vulkan11 && properties.apiVersion >= VK_API_VERSION_1_1;
+		pools.resize(memoryProperties.memoryTypeCount * 2);
+	}
+
+	/*
+	The requirements of buffer, plus whether the driver wants it in its own allocation.
+	The caller picks request.memoryType with findMemoryType.
+	*/
+	MemoryRequest bufferRequest(VkBuffer buffer)
+	{
+		MemoryRequest request{};
+		request.buffer = buffer;
+		if (!dedicatedQueries)
+		{
+			vkGetBufferMemoryRequirements(device, buffer, &request.requirements);
+			return request;
+		}
+		VkBufferMemoryRequirementsInfo2 info{};
+		info.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+		info.buffer = buffer;
+		VkMemoryDedicatedRequirements dedicated{};
+		dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+		VkMemoryRequirements2 requirements{};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		requirements.pNext = &dedicated;
+		vkGetBufferMemoryRequirements2(device, &info, &requirements);
+		request.requirements = requirements.memoryRequirements;
+		request.prefersDedicated = dedicated.prefersDedicatedAllocation == VK_TRUE;
+		request.requiresDedicated = dedicated.requiresDedicatedAllocation == VK_TRUE;
+		return request;
+	}
+
+	MemoryRequest imageRequest(VkImage image, VkImageTiling tiling)
+	{
+		MemoryRequest request{};
+		request.image = image;
+		request.optimalImage = tiling == VK_IMAGE_TILING_OPTIMAL;
+		if (!dedicatedQueries)
+		{
+			vkGetImageMemoryRequirements(device, image, &request.requirements);
+			return request;
+		}
+		VkImageMemoryRequirementsInfo2 info{};
+		info.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+		info.image = image;
+		VkMemoryDedicatedRequirements dedicated{};
+		dedicated.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+		VkMemoryRequirements2 requirements{};
+		requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+		requirements.pNext = &dedicated;
+		vkGetImageMemoryRequirements2(device, &info, &requirements);
+		request.requirements = requirements.memoryRequirements;
+		request.prefersDedicated = dedicated.prefersDedicatedAllocation == VK_TRUE;
+		request.requiresDedicated = dedicated.requiresDedicatedAllocation == VK_TRUE;
+		return request;
+	}
+
+	MemoryAllocation allocate(const MemoryRequest& request)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		stats.allocateCalls++;
+		VkDeviceSize blockSize{ poolBlockSize(request.memoryType) };
+		VkDeviceSize size{ request.requirements.size };
+		if (request.requiresDedicated || size >= blockSize / 2 || (request.prefersDedicated && size >= blockSize / 8))
+		{
+			return allocateDedicated(request);
+		}
+
+		uint32_t pool{ request.memoryType * 2 + (request.optimalImage && bufferImageGranularity > 1 ? 1 : 0) };
+		MemoryAllocation allocation{};
+		allocation.size = size;
+		VkDeviceSize usedBefore{ 0 };
+		for (const std::unique_ptr<MemoryBlock>& block : pools[pool])
+		{
+			usedBefore = block->buddy.usedBytes();
+			if (block->buddy.allocate(size, request.requirements.alignment, allocation.offset))
+			{
+				allocation.block = block.get();
+				break;
+			}
+		}
+		if (!allocation.block)
+		{
+			allocation.block = createBlock(pool, blockSize);
+			usedBefore = 0;
+			allocation.block->buddy.allocate(size, request.requirements.alignment, allocation.offset);
+		}
+		allocation.memory = allocation.block->memory;
+		if (allocation.block->mapped)
+		{
+			allocation.mapped = allocation.block->mapped + allocation.offset;
+		}
+		stats.subAllocationCount++;
+		stats.requestedBytes += size;
+		stats.nodeBytes += allocation.block->buddy.usedBytes() - usedBefore;
+		return allocation;
+	}
+
+	// frees and resets allocation, nothing happens for an empty one
+	void free(MemoryAllocation& allocation)
+	{
+		if (allocation.memory == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> lock{ mutex };
+		MemoryBlock* block{ allocation.block };
+		if (!block)
+		{
+			vkFreeMemory(device, allocation.memory, nullptr);
+			stats.deviceMemoryCount--;
+			stats.dedicatedCount--;
+			stats.dedicatedBytes -= allocation.size;
+			allocation = {};
+			return;
+		}
+		VkDeviceSize nodeBytes{ block->buddy.usedBytes() };
+		block->buddy.free(allocation.offset);
+		stats.subAllocationCount--;
+		stats.requestedBytes -= allocation.size;
+		stats.nodeBytes -= nodeBytes - block->buddy.usedBytes();
+		allocation = {};
+
+		std::vector<std::unique_ptr<MemoryBlock>>& blocks{ pools[block->pool] };
+		bool otherEmptyBlock{ std::any_of(blocks.begin(), blocks.end(),
+			[block](const std::unique_ptr<MemoryBlock>& other) { return other.get() != block && other->buddy.empty(); }) };
+		if (block->buddy.empty() && otherEmptyBlock)
+		{
+			destroyBlock(*block);
+			blocks.erase(std::find_if(blocks.begin(), blocks.end(),
+				[block](const std::unique_ptr<MemoryBlock>& other) { return other.get() == block; }));
+		}
+	}
+
+	// frees the blocks, every allocation has to be freed before
+	void destroy()
+	{
+		for (std::vector<std::unique_ptr<MemoryBlock>>& blocks : pools)
+		{
+			for (const std::unique_ptr<MemoryBlock>& block : blocks)
+			{
+				destroyBlock(*block);
+			}
+			blocks.clear();
+		}
+	}
+
+	MemoryStats statistics()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		return stats;
+	}
+
+	uint32_t deviceMemoryLimit() const
+	{
+		return maxMemoryAllocationCount;
+	}
+
+private:
+	VkDevice device{ VK_NULL_HANDLE };
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	VkDeviceSize bufferImageGranularity{ 1 };
+	uint32_t maxMemoryAllocationCount{ 0 };
+	bool dedicatedQueries{ false };
+	// memory type * 2 + 1 for optimal images when they need their own blocks
+	std::vector<std::vector<std::unique_ptr<MemoryBlock>>> pools;
+	MemoryStats stats;
+	// the streaming thread and the render loop may both allocate later on
+	std::mutex mutex;
+
+	VkDeviceSize poolBlockSize(uint32_t memoryType) const
+	{
+		VkDeviceSize heapSize{ memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryType].heapIndex].size };
+		VkDeviceSize blockSize{ DEVICE_MEMORY_BLOCK_SIZE };
+		while (blockSize > DEVICE_MEMORY_MIN_BLOCK_SIZE && blockSize > heapSize / 8)
+		{
+			blockSize >>= 1;
+		}
+		return blockSize;
+	}
+
+	VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryType, const void* next)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.pNext = next;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryType;
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate device memory!");
+		}
+		stats.vkAllocateMemoryCalls++;
+		stats.deviceMemoryCount++;
+		stats.peakDeviceMemoryCount = std::max(stats.peakDeviceMemoryCount, stats.deviceMemoryCount);
+		stats.peakDeviceBytes = std::max(stats.peakDeviceBytes, stats.blockBytes + stats.dedicatedBytes + size);
+		return memory;
+	}
+
+	void* mapWhole(VkDeviceMemory memory, uint32_t memoryType)
+	{
+		if (!(memoryProperties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+		{
+			return nullptr;
+		}
+		void* mapped;
+		if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to map device memory!");
+		}
+		return mapped;
+	}
+
+	MemoryAllocation allocateDedicated(const MemoryRequest& request)
+	{
+		// only name the resource when the driver asked, the size heuristic works without it
+		VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+		dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+		dedicatedInfo.buffer = request.buffer;
+		dedicatedInfo.image = request.image;
+		bool named{ request.prefersDedicated || request.requiresDedicated };
+		MemoryAllocation allocation{};
+		allocation.size = request.requirements.size;
+		allocation.memory = allocateMemory(allocation.size, request.memoryType, named ? &dedicatedInfo : nullptr);
+		allocation.mapped = mapWhole(allocation.memory, request.memoryType);
+		stats.dedicatedCount++;
+		stats.dedicatedBytes += allocation.size;
+		return allocation;
+	}
+
+	MemoryBlock* createBlock(uint32_t pool, VkDeviceSize blockSize)
+	{
+		uint32_t memoryType{ pool / 2 };
+		// the node size is a multiple of nonCoherentAtomSize (at most 256), should a pool ever be non-coherent
+		std::unique_ptr<MemoryBlock> block{ new MemoryBlock{ VK_NULL_HANDLE, nullptr, pool,
+			BuddyBlock{ blockSize, DEVICE_MEMORY_MIN_NODE_SIZE } } };
+		block->memory = allocateMemory(blockSize, memoryType, nullptr);
+		block->mapped = static_cast<uint8_t*>(mapWhole(block->memory, memoryType));
+		stats.blockCount++;
+		stats.blockBytes += blockSize;
+		pools[pool].push_back(std::move(block));
+		return pools[pool].back().get();
+	}
+
+	void destroyBlock(MemoryBlock& block)
+	{
+		if (block.mapped)
+		{
+			vkUnmapMemory(device, block.memory);
+		}
+		vkFreeMemory(device, block.memory, nullptr);
+		stats.deviceMemoryCount--;
+		stats.blockCount--;
+		stats.blockBytes -= poolBlockSize(block.pool / 2);
+	}
+};
+
+/*
+Completion token of an asynchronous upload: the value the upload timeline semaphore
+reaches once the copy is done. 0 stands for an upload that already completed.
+*/
+using UploadToken = uint64_t;
+
+/*
+A piece of the staging ring, or of a temporary buffer for an upload bigger than the
+whole ring (memory is only set then). Write the data through mapped and copy from
+buffer at offset.
+*/
+struct StagingRegion
+{
+	VkBuffer buffer{ VK_NULL_HANDLE };
+	VkDeviceSize offset{ 0 };
+	VkDeviceSize size{ 0 };
+	uint8_t* mapped{ nullptr };
+	// position in the ring, for release
+	uint64_t id{ 0 };
+	MemoryAllocation memory{};
+};
+
+struct StagingStats
+{
+	uint64_t uploads{ 0 };
+	uint64_t bytesStaged{ 0 };
+	// allocations that had to wait for a fence before the ring had room, and how long
+	uint64_t stalls{ 0 };
+	double stallMilliseconds{ 0.0 };
+	// allocations that skipped the end of the ring and went back to its start
+	uint64_t wraps{ 0 };
+	// uploads bigger than the ring, staged in a temporary buffer instead
+	uint64_t oversizeUploads{ 0 };
+	VkDeviceSize peakBytesInFlight{ 0 };
+};
+
+struct UploadStats
+{
+	// submissions to the upload queue, and how many of them moved ownership to the graphics family
+	uint64_t submissions{ 0 };
+	uint64_t ownershipTransfers{ 0 };
+	// frames whose submission waited on the upload timeline for a resource they draw with
+	uint64_t frameWaits{ 0 };
+	// single time command sequences and uploads recorded, and the vkQueueSubmit calls they took
+	uint64_t operations{ 0 };
+	uint64_t queueSubmits{ 0 };
+};
+
+/*
+The transfers and barriers of several uploads recorded into one command buffer per
+queue and submitted together, see beginUploadBatch.
+*/
+struct UploadBatch
+{
+	// graphics queue commands, and the uploads too when they run in the graphics family
+	VkCommandBuffer graphicsCommands{ VK_NULL_HANDLE };
+	// uploads for a transfer family, allocated with the first one
+	VkCommandBuffer uploadCommands{ VK_NULL_HANDLE };
+	// signaled by the graphics submission, which is the last one
+	VkFence fence{ VK_NULL_HANDLE };
+	// the upload timeline value the batch signals, 0 until an upload was recorded
+	UploadToken upload{ 0 };
+	// staging the commands read, handed back when the batch is submitted with the fence or the upload
+	std::vector<StagingRegion> graphicsStaging;
+	std::vector<StagingRegion> uploadStaging;
+	// releases objects the commands use, run once the fence signaled
+	std::vector<std::function<void()>> onComplete;
+};
+
+/*
+One persistently mapped staging buffer used as a ring. allocate takes the next free
+bytes after the newest region, going back to the start of the buffer when the end is
+too short. Once the commands copying from a region are submitted, release hands over
+the fence of that submission, or the timeline semaphore value it signals (or neither
+when they already finished), and retire frees regions oldest first as those signal.
+Only an allocation that runs into a region still in flight waits, for the oldest one.
+
+A released fence has to be submitted before the next allocate and retire has to run
+after a wait on it but before it is reset, so a region never points at a reset fence.
+Regions that were never released block the ring, allocate throws rather than wait
+for them.
+*/
+class StagingRing
+{
+public:
+	void init(VkDevice device, VkBuffer buffer, uint8_t* mapped, VkDeviceSize capacity)
+	{
+		this->device = device;
+		this->buffer = buffer;
+		this->mapped = mapped;
+		this->capacity = capacity;
+	}
+
+	VkDeviceSize size() const
+	{
+		return capacity;
+	}
+
+	// whether allocate would find room for size bytes without waiting
+	bool fits(VkDeviceSize size, VkDeviceSize alignment = 16)
+	{
+		VkDeviceSize offset;
+		retire();
+		return place(std::max<VkDeviceSize>(size, 1), alignment, offset);
+	}
+
+	// size has to fit the ring, alignment is a power of two
+	StagingRegion allocate(VkDeviceSize size, VkDeviceSize alignment = 16)
+	{
+		size = std::max<VkDeviceSize>(size, 1);
+		VkDeviceSize offset;
+		retire();
+		while (!place(size, alignment, offset))
+		{
+			Entry& oldest{ entries.front() };
+			if (!oldest.released)
+			{
+				throw std::runtime_error("failed to allocate staging memory, the ring is full of unsubmitted uploads!");
+			}
+			auto stallStart{ std::chrono::high_resolution_clock::now() };
+			if (oldest.fence != VK_NULL_HANDLE)
+			{
+				vkWaitForFences(device, 1, &oldest.fence, VK_TRUE, UINT64_MAX);
+			}
+			else
+			{
+				VkSemaphoreWaitInfo waitInfo{};
+				waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+				waitInfo.semaphoreCount = 1;
+				waitInfo.pSemaphores = &oldest.semaphore;
+				waitInfo.pValues = &oldest.value;
+				vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+			}
+			stats.stallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - stallStart).count();
+			stats.stalls++;
+			oldest.fence = VK_NULL_HANDLE;
+			oldest.semaphore = VK_NULL_HANDLE;
+			retire();
+		}
+		// a region before the newest one means the end of the ring was skipped
+		if (!entries.empty() && offset < entries.back().end)
+		{
+			stats.wraps++;
+		}
+		entries.push_back({ offset, offset + size, VK_NULL_HANDLE, VK_NULL_HANDLE, 0, false });
+		stats.uploads++;
+		stats.bytesStaged += size;
+		stats.peakBytesInFlight = std::max(stats.peakBytesInFlight, bytesInFlight());
+
+		StagingRegion region{};
+		region.buffer = buffer;
+		region.offset = offset;
+		region.size = size;
+		region.mapped = mapped + offset;
+		region.id = firstId + entries.size() - 1;
+		return region;
+	}
+
+	/*
+	The commands reading region were submitted with fence, or signal semaphore with value
+	once they are done. Both null if they already completed.
+	*/
+	void release(const StagingRegion& region, VkFence fence, VkSemaphore semaphore = VK_NULL_HANDLE, uint64_t value = 0)
+	{
+		Entry& entry{ entries[region.id - firstId] };
+		entry.released = true;
+		entry.fence = fence;
+		entry.semaphore = semaphore;
+		entry.value = value;
+	}
+
+	// forgets the fences and semaphore values that signaled and frees the finished regions at the front of the ring
+	void retire()
+	{
+		for (Entry& entry : entries)
+		{
+			if (entry.fence != VK_NULL_HANDLE && vkGetFenceStatus(device, entry.fence) == VK_SUCCESS)
+			{
+				entry.fence = VK_NULL_HANDLE;
+			}
+			if (entry.semaphore != VK_NULL_HANDLE)
+			{
+				uint64_t value;
+				vkGetSemaphoreCounterValue(device, entry.semaphore, &value);
+				if (value >= entry.value)
+				{
+					entry.semaphore = VK_NULL_HANDLE;
+				}
+			}
+		}
+		while (!entries.empty() && entries.front().released && entries.front().fence == VK_NULL_HANDLE &&
+			entries.front().semaphore == VK_NULL_HANDLE)
+		{
+			entries.pop_front();
+			firstId++;
+		}
+	}
+
+	StagingStats stats;
+
+private:
+	struct Entry
+	{
+		VkDeviceSize begin;
+		VkDeviceSize end;
+		VkFence fence;
+		VkSemaphore semaphore;
+		uint64_t value;
+		bool released;
+	};
+	VkDevice device{ VK_NULL_HANDLE };
+	VkBuffer buffer{ VK_NULL_HANDLE };
+	uint8_t* mapped{ nullptr };
+	VkDeviceSize capacity{ 0 };
+	// live regions, oldest first; the id of entries[i] is firstId + i
+	std::deque<Entry> entries;
+	uint64_t firstId{ 0 };
+
+	/*
+	The live regions run from the front's begin (tail) to the back's end (head). When
+	head is not past tail the regions wrapped around and the free space is the gap in
+	between, otherwise it is the end of the buffer and then its start.
+	*/
+	bool place(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		if (entries.empty())
+		{
+			offset = 0;
+			return size <= capacity;
+		}
+		VkDeviceSize tail{ entries.front().begin };
+		VkDeviceSize head{ entries.back().end };
+		offset = (head + alignment - 1) & ~(alignment - 1);
+		if (head <= tail)
+		{
+			return offset + size <= tail;
+		}
+		if (offset + size <= capacity)
+		{
+			return true;
+		}
+		if (size <= tail)
+		{
+			offset = 0;
+			return true;
+		}
+		return false;
+	}
+
+	VkDeviceSize bytesInFlight() const
+	{
+		VkDeviceSize tail{ entries.front().begin };
+		VkDeviceSize head{ entries.back().end };
+		return head > tail ? head - tail : capacity - tail + head;
+	}
+};
+
+// A piece of the uniform arena: the dynamic offset to bind it with and where to write it.
+struct UniformAllocation
+{
+	uint32_t offset;
+	void* mapped;
+};
+
+struct UniformArenaStats
+{
+	uint64_t frames{ 0 };
+	uint64_t allocations{ 0 };
+	// most bytes a single frame took, padding included
+	VkDeviceSize peakFrameBytes{ 0 };
+};
+
+/*
+Per frame linear allocator for uniform data. One persistently mapped buffer holds a
+region per frame in flight, allocate hands out the next chunk of the current frame's
+region aligned to minUniformBufferOffsetAlignment. Draws find their chunk through the
+dynamic offset of a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC binding, so one
+descriptor set per frame covers any number of them. reset starts a frame's region
+over and may only run once the fence of the last submission reading it signaled.
+*/
+class UniformArena
+{
+public:
+	// alignment is a power of two, as Vulkan guarantees for minUniformBufferOffsetAlignment, and divides frameSize
+	void init(uint8_t* mapped, VkDeviceSize frameSize, VkDeviceSize alignment)
+	{
+		this->mapped = mapped;
+		this->frameSize = frameSize;
+		this->alignment = alignment;
+	}
+
+	VkDeviceSize regionSize() const
+	{
+		return frameSize;
+	}
+
+	void reset(uint32_t frame)
+	{
+		this->frame = frame;
+		head = 0;
+		stats.frames++;
+	}
+
+	UniformAllocation allocate(VkDeviceSize size)
+	{
+		VkDeviceSize offset{ (head + alignment - 1) & ~(alignment - 1) };
+		if (offset + size > frameSize)
+		{
+			throw std::runtime_error("failed to allocate uniform data, the frame's arena is full!");
+		}
+		head = offset + size;
+		stats.allocations++;
+		stats.peakFrameBytes = std::max(stats.peakFrameBytes, head);
+		VkDeviceSize bufferOffset{ frame * frameSize + offset };
+		return { static_cast<uint32_t>(bufferOffset), mapped + bufferOffset };
+	}
+
+	UniformArenaStats stats;
+
+private:
+	uint8_t* mapped{ nullptr };
+	VkDeviceSize frameSize{ 0 };
+	VkDeviceSize alignment{ 1 };
+	uint32_t frame{ 0 };
+	VkDeviceSize head{ 0 };
+};
+
+// Push constants of shaders/shader.vert and shader_compact.vert, see enablePushConstantTransforms.
+struct DrawPushConstants
+{
+	glm::mat4 modelViewProjection;
+	uint32_t drawId;
+};
+
+// Push constants of shaders/mipmap.comp.
+struct MipmapPushConstants
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t groupCount;
+};
+
+// How createTextureImageFromSource fills in the mip chain.
+enum class MipmapGenerator
+{
+	Blit,
+	// shaders/mipmap.comp, see enableComputeMipmaps
+	Compute,
+	// buildMipChainRgba8Srgb, then one copy of all levels; needs nothing from the device
+	Cpu
+};
+
+// Options taken from the command line, see main.
+struct RenderSettings
+{
+	// draw this LOD instead of picking one from the screen-space error
+	int forcedLod{ -1 };
+	// step through all LODs, two seconds each, to compare their frame times
+	bool lodSweep{ false };
+	// load the texture through both paths at startup and print the timings
+	bool compareTextureLoading{ false };
+	// stream the larger mip levels in after the first frame, see enableTextureStreaming
+	bool textureStreaming{ enableTextureStreaming };
+	// preferred mip generator, chooseMipmapGenerator falls back from it when the device can't run it
+	MipmapGenerator mipmapGenerator{ enableComputeMipmaps ? MipmapGenerator::Compute : MipmapGenerator::Blit };
+	// decode source textures straight into the staging buffer, see createTextureImageFromSource
+	bool directTextureDecode{ true };
+	// image the decode comparison of compareTextureLoading loads
+	std::string decodeTexturePath{ TEXTURE_PATH };
+	// record the startup uploads into one batch instead of submitting and waiting for each
+	bool batchStartupUploads{ true };
+	// transient MSAA color and depth attachments, see enableTransientAttachments
+	bool transientAttachments{ enableTransientAttachments };
+	// prefer a 16 bit depth buffer: half the memory and bandwidth of D32, less precision
+	bool d16Depth{ false };
+	// upload PackedVertex instead of Vertex, see enableCompactVertices
+	bool compactVertices{ enableCompactVertices };
+	// draw the culled meshlets with the mesh shader where the device can, see enableMeshShading
+	bool meshShading{ enableMeshShading };
+	// per-draw transforms as push constants instead of uniform buffers, see enablePushConstantTransforms
+	bool pushTransforms{ enablePushConstantTransforms };
+	// draw the model this many times, on a grid that fits where the single model was
+	uint32_t objectCount{ 1 };
+	// reuse recorded command buffers while the frame content is unchanged, see recordedCommandBuffers
+	bool cacheCommandBuffers{ false };
+	// record the draws into secondary command buffers on this many threads, 0 records them inline
+	uint32_t recordThreads{ 0 };
+	// time recording 1k to 100k draws on 1 thread up to one per core at startup, see benchmarkCommandRecording
+	bool benchmarkRecording{ false };
+	/*
+	The throughput against latency knobs. More frames in flight and swap chain images let
+	the CPU run further ahead of the display, each one a frame of latency when the GPU or
+	the display is the bottleneck. 0 images asks for one more than the surface minimum,
+	no present mode prefers mailbox over FIFO, see chooseSwapPresentMode.
+	*/
+	uint32_t framesInFlight{ DEFAULT_FRAMES_IN_FLIGHT };
+	uint32_t swapChainImageCount{ 0 };
+	std::optional<VkPresentModeKHR> presentMode;
+	// one timeline semaphore instead of the per-frame fences, see enableTimelineFrameSync
+	bool timelineFrameSync{ enableTimelineFrameSync };
+};
+
+class HelloTriangleApplication
+{
+public:
+	explicit HelloTriangleApplication(const RenderSettings& settings = {})
+		: settings{ settings }
+	{
+	}
+
+	void run()
+	{
+		runStart = std::chrono::high_resolution_clock::now();
+		initWindow();
+		initVulkan();
+		if (settings.benchmarkRecording)
+		{
+			benchmarkCommandRecording();
+		}
+		mainLoop();
+		printLodReport();
+		printMeshletReport();
+		printMemoryReport();
+		printAttachmentReport();
+		printTransformReport();
+		printCommandBufferReport();
+		printFrameTimingReport();
+		cleanup();
+	}
+
+private:
+	GLFWwindow* window;
+	VkInstance instance;
+	VkDebugUtilsMessengerEXT debugMessenger;
+	VkSurfaceKHR surface;
+	VkPhysicalDevice physicalDevice{ VK_NULL_HANDLE };
+	VkDevice device;
+	// every buffer and image takes its memory from here, see createBuffer and createImage
+	DeviceMemoryAllocator memoryAllocator;
+	// uploads stage their data here, see acquireStaging
+	VkBuffer stagingRingBuffer{ VK_NULL_HANDLE };
+	MemoryAllocation stagingRingMemory{};
+	StagingRing stagingRing;
+	// oversized uploads' temporary buffers and the fence or upload after which they can go
+	std::vector<std::tuple<StagingRegion, VkFence, VkSemaphore, uint64_t>> temporaryStaging;
+	/*
+	Asynchronous uploads, see submitUpload. uploadQueue is the transfer queue, or the
+	graphics queue when the device has no transfer-only family. Every upload submission
+	signals uploadTimeline with the next value, the token the upload functions return.
+	Resources copied on another family are released there and acquired on the graphics
+	queue by the next frame; pendingBufferAcquires/pendingImageAcquires hold those
+	barriers and pendingAcquireUpload the upload they have to wait for.
+	*/
+	bool asyncUploadsSupported{ false };
+	uint32_t graphicsQueueFamily{ 0 };
+	uint32_t uploadQueueFamily{ 0 };
+	VkQueue uploadQueue;
+	VkCommandPool uploadCommandPool{ VK_NULL_HANDLE };
+	VkSemaphore uploadTimeline{ VK_NULL_HANDLE };
+	UploadToken uploadTimelineValue{ 0 };
+	std::vector<std::pair<VkCommandBuffer, UploadToken>> uploadCommandBuffers;
+	std::vector<VkBufferMemoryBarrier> pendingBufferAcquires;
+	std::vector<VkImageMemoryBarrier> pendingImageAcquires;
+	UploadToken pendingAcquireUpload{ 0 };
+	// the upload each resource the frames draw with waits for, reset to 0 once it completed
+	UploadToken vertexBufferUpload{ 0 };
+	UploadToken indexBufferUpload{ 0 };
+	UploadToken textureUpload{ 0 };
+	UploadToken meshletBufferUpload{ 0 };
+	UploadStats uploadStats;
+	// open between beginUploadBatch and submitUploadBatch, the submitted ones wait in retireStaging
+	UploadBatch uploadBatch;
+	std::vector<UploadBatch> submittedUploadBatches;
+	VkQueue graphicsQueue;
+	VkQueue presentQueue;
+	VkSwapchainKHR swapChain;
+	std::vector<VkImage> swapChainImages;
+	VkFormat swapChainImageFormat;
+	VkExtent2D swapChainExtent;
+	VkPresentModeKHR swapChainPresentMode;
+	std::vector<VkImageView> swapChainImageViews;
+	VkRenderPass renderPass;
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	std::vector<VkDescriptorSet> descriptorSets;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline graphicsPipeline;
+	std::vector<VkFramebuffer> swapChainFramebuffers;
+	VkCommandPool commandPool;
+	VkBuffer vertexBuffer;
+	MemoryAllocation vertexBufferMemory;
+	VkBuffer indexBuffer;
+	MemoryAllocation indexBufferMemory;
+	// the uniform data of all frames in flight, see UniformArena
+	VkBuffer uniformArenaBuffer{ VK_NULL_HANDLE };
+	MemoryAllocation uniformArenaMemory{};
+	UniformArena uniformArena;
+	// the dynamic offset of this frame's FrameUniforms
+	uint32_t frameUniformOffset{ 0 };
+	/*
+	The settings.objectCount objects, see placeObjects. updateUniformBuffer writes where
+	each one's transform comes from this frame: its push constants with
+	settings.pushTransforms, the offset of its DrawUniforms otherwise. The first object
+	has DrawUniforms either way, the mesh shader reads them.
+	*/
+	std::vector<glm::mat4> objectPlacements;
+	std::vector<DrawPushConstants> drawPushConstants;
+	std::vector<uint32_t> drawUniformOffsets;
+	struct TransformStats
+	{
+		uint64_t frames{ 0 };
+		double updateSeconds{ 0.0 };
+		double recordSeconds{ 0.0 };
+		uint64_t draws{ 0 };
+		uint64_t queriedFrames{ 0 };
+		uint64_t vertexInvocations{ 0 };
+	};
+	TransformStats transformStats;
+	// counts the vertex shader invocations of each frame in flight, needs pipelineStatisticsQuery
+	bool pipelineStatisticsSupported{ false };
+	// the query can stay active across vkCmdExecuteCommands
+	bool inheritedQueriesSupported{ false };
+	VkQueryPool statisticsQueryPool{ VK_NULL_HANDLE };
+	std::vector<bool> statisticsQueryPending;
+	std::vector<VkCommandBuffer> commandBuffers;
+	/*
+	With settings.cacheCommandBuffers a frame submits the command buffer recorded for its
+	frame in flight and swap chain image, recordedCommandBuffers[frame * images + image],
+	as long as what went into it still holds: the generation, bumped whenever a pipeline
+	or descriptor set it uses changes, the LOD and the uniform offsets. The uniform data
+	behind those offsets changes every frame without touching the commands. Swap chain
+	recreation frees them all, see allocateRecordedCommandBuffers.
+	*/
+	struct RecordedCommandBuffer
+	{
+		VkCommandBuffer commandBuffer{ VK_NULL_HANDLE };
+		// 0 while it holds nothing to reuse
+		uint64_t generation{ 0 };
+		uint32_t lod{ 0 };
+		uint32_t frameUniformOffset{ 0 };
+		std::vector<uint32_t> drawUniformOffsets;
+		uint64_t draws{ 0 };
+	};
+	std::vector<RecordedCommandBuffer> recordedCommandBuffers;
+	uint64_t commandBufferGeneration{ 1 };
+	// one index buffer draw of this frame, see collectDraws
+	struct IndexedDraw
+	{
+		uint32_t object;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t vertexOffset;
+	};
+	std::vector<IndexedDraw> frameDraws;
+	/*
+	With settings.recordThreads the draws are split over that many threads, see
+	recordSecondaryDraws. Thread t of frame f records recordingCommandBuffers[f * threads + t]
+	from its own pool recordingCommandPools[f * threads + t], which it resets when frame f
+	comes around again, after its fence.
+	*/
+	std::unique_ptr<WorkerPool> recordingWorkers;
+	std::vector<VkCommandPool> recordingCommandPools;
+	std::vector<VkCommandBuffer> recordingCommandBuffers;
+	struct CommandBufferStats
+	{
+		uint64_t frames{ 0 };
+		uint64_t recorded{ 0 };
+		uint64_t reused{ 0 };
+		double recordSeconds{ 0.0 };
+		// checking the key and setting up the submission of a reused one
+		double reuseSeconds{ 0.0 };
+	};
+	CommandBufferStats commandBufferStats;
+	std::vector<VkSemaphore> imageAvailableSemaphores;
+	std::vector<VkSemaphore> renderFinishedSemaphores;
+	std::vector<VkFence> inFlightFences;
+	/*
+	With settings.timelineFrameSync the frames signal frameTimeline instead of
+	inFlightFences: frame n of the run signals value n. frameTimelineValue is the last
+	frame number handed out and frameSubmitValues the one each frame in flight got, 0
+	before its first submission. The fences keep the same numbers in frameSubmitValues,
+	so frameComplete and waitForFrame work the same with either.
+	*/
+	VkSemaphore frameTimeline{ VK_NULL_HANDLE };
+	uint64_t frameTimelineValue{ 0 };
+	std::vector<uint64_t> frameSubmitValues;
+	bool framebufferResized{ false };
+	uint32_t currentFrame{ 0 };
+	uint32_t mipLevels;
+	VkFormat textureFormat{ VK_FORMAT_R8G8B8A8_SRGB };
+	VkExtent3D textureExtent{};
+	bool textureCompressionBCEnabled{ false };
+	VkImage textureImage;
+	MemoryAllocation textureImageMemory;
+	VkImageView textureImageView;
+	VkSampler textureSampler;
+	/*
+	Texture streaming state. The loader thread copies levels from streamingFile into the
+	mapped staging buffer and publishes the lowest level done in streamingStagedLevel;
+	the render loop copies levels down to that one into the image and moves
+	streamingUploadedLevel after it. textureLodSamplers[i] has minLod i, the level 0
+	entry stays null since textureSampler is used then. descriptorSetTextureLevel holds
+	the level each frame's descriptor set currently clamps to.
+	*/
+	Ktx2File streamingFile;
+	std::thread streamingThread;
+	std::atomic<uint32_t> streamingStagedLevel{ 0 };
+	std::atomic<bool> streamingCanceled{ false };
+	uint32_t streamingUploadedLevel{ 0 };
+	StagingRegion streamingStaging{};
+	std::vector<VkDeviceSize> streamingLevelOffsets;
+	std::vector<VkSampler> textureLodSamplers;
+	std::vector<uint32_t> descriptorSetTextureLevel;
+	/*
+	Compute mip generation. computeMipmapsSupported is set by createLogicalDevice,
+	mipmapPipeline stays null when it isn't or shaders/mipmap.spv is missing.
+	*/
+	bool computeMipmapsSupported{ false };
+	VkDescriptorSetLayout mipmapDescriptorSetLayout{ VK_NULL_HANDLE };
+	VkPipelineLayout mipmapPipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline mipmapPipeline{ VK_NULL_HANDLE };
+	VkDescriptorPool mipmapDescriptorPool{ VK_NULL_HANDLE };
+	VkBuffer mipmapCounterBuffer;
+	MemoryAllocation mipmapCounterBufferMemory;
+	// time spent in the last generateMipmaps(Compute) call, for compareTextureLoading
+	double mipmapMilliseconds{ 0.0 };
+	std::chrono::high_resolution_clock::time_point runStart;
+	bool firstFramePresented{ false };
+	bool fullQualityPresented{ false };
+	VkImage depthImage;
+	MemoryAllocation depthImageMemory;
+	VkImageView depthImageView;
+	VkSampleCountFlagBits msaaSamples{ VK_SAMPLE_COUNT_1_BIT };
+	VkImage colorImage;
+	MemoryAllocation colorImageMemory;
+	VkImageView colorImageView;
+	/*
+	loadModel points these at either the freshly welded vertices/indices vectors or
+	straight into the mapped mesh cache; the buffer creation functions only read
+	through them.
+	*/
+	MappedFile meshCacheFile;
+	std::span<const Vertex> vertexData;
+	std::span<const uint32_t> indexData;
+	uint32_t indexCount{ 0 };
+	// only filled with settings.compactVertices
+	QuantizedMesh quantizedMesh{};
+	glm::mat4 positionDequantize{ 1.0f };
+	VkIndexType indexType{ VK_INDEX_TYPE_UINT32 };
+	std::vector<uint16_t> indices16;
+	std::vector<SubMesh> subMeshes;
+	/*
+	The sub-meshes of LOD i are subMeshes[lodFirstSubMesh[i]] up to (excluding)
+	subMeshes[lodFirstSubMesh[i + 1]].
+	*/
+	std::vector<MeshLod> lods;
+	std::vector<uint32_t> lodFirstSubMesh;
+	glm::vec3 boundsCenter;
+	float boundsRadius;
+	// camera state of the current frame, written by updateUniformBuffer
+	glm::mat4 modelMatrix{ 1.0f };
+	glm::vec3 cameraPosition{ 2.0f, 2.0f, 2.0f };
+	float cameraFovY{ glm::radians(45.0f) };
+	RenderSettings settings;
+	uint32_t currentLod{ 0 };
+	struct LodFrameStats
+	{
+		double seconds{ 0.0 };
+		uint64_t frames{ 0 };
+	};
+	std::vector<LodFrameStats> lodFrameStats;
+	std::chrono::high_resolution_clock::time_point lastFrameTime{};
+	/*
+	When each frame in flight sampled its input, see updateUniformBuffer; reset once it
+	was seen complete, which ends a latency sample of printFrameTimingReport.
+	*/
+	std::vector<std::chrono::high_resolution_clock::time_point> frameInputTimes;
+	struct FrameTimingStats
+	{
+		uint64_t frames{ 0 };
+		double frameSeconds{ 0.0 };
+		double frameWaitSeconds{ 0.0 };
+		double acquireSeconds{ 0.0 };
+		uint64_t latencySamples{ 0 };
+		double latencySeconds{ 0.0 };
+		double maxLatencySeconds{ 0.0 };
+	};
+	FrameTimingStats frameTimingStats;
+	// proj * view of the current frame, the meshlet culling works on it
+	glm::mat4 viewProjection{ 1.0f };
+	/*
+	The meshlets of LOD i are meshletData.meshlets[lodFirstMeshlet[i]] up to
+	(excluding) meshletData.meshlets[lodFirstMeshlet[i + 1]].
+	*/
+	MeshletBuild meshletData;
+	std::vector<uint32_t> lodFirstMeshlet;
+	std::vector<uint32_t> visibleMeshlets;
+	struct MeshletCullStats
+	{
+		uint64_t frames{ 0 };
+		uint64_t meshlets{ 0 };
+		uint64_t visibleMeshlets{ 0 };
+		uint64_t triangles{ 0 };
+		uint64_t frustumCulledTriangles{ 0 };
+		uint64_t coneCulledTriangles{ 0 };
+		uint64_t draws{ 0 };
+	};
+	MeshletCullStats meshletStats;
+	// set by createLogicalDevice when settings.meshShading is on and the device has VK_EXT_mesh_shader
+	bool meshShadingSupported{ false };
+	PFN_vkCmdDrawMeshTasksEXT cmdDrawMeshTasks{ nullptr };
+	VkPipeline meshPipeline{ VK_NULL_HANDLE };
+	VkBuffer meshletBuffer;
+	MemoryAllocation meshletBufferMemory;
+	VkBuffer meshletVertexBuffer;
+	MemoryAllocation meshletVertexBufferMemory;
+	VkBuffer meshletTriangleBuffer;
+	MemoryAllocation meshletTriangleBufferMemory;
+	// per frame in flight list of the meshlets that survived culling, one task each
+	std::vector<VkBuffer> visibleMeshletBuffers;
+	std::vector<MemoryAllocation> visibleMeshletBuffersMemory;
+	std::vector<void*> visibleMeshletBuffersMapped;
+
+	void initWindow()
+	{
+		glfwInit();
+
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // we don't want to create a opengl context
+		//glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE); // window resizing is more involved so disable it
+
+		window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr); // 1st nullptr is for monitor, 2nd for opengl
+		glfwSetWindowUserPointer(window, this);
+		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+
+	}
+
+	void initVulkan()
+	{
+		auto initStart{ std::chrono::high_resolution_clock::now() };
+		// the shader binaries decide which of the settings can be honoured
+		checkShaderModules();
+		/*
+		The very first thing you need to do is initialize the Vulkan library by creating
+		an instance. The instance is the connection between your application and
+		the Vulkan library and creating it involves specifying some details about your
+		application to the driver.
+		*/
+		createInstance();
 		/*
 		Setting up the debug messenger function requires the instance to be created first
 		Since vkCreateDebugUtilsMessengerEXT func is an extension func the instance is required
@@ -354,6 +4931,9 @@ private:
 		device if you have varying requirements.
 		*/
 		createLogicalDevice();
+		// the 1.1 queries for dedicated allocations need both the instance and the device at 1.1
+		memoryAllocator.init(physicalDevice, device, VULKAN_API_VERSION >= VK_API_VERSION_1_1);
+		createStagingRing();
 		/*
 		With the logical device and queue handles we can now actually start using the
 		graphics card to do things!
@@ -384,6 +4964,17 @@ private:
 		*/
 		createDescriptorSetLayout();
 		/*
+		The model is loaded before the pipeline is created, since the vertex layout of
+		the compact path depends on the range of its texture coordinates.
+		*/
+		loadModel();
+		computeModelBounds();
+		placeObjects();
+		chooseIndexType();
+		// the meshlets need the final index layout and the float positions
+		buildModelMeshlets();
+		quantizeModel();
+		/*
 		The graphics pipeline is the sequence
 		of operations that take the vertices and textures of your meshes all the
 		way to the pixels in the render targets.
@@ -403,6 +4994,15 @@ private:
 		buffers are allocated from them.
 		*/
 		createCommandPool();
+		createUploadObjects();
+		/*
+		Everything from here to the mesh buffers goes to the GPU in one batch: the
+		attachment layout changes, the texture with its mip chain and the model buffers.
+		*/
+		if (settings.batchStartupUploads)
+		{
+			beginUploadBatch();
+		}
 		createColorResources();
 		createDepthResources();
 		/*
@@ -416,6 +5016,7 @@ private:
 		retrieved image at drawing time.
 		*/
 		createFramebuffers();
+		createMipmapPipeline();
 		/*
 		Adding a texture to our application will involve the following steps:
 		• Create an image object backed by device memory
@@ -437,7 +5038,6 @@ private:
 		color that is retrieved.
 		*/
 		createTextureSampler();
-		loadModel();
 		/*
 		Buffers in Vulkan are regions of memory used for storing arbitrary data that can
 		be read by the graphics card. They can be used to store vertex data but they can
@@ -455,6 +5055,13 @@ private:
 		you to reorder the vertex data, and reuse existing data for multiple vertices.
 		*/
 		createIndexBuffer();
+		createMeshletBuffers();
+		if (uploadBatchOpen())
+		{
+			submitUploadBatch();
+		}
+		// Both arrays live on the GPU now, the CPU side copies (or the mapping) can go.
+		releaseModelData();
 		/*
 		A descriptor is a way for shaders to freely access resources like buffers and images. We’re
 		going to set up a buffer that contains the transformation matrices and have the
@@ -491,6 +5098,17 @@ private:
 		createCommandBuffers();
 
 		createSyncObjects();
+		createStatisticsQueryPool();
+		createRecordingCommandPools();
+
+		/*
+		Without the batch every upload operation is a submission the CPU waits for, with
+		it the transfers overlap the rest of the startup and only the frames wait for them.
+		*/
+		std::cout << "initVulkan: " << std::chrono::duration<double, std::milli>(
+			std::chrono::high_resolution_clock::now() - initStart).count() << " ms, " << uploadStats.operations
+			<< " upload operation(s) in " << uploadStats.queueSubmits << " queue submission(s)"
+			<< (settings.batchStartupUploads ? ", batched" : "") << std::endl;
 	}
 
 	void mainLoop()
@@ -507,35 +5125,106 @@ private:
 	void cleanup()
 	{
 		cleanupSwapChain();
+		streamingCanceled = true;
+		if (streamingThread.joinable())
+		{
+			streamingThread.join();
+		}
+		// a stream that didn't get to the last level still holds its staging
+		if (streamingStaging.memory.memory != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(device, streamingStaging.buffer, nullptr);
+			memoryAllocator.free(streamingStaging.memory);
+		}
+		// everything finished, this only runs what the upload batches left to do
+		retireStaging();
+		for (auto& [region, fence, semaphore, value] : temporaryStaging)
+		{
+			vkDestroyBuffer(device, region.buffer, nullptr);
+			memoryAllocator.free(region.memory);
+		}
+		vkDestroyBuffer(device, stagingRingBuffer, nullptr);
+		memoryAllocator.free(stagingRingMemory);
+		if (asyncUploadsSupported)
+		{
+			vkDestroySemaphore(device, uploadTimeline, nullptr);
+			vkDestroyCommandPool(device, uploadCommandPool, nullptr);
+		}
+		for (VkSampler sampler : textureLodSamplers)
+		{
+			if (sampler != VK_NULL_HANDLE)
+			{
+				vkDestroySampler(device, sampler, nullptr);
+			}
+		}
+		if (mipmapPipeline != VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(device, mipmapCounterBuffer, nullptr);
+			memoryAllocator.free(mipmapCounterBufferMemory);
+			vkDestroyDescriptorPool(device, mipmapDescriptorPool, nullptr);
+			vkDestroyPipeline(device, mipmapPipeline, nullptr);
+			vkDestroyPipelineLayout(device, mipmapPipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(device, mipmapDescriptorSetLayout, nullptr);
+		}
 		vkDestroySampler(device, textureSampler, nullptr);
 		vkDestroyImageView(device, textureImageView, nullptr);
 		vkDestroyImage(device, textureImage, nullptr);
-		vkFreeMemory(device, textureImageMemory, nullptr);
+		memoryAllocator.free(textureImageMemory);
 		//The uniform data will be used for all draw calls, so the buffer containing it
 		//should only be destroyed when we stop rendering.
-		for (size_t i{ 0 }; i < MAX_FRAMES_IN_FLIGHT; i++)
-		{
-			vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-			vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-		}
+		vkDestroyBuffer(device, uniformArenaBuffer, nullptr);
+		memoryAllocator.free(uniformArenaMemory);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 		vkDestroyBuffer(device, vertexBuffer, nullptr);
-		vkFreeMemory(device, vertexBufferMemory, nullptr);
+		memoryAllocator.free(vertexBufferMemory);
 		vkDestroyBuffer(device, indexBuffer, nullptr);
-		vkFreeMemory(device, indexBufferMemory, nullptr);
+		memoryAllocator.free(indexBufferMemory);
+		if (meshShadingSupported)
+		{
+			vkDestroyBuffer(device, meshletBuffer, nullptr);
+			memoryAllocator.free(meshletBufferMemory);
+			vkDestroyBuffer(device, meshletVertexBuffer, nullptr);
+			memoryAllocator.free(meshletVertexBufferMemory);
+			vkDestroyBuffer(device, meshletTriangleBuffer, nullptr);
+			memoryAllocator.free(meshletTriangleBufferMemory);
+			for (size_t i{ 0 }; i < settings.framesInFlight; i++)
+			{
+				vkDestroyBuffer(device, visibleMeshletBuffers[i], nullptr);
+				memoryAllocator.free(visibleMeshletBuffersMemory[i]);
+			}
+			vkDestroyPipeline(device, meshPipeline, nullptr);
+		}
 		vkDestroyPipeline(device, graphicsPipeline, nullptr);
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
 		vkDestroyRenderPass(device, renderPass, nullptr);
 
-		for (size_t i{ 0 }; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (size_t i{ 0 }; i < settings.framesInFlight; i++)
 		{
 			vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
 			vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-			vkDestroyFence(device, inFlightFences[i], nullptr);
+		}
+		for (VkFence fence : inFlightFences)
+		{
+			vkDestroyFence(device, fence, nullptr);
+		}
+		if (frameTimeline != VK_NULL_HANDLE)
+		{
+			vkDestroySemaphore(device, frameTimeline, nullptr);
+		}
+
+		if (statisticsQueryPool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(device, statisticsQueryPool, nullptr);
+		}
+		recordingWorkers.reset();
+		for (VkCommandPool pool : recordingCommandPools)
+		{
+			vkDestroyCommandPool(device, pool, nullptr);
 		}
 
 		vkDestroyCommandPool(device, commandPool, nullptr);
+		memoryAllocator.destroy();
 		
 		//Logical devices don’t interact directly with instances, which is why it’s not included as a parameter.
 		vkDestroyDevice(device, nullptr);
@@ -561,10 +5250,10 @@ private:
 	{
 		vkDestroyImageView(device, depthImageView, nullptr);
 		vkDestroyImage(device, depthImage, nullptr);
-		vkFreeMemory(device, depthImageMemory, nullptr);
+		memoryAllocator.free(depthImageMemory);
 		vkDestroyImageView(device, colorImageView, nullptr);
 		vkDestroyImage(device, colorImage, nullptr);
-		vkFreeMemory(device, colorImageMemory, nullptr);
+		memoryAllocator.free(colorImageMemory);
 		//delete the framebuffers before the image views and render pass that
 		//they are based on, but only after we’ve finished rendering
 		for (auto framebuffer : swapChainFramebuffers)
@@ -592,7 +5281,8 @@ private:
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		// VK_EXT_mesh_shader needs SPIR-V 1.4, which is core from Vulkan 1.2 on
+		appInfo.apiVersion = VULKAN_API_VERSION;
 
 		/*
 		This next struct is not optional and tells
@@ -933,6 +5623,16 @@ private:
 			}
 			i++;
 		}
+		// a family without compute as well is the dedicated copy engine, take it over one with compute
+		for (uint32_t family{ 0 }; family < queueFamilyCount; family++)
+		{
+			VkQueueFlags flags{ queueFamilies[family].queueFlags };
+			bool transferOnly{ (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) };
+			if (transferOnly && (!indices.transferFamily || !(flags & VK_QUEUE_COMPUTE_BIT)))
+			{
+				indices.transferFamily = family;
+			}
+		}
 		return indices;
 	}
 
@@ -1018,6 +5718,10 @@ private:
 				indices.grahicsFamily.value(),
 				indices.presentFamily.value()
 		} };
+		if (enableAsyncUploads && indices.transferFamily)
+		{
+			uniqueQueueFamilies.insert(indices.transferFamily.value());
+		}
 		/*
 		The currently available drivers will only allow you to create a small number of
 		queues for each queue family and you don’t really need more than one. That’s
@@ -1058,10 +5762,121 @@ private:
 		improve the image quality even further, though at an additional performance
 		cost
 		*/
-		deviceFeatures.sampleRateShading = VK_TRUE;
+		deviceFeatures.sampleRateShading = VK_TRUE;
+		// BC textures are optional, chooseTextureFormat falls back to RGBA8 without them
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+		textureCompressionBCEnabled = supportedFeatures.textureCompressionBC == VK_TRUE;
+		deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+		// only for the vertex shader invocations printTransformReport shows
+		pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+		deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+		inheritedQueriesSupported = supportedFeatures.inheritedQueries == VK_TRUE;
+		deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+		/*
+		The compute mip generator indexes an array of storage images with the level and
+		writes UNORM views of the sRGB texture. That takes Vulkan 1.1 (extended image usage
+		and VkImageViewUsageCreateInfo) and a graphics queue family that also does compute.
+		*/
+		if (enableComputeMipmaps)
+		{
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+			uint32_t queueFamilyCount{ 0 };
+			vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+			std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+			vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+			computeMipmapsSupported = properties.apiVersion >= VK_API_VERSION_1_1 &&
+				supportedFeatures.shaderStorageImageArrayDynamicIndexing == VK_TRUE &&
+				(queueFamilies[indices.grahicsFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT);
+			deviceFeatures.shaderStorageImageArrayDynamicIndexing = computeMipmapsSupported;
+		}
+		/*
+		The mesh shader path is optional: without the extension, the meshShader feature or
+		a Vulkan 1.2 device and instance (for SPIR-V 1.4) the meshlets are drawn from the
+		index buffer.
+		*/
+		std::vector<const char*> enabledExtensions{ deviceExtensions };
+		VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+		meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+		if (settings.meshShading && enableMeshletCulling)
+		{
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+			uint32_t extensionCount{ 0 };
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+			std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+			vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+			bool hasExtension{ std::any_of(availableExtensions.begin(), availableExtensions.end(),
+				[](const VkExtensionProperties& extension) { return strcmp(extension.extensionName, VK_EXT_MESH_SHADER_EXTENSION_NAME) == 0; }) };
+			if (hasExtension && properties.apiVersion >= VK_API_VERSION_1_2 && VULKAN_API_VERSION >= VK_API_VERSION_1_2)
+			{
+				VkPhysicalDeviceFeatures2 features2{};
+				features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+				features2.pNext = &meshShaderFeatures;
+				vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+				meshShadingSupported = meshShaderFeatures.meshShader == VK_TRUE;
+			}
+			// only the mesh stage is used, no task shaders or the other optional parts
+			meshShaderFeatures = {};
+			meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+			meshShaderFeatures.meshShader = VK_TRUE;
+			if (meshShadingSupported)
+			{
+				enabledExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+			}
+			std::cout << "mesh shading " << (meshShadingSupported ? "enabled" : "not supported, culling on the CPU only") << std::endl;
+		}
+
+		/*
+		The uploads signal a timeline semaphore with an increasing value per submission,
+		which is what the frames wait on. The frames signal one of their own, see
+		frameTimeline.
+		*/
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		bool timelineSemaphoresSupported{ false };
+		if (enableAsyncUploads || settings.timelineFrameSync)
+		{
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+			if (properties.apiVersion >= VK_API_VERSION_1_2)
+			{
+				VkPhysicalDeviceFeatures2 features2{};
+				features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+				features2.pNext = &timelineFeatures;
+				vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+				timelineSemaphoresSupported = timelineFeatures.timelineSemaphore == VK_TRUE;
+			}
+			timelineFeatures.pNext = nullptr;
+			timelineFeatures.timelineSemaphore = timelineSemaphoresSupported;
+		}
+		if (enableAsyncUploads)
+		{
+			asyncUploadsSupported = timelineSemaphoresSupported;
+			std::cout << "uploads: " << (!asyncUploadsSupported ? "synchronous, no timeline semaphores" :
+				indices.transferFamily ? "asynchronous on a transfer queue" : "asynchronous on the graphics queue") << std::endl;
+		}
+		if (settings.timelineFrameSync && !timelineSemaphoresSupported)
+		{
+			settings.timelineFrameSync = false;
+			std::cout << "frame sync: fences, no timeline semaphores" << std::endl;
+		}
 
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		void* featureChain{ nullptr };
+		if (meshShadingSupported)
+		{
+			meshShaderFeatures.pNext = featureChain;
+			featureChain = &meshShaderFeatures;
+		}
+		if (timelineSemaphoresSupported)
+		{
+			timelineFeatures.pNext = featureChain;
+			featureChain = &timelineFeatures;
+		}
+		createInfo.pNext = featureChain;
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = queueCreateInfos.size();
 		createInfo.pEnabledFeatures = &deviceFeatures;
@@ -1070,8 +5885,8 @@ private:
 		struct and requires you to specify extensions and validation layers. The difference
 		is that these are device specific this time.
 		*/
-		createInfo.enabledExtensionCount = deviceExtensions.size();
-		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		createInfo.enabledExtensionCount = enabledExtensions.size();
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 		/*
 		Previous implementations of Vulkan made a distinction between instance and device
 		specific validation layers, but this is no longer the case. That means that the
@@ -1096,6 +5911,13 @@ private:
 
 		vkGetDeviceQueue(device, indices.grahicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+		graphicsQueueFamily = indices.grahicsFamily.value();
+		uploadQueueFamily = asyncUploadsSupported && indices.transferFamily ? indices.transferFamily.value() : graphicsQueueFamily;
+		vkGetDeviceQueue(device, uploadQueueFamily, 0, &uploadQueue);
+		if (meshShadingSupported)
+		{
+			cmdDrawMeshTasks = reinterpret_cast<PFN_vkCmdDrawMeshTasksEXT>(vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT"));
+		}
 	}
 
 	void createSwapChain()
@@ -1103,6 +5925,7 @@ private:
 		SwapChainSupportDetails swapChainSupport{ querySwapChainSupport(physicalDevice) };
 		VkSurfaceFormatKHR surfaceFormat{ chooseSwapSurfaceFormat(swapChainSupport.formats) };
 		VkPresentModeKHR presentMode{ chooseSwapPresentMode(swapChainSupport.presentModes) };
+		swapChainPresentMode = presentMode;
 		VkExtent2D extent{ chooseSwapExtent(swapChainSupport.capabilities) };
 		/*
 		simply sticking to this minimum means that we may sometimes have
@@ -1111,6 +5934,11 @@ private:
 		more image than the minimum:
 		*/
 		uint32_t imageCount{ swapChainSupport.capabilities.minImageCount + 1 };
+		// unless --swapchain-images asks for a number, which the surface limits still apply to
+		if (settings.swapChainImageCount > 0)
+		{
+			imageCount = std::max(settings.swapChainImageCount, swapChainSupport.capabilities.minImageCount);
+		}
 		if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
 		{
 			imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -1254,7 +6082,18 @@ private:
 		sync. This is commonly known as “triple buffering”, although the existence
 		of three buffers alone does not necessarily mean that the framerate
 		is unlocked.
+		--present-mode picks one of them; FIFO is the one every device has to support,
+		so a mode the surface doesn't offer falls back to it.
 		*/
+		if (settings.presentMode)
+		{
+			if (std::find(availablePresentModes.begin(), availablePresentModes.end(), *settings.presentMode) != availablePresentModes.end())
+			{
+				return *settings.presentMode;
+			}
+			std::cout << "present mode " << presentModeName(*settings.presentMode) << " not supported, using fifo" << std::endl;
+			return VK_PRESENT_MODE_FIFO_KHR;
+		}
 		for (const auto& availablePresentMode : availablePresentModes)
 		{
 			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
@@ -1324,11 +6163,23 @@ private:
 		}
 	}
 
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
+	/*
+	A non-zero usage limits what the view is used for, needed when the image has usages
+	its view format doesn't support (storage on an sRGB image). Vulkan 1.1 only.
+	*/
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels,
+		VkImageUsageFlags usage = 0)
 	{
 		VkImageViewCreateInfo viewInfo{};
 		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 		viewInfo.image = image;
+		VkImageViewUsageCreateInfo usageInfo{};
+		usageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO;
+		usageInfo.usage = usage;
+		if (usage != 0)
+		{
+			viewInfo.pNext = &usageInfo;
+		}
 		/*
 		The viewType and format fields specify how the image data should be interpreted.
 		The viewType parameter allows you to treat images as 1D textures, 2D
@@ -1383,9 +6234,13 @@ private:
 		memory and can be read later
 		• VK_ATTACHMENT_STORE_OP_DONT_CARE: Contents of the framebuffer will
 		be undefined after the rendering operation
+		The multisampled image is resolved into the swap chain image at the end of the
+		subpass and never read after it, so its samples don't have to be written back.
+		On a tile based GPU that keeps them out of memory entirely, which is what lets
+		the attachment be transient.
 		*/
 		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		/*
 		The loadOp and storeOp apply to color and depth data, and stencilLoadOp /
 		stencilStoreOp apply to stencil data.
@@ -1417,8 +6272,9 @@ private:
 		VkAttachmentDescription colorAttachmentResolve{};
 		colorAttachmentResolve.format = swapChainImageFormat;
 		colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+		// the resolve overwrites every pixel, but the result is what gets presented and has to be stored
 		colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1571,7 +6427,8 @@ private:
 		descriptorCount of 1.
 		*/
 		uboLayoutBinding.binding = 0;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		// dynamic, so each draw can point it at its own piece of the uniform arena
+		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		uboLayoutBinding.descriptorCount = 1;
 		/*
 		We also need to specify in which shader stages the descriptor is going to be referenced.
@@ -1597,7 +6454,30 @@ private:
 		*/
 		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		std::array< VkDescriptorSetLayoutBinding, 2> bindings{ uboLayoutBinding, samplerLayoutBinding };
+		// the DrawUniforms of each object, also dynamic
+		VkDescriptorSetLayoutBinding drawUniformsLayoutBinding{ uboLayoutBinding };
+		drawUniformsLayoutBinding.binding = 7;
+
+		std::vector<VkDescriptorSetLayoutBinding> bindings{ uboLayoutBinding, samplerLayoutBinding, drawUniformsLayoutBinding };
+		/*
+		shader.mesh transforms the vertices itself, so it needs the uniform buffers too,
+		plus five storage buffers at bindings 2 to 6: meshlets, meshlet vertices,
+		meshlet triangles, the vertex buffer and the list of visible meshlets.
+		*/
+		if (meshShadingSupported)
+		{
+			bindings[0].stageFlags |= VK_SHADER_STAGE_MESH_BIT_EXT;
+			bindings[2].stageFlags |= VK_SHADER_STAGE_MESH_BIT_EXT;
+			for (uint32_t binding = 2; binding <= 6; binding++)
+			{
+				VkDescriptorSetLayoutBinding storageLayoutBinding{};
+				storageLayoutBinding.binding = binding;
+				storageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				storageLayoutBinding.descriptorCount = 1;
+				storageLayoutBinding.stageFlags = VK_SHADER_STAGE_MESH_BIT_EXT;
+				bindings.push_back(storageLayoutBinding);
+			}
+		}
 
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -1659,7 +6539,7 @@ private:
 	*/
 	void createGraphicsPipeline()
 	{
-		auto vertShaderCode{ readFile("shaders/vert.spv") };
+		auto vertShaderCode{ readFile(settings.compactVertices ? "shaders/vert_compact.spv" : "shaders/vert.spv") };
 		auto fragShaderCode{ readFile("shaders/frag.spv") };
 
 		/*
@@ -1677,6 +6557,11 @@ private:
 		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
 		vertShaderStageInfo.module = vertShaderModule;
 		vertShaderStageInfo.pName = "main"; // entrypoint func
+		// PUSH_TRANSFORMS of the vertex shaders, see enablePushConstantTransforms
+		VkBool32 pushTransforms{ settings.pushTransforms ? VK_TRUE : VK_FALSE };
+		VkSpecializationMapEntry pushTransformsEntry{ 0, 0, sizeof(VkBool32) };
+		VkSpecializationInfo vertSpecializationInfo{ 1, &pushTransformsEntry, sizeof(pushTransforms), &pushTransforms };
+		vertShaderStageInfo.pSpecializationInfo = &vertSpecializationInfo;
 
 		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
 		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -1688,12 +6573,23 @@ private:
 
 		auto bindingDescription = Vertex::getBindingDescription();
 		auto attributeDescription = Vertex::getAttributeDescription();
+		auto packedBindingDescription = PackedVertex::getBindingDescription();
+		auto packedAttributeDescription = PackedVertex::getAttributeDescription(quantizedMesh.texCoordFormat);
 		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
 		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-		vertexInputInfo.vertexAttributeDescriptionCount = attributeDescription.size();
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
+		if (settings.compactVertices)
+		{
+			vertexInputInfo.pVertexBindingDescriptions = &packedBindingDescription;
+			vertexInputInfo.vertexAttributeDescriptionCount = packedAttributeDescription.size();
+			vertexInputInfo.pVertexAttributeDescriptions = packedAttributeDescription.data();
+		}
+		else
+		{
+			vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+			vertexInputInfo.vertexAttributeDescriptionCount = attributeDescription.size();
+			vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
+		}
 
 		/*
 		The VkPipelineInputAssemblyStateCreateInfo struct describes two things:
@@ -1881,9 +6777,14 @@ private:
 		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutInfo.setLayoutCount = 1;
 		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-		// The structure also specifies push constants, which are another way of passing dynamic values to shaders
-		pipelineLayoutInfo.pushConstantRangeCount = 0;
-		pipelineLayoutInfo.pPushConstantRanges = nullptr;
+		/*
+		The structure also specifies push constants, which are another way of passing dynamic
+		values to shaders. The vertex shaders declare the per-draw transform there whether
+		they read it or not, see enablePushConstantTransforms.
+		*/
+		VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants) };
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
 
 		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
 		{
@@ -1973,8 +6874,72 @@ private:
 			throw std::runtime_error("failed to create graphics pipeline!");
 		}
 
+		/*
+		The mesh shader pipeline shares all fixed-function state and the fragment shader,
+		but has no vertex input or input assembly state. Specialization constants tell
+		shader.mesh which vertex layout it reads from the vertex buffer.
+		*/
+		if (meshShadingSupported)
+		{
+			auto meshShaderCode{ readFile("shaders/mesh.spv") };
+			VkShaderModule meshShaderModule{ createShaderModule(meshShaderCode) };
+			std::array<uint32_t, 5> specializationData{
+				settings.compactVertices,
+				settings.compactVertices && quantizedMesh.texCoordFormat == VK_FORMAT_R16G16_SFLOAT,
+				sizeof(Vertex) / sizeof(uint32_t),
+				offsetof(Vertex, color) / sizeof(uint32_t),
+				offsetof(Vertex, texCoord) / sizeof(uint32_t)
+			};
+			std::array<VkSpecializationMapEntry, 5> specializationEntries{};
+			for (uint32_t i = 0; i < specializationEntries.size(); i++)
+			{
+				specializationEntries[i] = { i, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t) };
+			}
+			VkSpecializationInfo specializationInfo{};
+			specializationInfo.mapEntryCount = specializationEntries.size();
+			specializationInfo.pMapEntries = specializationEntries.data();
+			specializationInfo.dataSize = sizeof(specializationData);
+			specializationInfo.pData = specializationData.data();
+			VkPipelineShaderStageCreateInfo meshShaderStageInfo{};
+			meshShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			meshShaderStageInfo.stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+			meshShaderStageInfo.module = meshShaderModule;
+			meshShaderStageInfo.pName = "main";
+			meshShaderStageInfo.pSpecializationInfo = &specializationInfo;
+			VkPipelineShaderStageCreateInfo meshShaderStages[] = { meshShaderStageInfo, fragShaderStageInfo };
+			pipelineInfo.pStages = meshShaderStages;
+			pipelineInfo.pVertexInputState = nullptr;
+			pipelineInfo.pInputAssemblyState = nullptr;
+			if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &meshPipeline) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create mesh shader pipeline!");
+			}
+			vkDestroyShaderModule(device, meshShaderModule, nullptr);
+		}
+
 		vkDestroyShaderModule(device, vertShaderModule, nullptr);
 		vkDestroyShaderModule(device, fragShaderModule, nullptr);
+		// a recorded command buffer binds the pipelines it was recorded with
+		commandBufferGeneration++;
+	}
+
+	/*
+	The shader binaries in shaders/ are built from the sources next to them by the
+	project's custom build step or compile.bat. A missing shader_compact.vert binary
+	turns --compact-vertices off, a missing shader.mesh binary --mesh-shading.
+	*/
+	void checkShaderModules()
+	{
+		if (settings.compactVertices && !std::filesystem::exists("shaders/vert_compact.spv"))
+		{
+			settings.compactVertices = false;
+			std::cout << "shaders/vert_compact.spv not found, compile it with compile.bat to use the compact vertex layout" << std::endl;
+		}
+		if (settings.meshShading && !std::filesystem::exists("shaders/mesh.spv"))
+		{
+			settings.meshShading = false;
+			std::cout << "shaders/mesh.spv not found, compile it with compile.bat to draw the meshlets with the mesh shader" << std::endl;
+		}
 	}
 
 	VkShaderModule createShaderModule(const std::vector<char>& code)
@@ -2014,110 +6979,667 @@ private:
 			framebufferInfo.height = swapChainExtent.height;
 			framebufferInfo.layers = 1;
 
-			if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
+			if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create framebuffer!");
+			}
+		}
+	}
+
+	void createCommandPool()
+	{
+		QueueFamilyIndices queueFamilyIndices{ findQueueFamilies(physicalDevice) };
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		/*
+		There are two possible flags for command pools:
+		• VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers
+		are rerecorded with new commands very often (may change memory allocation
+		behavior)
+		• VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command
+		buffers to be rerecorded individually, without this flag they all have
+		to be reset together
+		We will be recording a command buffer every frame, so we want to be able to reset
+		and rerecord over it. Thus, we need to set the VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+		flag bit for our command pool.
+		Command buffers are executed
+		*/
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		// We’re going to record commands for drawing, which is why we’ve chosen the graphics queue family.
+		poolInfo.queueFamilyIndex = queueFamilyIndices.grahicsFamily.value();
+
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command pool!");
+		}
+	}
+
+	/*
+	The render pass takes both attachments from VK_IMAGE_LAYOUT_UNDEFINED, so they need
+	no layout transition up front. A transient attachment may not even have memory
+	behind it outside the render pass.
+	*/
+	void createDepthResources()
+	{
+		VkFormat depthFormat{ findDepthFormat() };
+		createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, depthFormat,
+			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | transientAttachmentUsage(),
+			attachmentMemoryProperties(), depthImage, depthImageMemory);
+		depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+	}
+
+	void createColorResources()
+	{
+		VkFormat colorFormat{ swapChainImageFormat };
+		createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat,
+			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | transientAttachmentUsage(),
+			attachmentMemoryProperties(), colorImage, colorImageMemory);
+		colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	}
+
+	VkImageUsageFlags transientAttachmentUsage() const
+	{
+		return settings.transientAttachments ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0;
+	}
+
+	/*
+	Lazily allocated memory for the transient attachments when the device has such a
+	memory type, usually only tile based GPUs do. It can only back transient attachments.
+	*/
+	VkMemoryPropertyFlags attachmentMemoryProperties()
+	{
+		if (settings.transientAttachments)
+		{
+			VkMemoryPropertyFlags lazy{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT };
+			VkPhysicalDeviceMemoryProperties memProperties;
+			vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+			for (uint32_t i{ 0 }; i < memProperties.memoryTypeCount; i++)
+			{
+				if ((memProperties.memoryTypes[i].propertyFlags & lazy) == lazy)
+				{
+					return lazy;
+				}
+			}
+		}
+		return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	}
+
+	// D16 first when asked for, every device supports it as a depth attachment
+	VkFormat findDepthFormat()
+	{
+		std::vector<VkFormat> candidates{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT };
+		if (settings.d16Depth)
+		{
+			candidates.insert(candidates.begin(), VK_FORMAT_D16_UNORM);
+		}
+		return findSupportedFormat(
+			candidates,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+		);
+	}
+
+	bool hasStencilComponent(VkFormat format)
+	{
+		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+	}
+
+	VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+	{
+		for (VkFormat format : candidates)
+		{
+			VkFormatProperties props;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+			/*
+			The VkFormatProperties struct contains three fields:
+			• linearTilingFeatures: Use cases that are supported with linear tiling
+			• optimalTilingFeatures: Use cases that are supported with optimal
+			tiling
+			• bufferFeatures: Use cases that are supported for buffers
+			Only the first two are relevant here, and the one we check depends on the tiling
+			parameter of the function:
+			*/
+			if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
+			{
+				return format;
+			}
+			else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
+			{
+				return format;
+			}
+		}
+		throw std::runtime_error("failed to find supported format!");
+	}
+
+	/*
+	The first format of TEXTURE_FORMAT_CANDIDATES the device can sample and filter from,
+	found the same way as the depth format. Block-compressed formats also need the
+	textureCompressionBC feature. Every device supports RGBA8, so it ends the list.
+	*/
+	VkFormat chooseTextureFormat()
+	{
+		std::vector<VkFormat> candidates;
+		for (VkFormat format : TEXTURE_FORMAT_CANDIDATES)
+		{
+			if (textureFormatInfo(format).blockWidth == 1 || textureCompressionBCEnabled)
+			{
+				candidates.push_back(format);
+			}
+		}
+		candidates.push_back(VK_FORMAT_R8G8B8A8_SRGB);
+		return findSupportedFormat(candidates, VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+	}
+
+	void createTextureImage()
+	{
+		bool useKtx2{ enableKtx2Textures };
+		VkFormat bakedFormat{ useKtx2 ? chooseTextureFormat() : VK_FORMAT_R8G8B8A8_SRGB };
+		std::string ktx2Path{ textureKtx2Path(bakedFormat) };
+		if (useKtx2)
+		{
+			std::error_code ec;
+			auto sourceTime{ std::filesystem::last_write_time(TEXTURE_PATH, ec) };
+			bool sourceExists{ !ec };
+			auto bakedTime{ std::filesystem::last_write_time(ktx2Path, ec) };
+			if ((ec || (sourceExists && bakedTime < sourceTime)) && !bakeKtx2(TEXTURE_PATH, ktx2Path, bakedFormat))
+			{
+				useKtx2 = false;
+			}
+		}
+		if (settings.compareTextureLoading)
+		{
+			// the loads are timed up to their completion, which an open batch would defer
+			bool batched{ uploadBatchOpen() };
+			if (batched)
+			{
+				submitUploadBatch();
+			}
+			compareTextureLoading(ktx2Path);
+			if (batched)
+			{
+				beginUploadBatch();
+			}
+		}
+
+		auto start{ std::chrono::high_resolution_clock::now() };
+		uint32_t residentLevel{ 0 };
+		if (useKtx2 && settings.textureStreaming && streamingFile.open(ktx2Path))
+		{
+			while (residentLevel + 1 < streamingFile.levels.size() &&
+				std::max(streamingFile.width, streamingFile.height) >> residentLevel > TEXTURE_STREAMING_RESIDENT_SIZE)
+			{
+				residentLevel++;
+			}
+		}
+		if (!useKtx2 || !createTextureImageFromKtx2(ktx2Path, textureImage, textureImageMemory, mipLevels, textureFormat, residentLevel))
+		{
+			createTextureImageFromSource(TEXTURE_PATH, textureImage, textureImageMemory, mipLevels, chooseMipmapGenerator());
+			textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+			useKtx2 = false;
+			streamingFile.close();
+		}
+		auto end{ std::chrono::high_resolution_clock::now() };
+		// the texture went up in the latest upload, or synchronously when there is none
+		textureUpload = uploadTimelineValue;
+
+		VkExtent3D extent{ textureExtent };
+		uint64_t size{ 0 };
+		uint64_t rgba8Size{ 0 };
+		for (uint32_t i = 0; i < mipLevels; i++)
+		{
+			size += textureLevelSize(textureFormat, std::max(extent.width >> i, 1u), std::max(extent.height >> i, 1u));
+			rgba8Size += textureLevelSize(VK_FORMAT_R8G8B8A8_SRGB, std::max(extent.width >> i, 1u), std::max(extent.height >> i, 1u));
+		}
+		std::cout << "createTextureImage: " << (useKtx2 ? ktx2Path : TEXTURE_PATH) << ", " << textureFormatName(textureFormat)
+			<< ", " << mipLevels << " levels, " << size / 1024.0 << " KiB (" << 100.0 * size / rgba8Size << "% of RGBA8) in "
+			<< std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+		if (useKtx2 && residentLevel > 0)
+		{
+			startTextureStreaming(residentLevel);
+		}
+	}
+
+	/*
+	Levels residentLevel and up are already in textureImage. Creates one staging buffer
+	for the rest and starts the thread that fills it.
+	*/
+	void startTextureStreaming(uint32_t residentLevel)
+	{
+		streamingLevelOffsets.resize(residentLevel);
+		VkDeviceSize stagingSize{ 0 };
+		for (uint32_t i = residentLevel; i-- > 0;)
+		{
+			stagingSize = (stagingSize + 15) & ~VkDeviceSize{ 15 };
+			streamingLevelOffsets[i] = stagingSize;
+			stagingSize += streamingFile.levels[i].size();
+		}
+		/*
+		Not from the ring: the region would be held until the frame that copies the last
+		level finishes, and the uploads after this one that wrap around to it would run
+		into a region that isn't released yet.
+		*/
+		streamingStaging = acquireTemporaryStaging(stagingSize);
+		streamingStagedLevel = residentLevel;
+		streamingUploadedLevel = residentLevel;
+		std::cout << "texture streaming: levels " << residentLevel << ".." << mipLevels - 1 << " resident, "
+			<< stagingSize / 1024.0 << " KiB to stream" << std::endl;
+
+		// the host writes are made visible to the device by the vkQueueSubmit of the frame that copies them
+		streamingThread = std::thread{ [this]()
+			{
+				for (uint32_t level{ streamingStagedLevel }; level-- > 0 && !streamingCanceled;)
+				{
+					std::span<const uint8_t> source{ streamingFile.levels[level] };
+					memcpy(streamingStaging.mapped + streamingLevelOffsets[level], source.data(), source.size());
+					streamingStagedLevel = level;
+				}
+			} };
+	}
+
+	/*
+	Called at the start of every command buffer: copies the levels the loader finished
+	since the last frame into the image and points this frame's descriptor set at the
+	sampler clamped to the new top level. The levels below the clamp are never sampled,
+	so the copy needs no synchronization with frames still in flight. Returns whether
+	it recorded a copy or rewrote the descriptor set, either makes the command buffer
+	one that must not be reused.
+	*/
+	bool recordTextureStreaming(VkCommandBuffer commandBuffer)
+	{
+		if (!streamingThread.joinable())
+		{
+			return false;
+		}
+		bool recorded{ false };
+		uint32_t stagedLevel{ streamingStagedLevel };
+		if (stagedLevel < streamingUploadedLevel)
+		{
+			recorded = true;
+			std::vector<VkBufferImageCopy> regions;
+			for (uint32_t i = stagedLevel; i < streamingUploadedLevel; i++)
+			{
+				VkBufferImageCopy region{};
+				region.bufferOffset = streamingStaging.offset + streamingLevelOffsets[i];
+				region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+				region.imageExtent = { std::max(textureExtent.width >> i, 1u), std::max(textureExtent.height >> i, 1u), 1 };
+				regions.push_back(region);
+			}
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = textureImage;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, stagedLevel, streamingUploadedLevel - stagedLevel, 0, 1 };
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			// from the transfer stage to chain after the acquire recordUploadAcquires may have put before it
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+			vkCmdCopyBufferToImage(commandBuffer, streamingStaging.buffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<uint32_t>(regions.size()), regions.data());
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+				0, nullptr, 0, nullptr, 1, &barrier);
+			streamingUploadedLevel = stagedLevel;
+			if (streamingUploadedLevel == 0)
+			{
+				// this frame's submission is the last one reading the staged levels
+				releaseStagingAfterFrame(streamingStaging);
+			}
+		}
+		if (descriptorSetTextureLevel[currentFrame] != streamingUploadedLevel)
+		{
+			writeTextureDescriptor(currentFrame, streamingUploadedLevel);
+			recorded = true;
+		}
+		return recorded;
+	}
+
+	// whether recordTextureStreaming has something to record this frame
+	bool textureStreamingPending()
+	{
+		return streamingThread.joinable() && (streamingStagedLevel < streamingUploadedLevel ||
+			descriptorSetTextureLevel[currentFrame] != streamingUploadedLevel);
+	}
+
+	/*
+	Once every level is in the image and every frame's descriptor set samples all of
+	them, the loader thread and the file are no longer needed. The staged levels went
+	back to the ring with the fence of the frame that copied the last one.
+	*/
+	void finishTextureStreaming()
+	{
+		if (!streamingThread.joinable() || streamingUploadedLevel > 0 ||
+			std::any_of(descriptorSetTextureLevel.begin(), descriptorSetTextureLevel.end(), [](uint32_t level) { return level > 0; }))
+		{
+			return;
+		}
+		streamingThread.join();
+		streamingFile.close();
+		streamingStaging = {};
+	}
+
+	void writeTextureDescriptor(uint32_t frame, uint32_t minLevel)
+	{
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = textureImageView;
+		imageInfo.sampler = minLevel == 0 ? textureSampler : textureLodSamplers[minLevel];
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSets[frame];
+		descriptorWrite.dstBinding = 1;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &imageInfo;
+		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+		descriptorSetTextureLevel[frame] = minLevel;
+		// the recorded command buffers bind the set as it was
+		commandBufferGeneration++;
+	}
+
+	/*
+	Loads the texture both ways a few times into throwaway images, so the two paths
+	can be compared without a restart. Each run includes the file read, the upload and
+	waiting for the queue to finish.
+	*/
+	void compareTextureLoading(const std::string& ktx2Path)
+	{
+		constexpr int runs{ 5 };
+		auto measure{ [&](auto&& load)
+			{
+				double best{ std::numeric_limits<double>::max() };
+				double total{ 0.0 };
+				for (int i = 0; i < runs; i++)
+				{
+					VkImage image{ VK_NULL_HANDLE };
+					MemoryAllocation memory{};
+					uint32_t levels{ 0 };
+					auto start{ std::chrono::high_resolution_clock::now() };
+					bool loaded{ load(image, memory, levels) };
+					// async uploads return before the copy ran, the time includes it like the synchronous path
+					waitForUpload(uploadTimelineValue);
+					double ms{ std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() };
+					if (image != VK_NULL_HANDLE)
+					{
+						std::erase_if(pendingImageAcquires, [image](const VkImageMemoryBarrier& barrier) { return barrier.image == image; });
+						vkDestroyImage(device, image, nullptr);
+						memoryAllocator.free(memory);
+					}
+					if (!loaded)
+					{
+						return -1.0;
+					}
+					best = std::min(best, ms);
+					total += ms;
+				}
+				std::cout << "best " << best << " ms, mean " << total / runs << " ms" << std::endl;
+				return best;
+			} };
+
+		std::cout << "texture loading, best of " << runs << " runs:" << std::endl;
+		/*
+		The mip generation alone is timed too, decoding the PNG dominates the total. Both
+		generators end in one vkQueueWaitIdle, so this includes the submit but no upload.
+		*/
+		double bestMipmap{ std::numeric_limits<double>::max() };
+		auto measureSource{ [&](MipmapGenerator generator)
 			{
-				throw std::runtime_error("failed to create framebuffer!");
-			}
+				bestMipmap = std::numeric_limits<double>::max();
+				double total{ measure([&](VkImage& image, MemoryAllocation& memory, uint32_t& levels)
+					{
+						createTextureImageFromSource(TEXTURE_PATH, image, memory, levels, generator);
+						bestMipmap = std::min(bestMipmap, mipmapMilliseconds);
+						return true;
+					}) };
+				std::cout << "    mip chain alone: best " << bestMipmap << " ms" << std::endl;
+				return total;
+			} };
+		double source{ -1.0 };
+		double blitMipmap{ -1.0 };
+		if (linearBlitSupported())
+		{
+			std::cout << "  " << TEXTURE_PATH << " decode + blit mip chain: ";
+			source = measureSource(MipmapGenerator::Blit);
+			blitMipmap = bestMipmap;
+		}
+		auto printSpeedup{ [&]()
+			{
+				if (blitMipmap > 0.0)
+				{
+					std::cout << "    speedup over blit " << blitMipmap / bestMipmap << "x" << std::endl;
+				}
+			} };
+		if (mipmapPipeline != VK_NULL_HANDLE)
+		{
+			std::cout << "  " << TEXTURE_PATH << " decode + compute mip chain: ";
+			measureSource(MipmapGenerator::Compute);
+			printSpeedup();
+		}
+		std::cout << "  " << TEXTURE_PATH << " decode + CPU mip chain: ";
+		double cpuSource{ measureSource(MipmapGenerator::Cpu) };
+		printSpeedup();
+		if (source < 0.0)
+		{
+			source = cpuSource;
 		}
-	}
 
-	void createCommandPool()
-	{
-		QueueFamilyIndices queueFamilyIndices{ findQueueFamilies(physicalDevice) };
-		VkCommandPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		/*
-		There are two possible flags for command pools:
-		• VK_COMMAND_POOL_CREATE_TRANSIENT_BIT: Hint that command buffers
-		are rerecorded with new commands very often (may change memory allocation
-		behavior)
-		• VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT: Allow command
-		buffers to be rerecorded individually, without this flag they all have
-		to be reset together
-		We will be recording a command buffer every frame, so we want to be able to reset
-		and rerecord over it. Thus, we need to set the VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
-		flag bit for our command pool.
-		Command buffers are executed
+		Decoding straight into the staging buffer against stbi_load and a copy, on
+		settings.decodeTexturePath (pass a large image after --compare-texture-load). The
+		peak is what stb_image held on the heap at once; the staging buffer is the same
+		size both ways, so the difference is the peak memory saved.
 		*/
-		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		// We’re going to record commands for drawing, which is why we’ve chosen the graphics queue family.
-		poolInfo.queueFamilyIndex = queueFamilyIndices.grahicsFamily.value();
+		bool directTextureDecode{ settings.directTextureDecode };
+		MipmapGenerator generator{ chooseMipmapGenerator() };
+		double decodeTimes[2]{};
+		size_t decodePeaks[2]{};
+		for (bool direct : { false, true })
+		{
+			settings.directTextureDecode = direct;
+			size_t heapBase{ stbHeapBytes.load() };
+			stbHeapPeakBytes = heapBase;
+			std::cout << "  " << settings.decodeTexturePath << (direct ? " decoded into staging: " : " decoded, then copied: ");
+			decodeTimes[direct] = measure([&](VkImage& image, MemoryAllocation& memory, uint32_t& levels)
+				{
+					createTextureImageFromSource(settings.decodeTexturePath, image, memory, levels, generator);
+					return true;
+				});
+			decodePeaks[direct] = stbHeapPeakBytes - heapBase;
+			std::cout << "    peak decoder heap " << decodePeaks[direct] / (1024.0 * 1024.0) << " MiB" << std::endl;
+		}
+		settings.directTextureDecode = directTextureDecode;
+		std::cout << "    decoding into staging saves " << decodeTimes[0] - decodeTimes[1] << " ms and "
+			<< (static_cast<double>(decodePeaks[0]) - decodePeaks[1]) / (1024.0 * 1024.0) << " MiB peak" << std::endl;
 
-		if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+		std::cout << "  " << ktx2Path << " single copy: ";
+		double ktx2{ measure([&](VkImage& image, MemoryAllocation& memory, uint32_t& levels)
+			{
+				VkFormat format;
+				return createTextureImageFromKtx2(ktx2Path, image, memory, levels, format);
+			}) };
+		if (ktx2 < 0.0)
 		{
-			throw std::runtime_error("failed to create command pool!");
+			std::cout << "failed to load " << ktx2Path << std::endl;
+		}
+		else
+		{
+			std::cout << "  speedup " << source / ktx2 << "x" << std::endl;
 		}
 	}
 
-	void createDepthResources()
+	/*
+	Uploads a baked KTX2 file. Every level is staged at its own offset in one buffer
+	and copied with a single vkCmdCopyBufferToImage that has one region per level, so
+	there is no blit chain and no per-level barriers. Levels below firstLevel are left
+	undefined for texture streaming to fill in later. Returns false if the file is
+	missing or not one the loader understands.
+	*/
+	bool createTextureImageFromKtx2(const std::string& path, VkImage& image, MemoryAllocation& imageMemory,
+		uint32_t& levels, VkFormat& format, uint32_t firstLevel = 0)
 	{
-		VkFormat depthFormat{ findDepthFormat() };
-		createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, depthFormat,
-			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			depthImage, depthImageMemory);
-		depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+		Ktx2File file;
+		if (!file.open(path))
+		{
+			return false;
+		}
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, file.format, &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) ||
+			(textureFormatInfo(file.format).blockWidth > 1 && !textureCompressionBCEnabled))
+		{
+			return false;
+		}
 
-		transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+		levels = static_cast<uint32_t>(file.levels.size());
+		format = file.format;
+		textureExtent = { file.width, file.height, 1 };
+		createTextureImageFromLevels(file.levels, format, file.width, file.height, firstLevel, image, imageMemory);
+		return true;
 	}
 
-	void createColorResources()
+	/*
+	Creates a sampled image with one level per entry of levelData. Levels firstLevel and
+	up are staged at their own offsets in one buffer and copied with a single
+	vkCmdCopyBufferToImage that has one region per level, the ones below are left
+	undefined. Used by the KTX2 loader and the CPU mip chain.
+	*/
+	void createTextureImageFromLevels(std::span<const std::span<const uint8_t>> levelData, VkFormat format,
+		uint32_t width, uint32_t height, uint32_t firstLevel, VkImage& image, MemoryAllocation& imageMemory)
 	{
-		VkFormat colorFormat{ swapChainImageFormat };
-		createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat,
-			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			colorImage, colorImageMemory);
-		colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-
-		transitionImageLayout(colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
-	}
+		VkDeviceSize stagingSize;
+		std::vector<VkBufferImageCopy> regions{ textureLevelRegions(format, width, height,
+			static_cast<uint32_t>(levelData.size()), firstLevel, stagingSize) };
 
-	VkFormat findDepthFormat()
-	{
-		return findSupportedFormat(
-			{ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT },
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-		);
+		StagingRegion staging{ acquireStaging(stagingSize) };
+		for (uint32_t i = firstLevel; i < levelData.size(); i++)
+		{
+			memcpy(staging.mapped + regions[i - firstLevel].bufferOffset, levelData[i].data(), levelData[i].size());
+		}
+		copyStagedLevelsToImage(staging, regions, format, width, height, static_cast<uint32_t>(levelData.size()),
+			image, imageMemory);
 	}
 
-	bool hasStencilComponent(VkFormat format)
+	/*
+	Where levels firstLevel and up of a levels deep image go in a staging buffer, one
+	copy region each, and the size of the buffer they need.
+	*/
+	std::vector<VkBufferImageCopy> textureLevelRegions(VkFormat format, uint32_t width, uint32_t height, uint32_t levels,
+		uint32_t firstLevel, VkDeviceSize& stagingSize)
 	{
-		return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
+		std::vector<VkBufferImageCopy> regions(levels - firstLevel);
+		stagingSize = 0;
+		for (uint32_t i = firstLevel; i < levels; i++)
+		{
+			VkBufferImageCopy& region{ regions[i - firstLevel] };
+			uint32_t levelWidth{ std::max(width >> i, 1u) };
+			uint32_t levelHeight{ std::max(height >> i, 1u) };
+			// 16 bytes satisfies the texel block size alignment of every supported format
+			stagingSize = (stagingSize + 15) & ~VkDeviceSize{ 15 };
+			region.bufferOffset = stagingSize;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = i;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = { levelWidth, levelHeight, 1 };
+			stagingSize += textureLevelSize(format, levelWidth, levelHeight);
+		}
+		return regions;
 	}
 
-	VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
+	/*
+	Creates the sampled image, fills it from the staged levels with one copy and hands
+	staging back. The region offsets are relative to the start of staging. With async
+	uploads the copy goes to the upload queue like uploadBuffer's and the token of the
+	upload is returned. Every region is a whole mip level, so the copy meets the image
+	transfer granularity of any transfer queue.
+	*/
+	UploadToken copyStagedLevelsToImage(StagingRegion& staging, std::vector<VkBufferImageCopy> regions, VkFormat format,
+		uint32_t width, uint32_t height, uint32_t levels, VkImage& image, MemoryAllocation& imageMemory)
 	{
-		for (VkFormat format : candidates)
+		for (VkBufferImageCopy& region : regions)
 		{
-			VkFormatProperties props;
-			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
-			/*
-			The VkFormatProperties struct contains three fields:
-			• linearTilingFeatures: Use cases that are supported with linear tiling
-			• optimalTilingFeatures: Use cases that are supported with optimal
-			tiling
-			• bufferFeatures: Use cases that are supported for buffers
-			Only the first two are relevant here, and the one we check depends on the tiling
-			parameter of the function:
-			*/
-			if (tiling == VK_IMAGE_TILING_LINEAR && (props.linearTilingFeatures & features) == features)
-			{
-				return format;
-			}
-			else if (tiling == VK_IMAGE_TILING_OPTIMAL && (props.optimalTilingFeatures & features) == features)
+			region.bufferOffset += staging.offset;
+		}
+		createImage(width, height, levels, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			image, imageMemory);
+
+		bool transferOwnership{ asyncUploadsSupported && uploadQueueFamily != graphicsQueueFamily };
+		VkImageMemoryBarrier barrier{};
+		auto record{ [&](VkCommandBuffer commandBuffer)
 			{
-				return format;
-			}
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.image = image;
+				barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 };
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+					0, nullptr, 0, nullptr, 1, &barrier);
+
+				vkCmdCopyBufferToImage(commandBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					static_cast<uint32_t>(regions.size()), regions.data());
+
+				/*
+				On a transfer family this is the release half of an ownership transfer and
+				the layout transition happens with it. The transfer queue can't name the
+				fragment shader stage, the acquire on the graphics queue makes the levels
+				visible to it.
+				*/
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = transferOwnership ? 0 : VK_ACCESS_SHADER_READ_BIT;
+				if (transferOwnership)
+				{
+					barrier.srcQueueFamilyIndex = uploadQueueFamily;
+					barrier.dstQueueFamilyIndex = graphicsQueueFamily;
+				}
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, transferOwnership ?
+					VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+					0, nullptr, 0, nullptr, 1, &barrier);
+			} };
+		if (!asyncUploadsSupported)
+		{
+			VkCommandBuffer commandBuffer{ beginSingleTimeCommands() };
+			record(commandBuffer);
+			endSingleTimeCommands(commandBuffer);
+			releaseStaging(staging, VK_NULL_HANDLE);
+			return 0;
 		}
-		throw std::runtime_error("failed to find supported format!");
+		UploadToken upload{ submitUpload(staging, record) };
+		if (transferOwnership)
+		{
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+			pendingImageAcquires.push_back(barrier);
+			pendingAcquireUpload = upload;
+			uploadStats.ownershipTransfers++;
+		}
+		return upload;
 	}
 
-	void createTextureImage()
+	void createTextureImageFromSource(const std::string& path, VkImage& image, MemoryAllocation& imageMemory, uint32_t& levels,
+		MipmapGenerator generator)
 	{
 		int texWidth;
 		int texHeight;
 		int texChannels;
-		stbi_uc* pixels{ stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha)};
+		// only reads the header, the pixels are decoded once the staging buffer exists
+		if (!stbi_info(path.c_str(), &texWidth, &texHeight, &texChannels))
+		{
+			throw std::runtime_error("failed to load texture image!");
+		}
+		textureExtent = { static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1 };
 		/*
 		This calculates the number of levels in the mip chain. The max function selects
 		the largest dimension. The log2 function calculates how many times that
@@ -2125,29 +7647,72 @@ private:
 		largest dimension is not a power of 2. 1 is added so that the original image has
 		a mip level.
 		*/
-		mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+		levels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+		if (generator == MipmapGenerator::Compute && levels > COMPUTE_MIPMAP_MAX_LEVELS)
+		{
+			generator = linearBlitSupported() ? MipmapGenerator::Blit : MipmapGenerator::Cpu;
+		}
+		bool computeMips{ generator == MipmapGenerator::Compute };
 		/*
-		The pointer that is
-		returned is the first element in an array of pixel values. The pixels are laid out
-		row by row with 4 bytes per pixel in the case of STBI_rgb_alpha for a total of
-		texWidth * texHeight * 4 values.
+		The pixels are laid out row by row with 4 bytes per pixel in the case of
+		STBI_rgb_alpha for a total of texWidth * texHeight * 4 values. The CPU generator
+		stages the whole chain, level 0 first.
 		*/
 		VkDeviceSize imageSize{ texWidth * texHeight * static_cast <VkDeviceSize>(4) };
-		if (!pixels)
+		VkDeviceSize stagingSize{ imageSize };
+		std::vector<VkBufferImageCopy> regions;
+		if (generator == MipmapGenerator::Cpu)
+		{
+			regions = textureLevelRegions(VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, levels, 0, stagingSize);
+		}
+
+		/*
+		The staging buffer is mapped before decoding and the decoder writes straight into
+		it, instead of into a heap buffer that is then copied over. That saves the extra
+		pass over the pixels and a second image-sized allocation. PNG decoding reads the
+		rows it already wrote, which is why the staging ring prefers cached memory.
+		*/
+		StagingRegion staging{ acquireStaging(stagingSize) };
+		uint8_t* staged{ staging.mapped };
+		bool decoded{ false };
+		if (settings.directTextureDecode)
+		{
+			decoded = decodeRgba8Into(path, staged, texWidth, texHeight);
+		}
+		else
+		{
+			stbi_uc* pixels{ stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha) };
+			decoded = pixels && static_cast<VkDeviceSize>(texWidth) * texHeight * 4 == imageSize;
+			if (decoded)
+			{
+				memcpy(staged, pixels, imageSize);
+			}
+			stbi_image_free(pixels);
+		}
+		if (!decoded)
 		{
+			releaseStaging(staging, VK_NULL_HANDLE);
 			throw std::runtime_error("failed to load texture image!");
 		}
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			stagingBuffer, stagingBufferMemory);
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, imageSize);
-		vkUnmapMemory(device, stagingBufferMemory);
-		stbi_image_free(pixels);
+		/*
+		The CPU generator builds every level in place from the one before it, so the whole
+		chain goes up in one multi-region copy like a KTX2 file, with no blits or dispatches.
+		*/
+		if (generator == MipmapGenerator::Cpu)
+		{
+			auto mipmapStart{ std::chrono::high_resolution_clock::now() };
+			for (uint32_t i = 1; i < levels; i++)
+			{
+				uint32_t sourceWidth{ std::max(static_cast<uint32_t>(texWidth) >> (i - 1), 1u) };
+				uint32_t sourceHeight{ std::max(static_cast<uint32_t>(texHeight) >> (i - 1), 1u) };
+				std::span<const uint8_t> source{ staged + regions[i - 1].bufferOffset, static_cast<size_t>(sourceWidth) * sourceHeight * 4 };
+				downsampleRgba8SrgbInto(source, sourceWidth, sourceHeight, staged + regions[i].bufferOffset);
+			}
+			mipmapMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mipmapStart).count();
+			copyStagedLevelsToImage(staging, regions, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, levels, image, imageMemory);
+			return;
+		}
 
 		/*
 		Our texture image now has multiple mip levels, but the staging buffer can only
@@ -2160,10 +7725,22 @@ private:
 		that we intend to use the texture image as both the source and destination
 		of a transfer. Add VK_IMAGE_USAGE_TRANSFER_SRC_BIT to the texture image’s
 		usage flags in createTextureImage
+		The compute generator writes the levels through UNORM storage views instead, so
+		the image has to allow other formats and usages its own format doesn't support.
 		*/
-		createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
-			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT |VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-			VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+		if (computeMips)
+		{
+			createImage(texWidth, texHeight, levels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
+				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+				VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory,
+				VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT);
+		}
+		else
+		{
+			createImage(texWidth, texHeight, levels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB,
+				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+				VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, imageMemory);
+		}
 
 		/*
 		The next step is to copy the staging
@@ -2171,9 +7748,11 @@ private:
 		• Transition the texture image to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
 		• Execute the buffer to image copy operation
 		*/
-		transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-		copyBufferToImage(stagingBuffer, textureImage, texWidth, texHeight);
+		transitionImageLayout(image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levels);
+		copyBufferToImage(staging.buffer, image, texWidth, texHeight, staging.offset);
+		// the mip chain is generated from the image, the staged pixels are done with
+		releaseStaging(staging, VK_NULL_HANDLE);
 
 		//transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
 		/*
@@ -2182,9 +7761,16 @@ private:
 		transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
 		*/
-		generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		auto mipmapStart{ std::chrono::high_resolution_clock::now() };
+		if (computeMips)
+		{
+			generateMipmapsCompute(image, texWidth, texHeight, levels);
+		}
+		else
+		{
+			generateMipmaps(image, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, levels);
+		}
+		mipmapMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mipmapStart).count();
 	}
 
 	void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
@@ -2319,9 +7905,9 @@ private:
 		*/
 		barrier.subresourceRange.baseMipLevel = mipLevels - 1;
 		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_STENCIL_READ_ONLY_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
 		vkCmdPipelineBarrier(commandBuffer,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
@@ -2333,10 +7919,247 @@ private:
 		endSingleTimeCommands(commandBuffer);
 	}
 
+	/*
+	Creates the pipeline of generateMipmapsCompute. Binding 0 holds a storage view per
+	mip level, binding 1 the counter the workgroups use to find the last one to finish.
+	Without device support or shaders/mipmap.spv mipmapPipeline stays null and textures
+	keep using the blit chain.
+	*/
+	void createMipmapPipeline()
+	{
+		if (!computeMipmapsSupported)
+		{
+			return;
+		}
+		if (!std::filesystem::exists("shaders/mipmap.spv"))
+		{
+			std::cout << "shaders/mipmap.spv not found, compile it with compile.bat to generate mipmaps with compute" << std::endl;
+			return;
+		}
+
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[0].descriptorCount = COMPUTE_MIPMAP_MAX_LEVELS;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = bindings.size();
+		layoutInfo.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &mipmapDescriptorSetLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create mipmap descriptor set layout!");
+		}
+
+		VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MipmapPushConstants) };
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &mipmapDescriptorSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &mipmapPipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create mipmap pipeline layout!");
+		}
+
+		auto computeShaderCode{ readFile("shaders/mipmap.spv") };
+		VkShaderModule computeShaderModule{ createShaderModule(computeShaderCode) };
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = computeShaderModule;
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = mipmapPipelineLayout;
+		if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &mipmapPipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create mipmap pipeline!");
+		}
+		vkDestroyShaderModule(device, computeShaderModule, nullptr);
+
+		// one set at a time, generateMipmapsCompute resets the pool after every use
+		std::array<VkDescriptorPoolSize, 2> poolSizes{ {
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, COMPUTE_MIPMAP_MAX_LEVELS },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 }
+		} };
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = poolSizes.size();
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = 1;
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &mipmapDescriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create mipmap descriptor pool!");
+		}
+
+		createBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mipmapCounterBuffer, mipmapCounterBufferMemory);
+	}
+
+	/*
+	Memory properties for staging buffers the CPU also reads from, like the decode
+	target. Host-visible memory without HOST_CACHED is often write-combined, where every
+	read misses, so a cached type is taken when the device has one.
+	*/
+	VkMemoryPropertyFlags readableStagingProperties()
+	{
+		VkMemoryPropertyFlags cached{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+			VK_MEMORY_PROPERTY_HOST_CACHED_BIT };
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+		for (uint32_t i{ 0 }; i < memProperties.memoryTypeCount; i++)
+		{
+			if ((memProperties.memoryTypes[i].propertyFlags & cached) == cached)
+			{
+				return cached;
+			}
+		}
+		return VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	}
+
+	bool linearBlitSupported()
+	{
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_SRGB, &formatProperties);
+		return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+	}
+
+	/*
+	The generator from the settings if the device can run it. Compute falls back to the
+	blit chain without the pipeline, the blit chain to compute (or the CPU after that)
+	without linear filtering, and the CPU works everywhere.
+	*/
+	MipmapGenerator chooseMipmapGenerator()
+	{
+		MipmapGenerator generator{ settings.mipmapGenerator };
+		if (generator == MipmapGenerator::Compute && mipmapPipeline == VK_NULL_HANDLE)
+		{
+			generator = MipmapGenerator::Blit;
+		}
+		if (generator == MipmapGenerator::Blit && !linearBlitSupported())
+		{
+			generator = mipmapPipeline != VK_NULL_HANDLE ? MipmapGenerator::Compute : MipmapGenerator::Cpu;
+		}
+		return generator;
+	}
+
+	/*
+	Same contract as generateMipmaps: every level in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+	with level 0 filled, every level in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL after.
+	One dispatch of shaders/mipmap.comp writes all the other levels, so there is a single
+	barrier before and after it instead of two per level, and no linear filtering support
+	is needed. The image must come from createTextureImageFromSource with the compute generator.
+	*/
+	void generateMipmapsCompute(VkImage image, uint32_t texWidth, uint32_t texHeight, uint32_t mipLevels)
+	{
+		std::vector<VkImageView> levelViews(mipLevels);
+		for (uint32_t i = 0; i < mipLevels; i++)
+		{
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = image;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+			viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 };
+			if (vkCreateImageView(device, &viewInfo, nullptr, &levelViews[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create mip level view!");
+			}
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = mipmapDescriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &mipmapDescriptorSetLayout;
+		VkDescriptorSet descriptorSet;
+		if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to allocate mipmap descriptor set!");
+		}
+		// every array element needs a view, the ones past the last level repeat it and are never used
+		std::array<VkDescriptorImageInfo, COMPUTE_MIPMAP_MAX_LEVELS> imageInfos{};
+		for (uint32_t i = 0; i < COMPUTE_MIPMAP_MAX_LEVELS; i++)
+		{
+			imageInfos[i] = { VK_NULL_HANDLE, levelViews[std::min(i, mipLevels - 1)], VK_IMAGE_LAYOUT_GENERAL };
+		}
+		VkDescriptorBufferInfo counterInfo{ mipmapCounterBuffer, 0, sizeof(uint32_t) };
+		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[0].dstSet = descriptorSet;
+		descriptorWrites[0].dstBinding = 0;
+		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		descriptorWrites[0].descriptorCount = COMPUTE_MIPMAP_MAX_LEVELS;
+		descriptorWrites[0].pImageInfo = imageInfos.data();
+		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[1].dstSet = descriptorSet;
+		descriptorWrites[1].dstBinding = 1;
+		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[1].descriptorCount = 1;
+		descriptorWrites[1].pBufferInfo = &counterInfo;
+		vkUpdateDescriptorSets(device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+
+		VkCommandBuffer commandBuffer{ beginSingleTimeCommands() };
+		// level 0 was just copied, the other levels hold nothing worth keeping yet
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1 };
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdFillBuffer(commandBuffer, mipmapCounterBuffer, 0, sizeof(uint32_t), 0);
+		VkBufferMemoryBarrier counterBarrier{};
+		counterBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		counterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		counterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		counterBarrier.buffer = mipmapCounterBuffer;
+		counterBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr, 1, &counterBarrier, 1, &barrier);
+
+		// one workgroup per 64x64 texels of level 0, which is 16x16 texels of level 2
+		uint32_t groupsX{ (std::max(texWidth >> 2, 1u) + 15) / 16 };
+		uint32_t groupsY{ (std::max(texHeight >> 2, 1u) + 15) / 16 };
+		MipmapPushConstants constants{ texWidth, texHeight, mipLevels, groupsX * groupsY };
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mipmapPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mipmapPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, mipmapPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+		endSingleTimeCommands(commandBuffer);
+
+		// in an upload batch the dispatch hasn't run yet
+		whenUploadsComplete([this, levelViews]()
+			{
+				vkResetDescriptorPool(device, mipmapDescriptorPool, 0);
+				for (VkImageView view : levelViews)
+				{
+					vkDestroyImageView(device, view, nullptr);
+				}
+			});
+	}
+
 	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels,
 		VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling,
 		VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image,
-		VkDeviceMemory& imageMemory)
+		MemoryAllocation& imageMemory, VkImageCreateFlags flags = 0)
 	{
 		VkImageCreateInfo imageInfo{};
 		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -2411,27 +8234,19 @@ private:
 		in this tutorial, so leave it to its default value of 0.
 		*/
 		imageInfo.samples = numSamples;
-		imageInfo.flags = 0;
+		imageInfo.flags = flags;
 
 		if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create iamge!");
 		}
 
-		VkMemoryRequirements memRequirements;
-		vkGetImageMemoryRequirements(device, image, &memRequirements);
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to allocate image memory!");
-		}
-
-		vkBindImageMemory(device, image, imageMemory, 0);
+		MemoryRequest request{ memoryAllocator.imageRequest(image, tiling) };
+		request.memoryType = findMemoryType(request.requirements.memoryTypeBits, properties);
+		// lazily allocated memory is committed per allocation, sharing a block would commit all of it
+		request.requiresDedicated |= (properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+		imageMemory = memoryAllocator.allocate(request);
+		vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
 	}
 
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout,
@@ -2465,12 +8280,12 @@ private:
 		barrier.image = image;
 		/*
 		The image and subresourceRange specify the image that is affected and the
-		specific part of the image. Our image is not an array and does not have mipmapping
-		levels, so only one level and layer are specified.
+		specific part of the image. Our image is not an array, so only one layer is
+		specified, but every mip level is transitioned.
 		*/
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		barrier.subresourceRange.baseMipLevel = 0;
-		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.levelCount = mipLevels;
 		barrier.subresourceRange.baseArrayLayer = 0;
 		barrier.subresourceRange.layerCount = 1;
 		/*
@@ -2573,7 +8388,7 @@ private:
 		endSingleTimeCommands(commandBuffer);
 	}
 
-	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, VkDeviceSize bufferOffset = 0)
 	{
 		VkCommandBuffer commandBuffer{ beginSingleTimeCommands() };
 
@@ -2587,7 +8402,7 @@ private:
 		are in our case. The imageSubresource, imageOffset and imageExtent fields
 		indicate to which part of the image we want to copy the pixels.
 		*/
-		region.bufferOffset = 0;
+		region.bufferOffset = bufferOffset;
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -2615,7 +8430,9 @@ private:
 
 	void createTextureImageView()
 	{
-		textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+		// the compute mip generator adds storage usage, which the sRGB view can't have
+		textureImageView = createImageView(textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels,
+			computeMipmapsSupported ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
 	}
 
 	void createTextureSampler()
@@ -2694,9 +8511,51 @@ private:
 		{
 			throw std::runtime_error("failed to create texture sampler!");
 		}
+		// while the texture streams in, samplers that keep away from the levels still missing
+		textureLodSamplers.assign(streamingUploadedLevel + 1, VK_NULL_HANDLE);
+		for (uint32_t level = 1; level <= streamingUploadedLevel; level++)
+		{
+			samplerInfo.minLod = static_cast<float>(level);
+			if (vkCreateSampler(device, &samplerInfo, nullptr, &textureLodSamplers[level]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create texture sampler!");
+			}
+		}
 	}
 
 	void loadModel()
+	{
+		auto startTime{ std::chrono::high_resolution_clock::now() };
+		if (enableMeshCache && loadMeshCache())
+		{
+			auto cacheMicroseconds{ std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::high_resolution_clock::now() - startTime).count() };
+			const auto* header{ reinterpret_cast<const MeshCacheHeader*>(meshCacheFile.data) };
+			std::cout << "loadModel: mesh cache hit, mapped " << vertexData.size() << " vertices / "
+				<< indexData.size() << " indices in " << cacheMicroseconds / 1000.0 << " ms (OBJ parse + weld took "
+				<< header->sourceLoadMicroseconds / 1000.0 << " ms when the cache was built, "
+				<< static_cast<double>(header->sourceLoadMicroseconds) / std::max<int64_t>(cacheMicroseconds, 1)
+				<< "x faster)" << std::endl;
+			return;
+		}
+
+		parseModel();
+		optimizeModel();
+		vertexData = vertices;
+		indexData = indices;
+		indexCount = static_cast<uint32_t>(indices.size());
+
+		auto parseMicroseconds{ std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::high_resolution_clock::now() - startTime).count() };
+		std::cout << "loadModel: parsed, welded and optimized " << MODEL_PATH << " into " << vertices.size() << " vertices / "
+			<< indices.size() << " indices in " << parseMicroseconds / 1000.0 << " ms" << std::endl;
+		if (enableMeshCache)
+		{
+			writeMeshCache(parseMicroseconds);
+		}
+	}
+
+	void parseModel()
 	{
 		/*
 		The attrib container holds all of the positions, normals and texture coordinates
@@ -2708,20 +8567,24 @@ private:
 		*/
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
-		std::vector<tinyobj::material_t> materials;
-		std::string warn;
 		std::string err;
 		/*
 		Faces in OBJ files can actually contain an arbitrary number of vertices, whereas our
-		application can only render triangles. Luckily the LoadObj has an optional
-		parameter to automatically triangulate such faces, which is enabled by default.
+		application can only render triangles. Like tinyobj::LoadObj with its default
+		arguments, loadObjParallel triangulates such faces while parsing.
 		*/
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str()))
+		if (!loadObjParallel(attrib, shapes, err, MODEL_PATH))
 		{
-			throw std::runtime_error(warn + err);
+			throw std::runtime_error(err);
 		}
 
-		std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+		size_t cornerCount{ 0 };
+		for (const auto& shape : shapes)
+		{
+			cornerCount += shape.mesh.indices.size();
+		}
+		std::vector<Vertex> corners;
+		corners.reserve(cornerCount);
 
 		for (const auto& shape : shapes)
 		{
@@ -2751,30 +8614,787 @@ private:
 					1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
 				};
 				vertex.color = { 1.0f, 1.0f, 1.0f };
-				if (uniqueVertices.count(vertex) == 0)
+				corners.push_back(vertex);
+			}
+		}
+
+		/*
+		Every corner refers to a unique vertex, corners with identical attributes share
+		one. Large meshes are welded on all cores, both paths number the vertices in
+		order of first use so the result does not depend on the path taken.
+		*/
+		if (cornerCount >= PARALLEL_WELD_MIN_CORNERS)
+		{
+			weldVerticesParallel(corners, vertices, indices);
+		}
+		else
+		{
+			VertexWeldTable uniqueVertices{ cornerCount };
+			vertices.reserve(cornerCount / 4);
+			indices.reserve(cornerCount);
+			for (const Vertex& vertex : corners)
+			{
+				indices.push_back(uniqueVertices.weld(vertex, vertices));
+			}
+		}
+	}
+
+	/*
+	OBJ files list their faces in whatever order the exporter wrote them and the weld
+	numbers vertices in that order as well. Reordering the triangles for the vertex
+	cache and then the vertices for fetch locality is done once here, before the
+	result goes into the mesh cache, so warm starts get it for free.
+	*/
+	void optimizeModel()
+	{
+		auto startTime{ std::chrono::high_resolution_clock::now() };
+		VertexCacheStats before{ analyzeVertexCache(indices, vertices.size()) };
+		optimizeVertexCache(indices, vertices.size());
+		buildLods();
+		// LOD 0 comes first, so the vertices end up in the order it uses them
+		optimizeVertexFetch(vertices, indices);
+		VertexCacheStats after{ analyzeVertexCache(std::span(indices).first(lods[0].indexCount), vertices.size()) };
+		auto milliseconds{ std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() };
+		std::cout << "optimizeModel: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> "
+			<< after.atvr << " (FIFO of " << VERTEX_CACHE_SIZE << "), " << milliseconds << " ms" << std::endl;
+	}
+
+	/*
+	Appends LOD 1..N to indices, each simplified from the previous level. The chain
+	stops early when a level no longer removes at least 10% of the triangles.
+	*/
+	void buildLods()
+	{
+		auto startTime{ std::chrono::high_resolution_clock::now() };
+		lods = { { 0, static_cast<uint32_t>(indices.size()), 0.0f, 0 } };
+		std::vector<uint32_t> previous{ indices };
+		float error{ 0.0f };
+		for (float targetError : LOD_TARGET_ERRORS)
+		{
+			float levelError;
+			std::vector<uint32_t> lod{ simplifyMesh(vertices, previous, previous.size() / 2, targetError, levelError) };
+			if (lod.empty() || lod.size() * 10 > previous.size() * 9)
+			{
+				break;
+			}
+			optimizeVertexCache(lod, vertices.size());
+			// errors of successive levels add up, since each one is measured against the previous
+			error += levelError;
+			lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod.size()), error, 0 });
+			indices.insert(indices.end(), lod.begin(), lod.end());
+			previous.swap(lod);
+		}
+		auto milliseconds{ std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count() };
+		std::cout << "buildLods: " << lods.size() << " LODs in " << milliseconds << " ms:";
+		for (const MeshLod& lod : lods)
+		{
+			std::cout << " " << lod.indexCount / 3 << " triangles (error " << lod.error << ")";
+		}
+		std::cout << std::endl;
+	}
+
+	void computeModelBounds()
+	{
+		glm::vec3 minimum{ std::numeric_limits<float>::max() };
+		glm::vec3 maximum{ std::numeric_limits<float>::lowest() };
+		for (const Vertex& vertex : vertexData)
+		{
+			minimum = glm::min(minimum, vertex.pos);
+			maximum = glm::max(maximum, vertex.pos);
+		}
+		boundsCenter = (minimum + maximum) * 0.5f;
+		boundsRadius = 0.0f;
+		for (const Vertex& vertex : vertexData)
+		{
+			boundsRadius = std::max(boundsRadius, glm::distance(vertex.pos, boundsCenter));
+		}
+	}
+
+	/*
+	settings.objectCount copies of the model on a square grid in the XY plane, each
+	scaled down to its cell, so together they cover what the single model did and the
+	camera keeps seeing all of them. With one object the placement is the identity.
+	*/
+	void placeObjects()
+	{
+		uint32_t side{ static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(settings.objectCount)))) };
+		float cell{ 2.0f * boundsRadius / side };
+		objectPlacements.clear();
+		for (uint32_t object = 0; object < settings.objectCount; object++)
+		{
+			glm::vec3 offset{ (object % side + 0.5f) * cell - boundsRadius, (object / side + 0.5f) * cell - boundsRadius, 0.0f };
+			objectPlacements.push_back(glm::scale(glm::translate(glm::mat4(1.0f), offset), glm::vec3(1.0f / side)));
+		}
+	}
+
+	/*
+	A LOD with error e seen from distance d covers e * h / (2 * tan(fovY / 2) * d)
+	pixels on a viewport h pixels high. The distance is measured to the nearest
+	point of the bounding sphere, so the estimate errs on the detailed side.
+	*/
+	uint32_t selectLod()
+	{
+		uint32_t lodCount{ static_cast<uint32_t>(lods.size()) };
+		if (settings.lodSweep)
+		{
+			auto seconds{ std::chrono::duration<double>(std::chrono::high_resolution_clock::now().time_since_epoch()).count() };
+			return static_cast<uint32_t>(seconds / 2.0) % lodCount;
+		}
+		if (settings.forcedLod >= 0)
+		{
+			return std::min(static_cast<uint32_t>(settings.forcedLod), lodCount - 1);
+		}
+		glm::vec4 center{ modelMatrix * glm::vec4(boundsCenter, 1.0f) };
+		float distance{ std::max(glm::length(cameraPosition - glm::vec3(center.x, center.y, center.z)) - boundsRadius, 0.1f) };
+		float pixelsPerUnit{ swapChainExtent.height / (2.0f * std::tan(cameraFovY * 0.5f) * distance) };
+		uint32_t lod{ 0 };
+		while (lod + 1 < lodCount && lods[lod + 1].error * pixelsPerUnit <= LOD_PIXEL_ERROR)
+		{
+			lod++;
+		}
+		return lod;
+	}
+
+	void printLodReport()
+	{
+		std::cout << "LOD report:" << std::endl;
+		for (size_t i = 0; i < lods.size(); i++)
+		{
+			std::cout << "  LOD " << i << ": " << lods[i].indexCount / 3 << " triangles, error " << lods[i].error;
+			if (i < lodFrameStats.size() && lodFrameStats[i].frames > 0)
+			{
+				std::cout << ", " << lodFrameStats[i].frames << " frames, "
+					<< lodFrameStats[i].seconds / lodFrameStats[i].frames * 1000.0 << " ms/frame";
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	void buildModelMeshlets()
+	{
+		if (!enableMeshletCulling)
+		{
+			return;
+		}
+		auto start{ std::chrono::high_resolution_clock::now() };
+		meshletData = {};
+		lodFirstMeshlet.clear();
+		// the triangles get reordered, so a 32-bit index buffer mapped from the mesh cache needs a copy
+		if (indexType == VK_INDEX_TYPE_UINT32 && indexData.data() != indices.data())
+		{
+			indices.assign(indexData.begin(), indexData.end());
+			indexData = indices;
+		}
+		// the reordering costs some vertex cache efficiency, measured on LOD 0
+		auto lod0CacheStats = [this]()
+		{
+			std::vector<uint32_t> lodIndices;
+			for (uint32_t i = lodFirstSubMesh[0]; i < lodFirstSubMesh[1]; i++)
+			{
+				const SubMesh& subMesh{ subMeshes[i] };
+				for (uint32_t j = subMesh.firstIndex; j < subMesh.firstIndex + subMesh.indexCount; j++)
+				{
+					lodIndices.push_back((indexType == VK_INDEX_TYPE_UINT16 ? indices16[j] : indexData[j]) + subMesh.vertexOffset);
+				}
+			}
+			return analyzeVertexCache(lodIndices, vertexData.size());
+		};
+		VertexCacheStats cacheBefore{ lod0CacheStats() };
+		std::vector<uint32_t> subMeshIndices;
+		for (size_t lod = 0; lod < lods.size(); lod++)
+		{
+			lodFirstMeshlet.push_back(static_cast<uint32_t>(meshletData.meshlets.size()));
+			for (uint32_t i = lodFirstSubMesh[lod]; i < lodFirstSubMesh[lod + 1]; i++)
+			{
+				const SubMesh& subMesh{ subMeshes[i] };
+				if (indexType == VK_INDEX_TYPE_UINT16)
+				{
+					auto subMeshBegin{ indices16.begin() + subMesh.firstIndex };
+					subMeshIndices.assign(subMeshBegin, subMeshBegin + subMesh.indexCount);
+					buildMeshlets(vertexData, subMeshIndices, subMesh.firstIndex, subMesh.vertexOffset, meshletData);
+					std::transform(subMeshIndices.begin(), subMeshIndices.end(), subMeshBegin,
+						[](uint32_t index) { return static_cast<uint16_t>(index); });
+				}
+				else
+				{
+					buildMeshlets(vertexData, std::span(indices).subspan(subMesh.firstIndex, subMesh.indexCount),
+						subMesh.firstIndex, subMesh.vertexOffset, meshletData);
+				}
+			}
+		}
+		lodFirstMeshlet.push_back(static_cast<uint32_t>(meshletData.meshlets.size()));
+		auto end{ std::chrono::high_resolution_clock::now() };
+		VertexCacheStats cacheAfter{ lod0CacheStats() };
+
+		size_t meshletCount{ meshletData.meshlets.size() };
+		size_t withCone{ static_cast<size_t>(std::count_if(meshletData.meshlets.begin(), meshletData.meshlets.end(),
+			[](const Meshlet& meshlet) { return meshlet.coneCutoff < 1.0f; })) };
+		double averageVertices{ meshletData.vertices.size() / static_cast<double>(std::max<size_t>(meshletCount, 1)) };
+		double averageTriangles{ indexData.size() / 3.0 / std::max<size_t>(meshletCount, 1) };
+		std::cout << "buildMeshlets: " << meshletCount << " meshlets for " << lods.size() << " LODs, on average "
+			<< averageVertices << " vertices (" << averageVertices / MESHLET_MAX_VERTICES * 100.0 << "%) and "
+			<< averageTriangles << " triangles (" << averageTriangles / MESHLET_MAX_TRIANGLES * 100.0 << "%), "
+			<< withCone * 100.0 / std::max<size_t>(meshletCount, 1) << "% with a usable normal cone, "
+			<< std::chrono::duration<double, std::milli>(end - start).count() << " ms, LOD 0 ACMR "
+			<< cacheBefore.acmr << " -> " << cacheAfter.acmr << std::endl;
+		for (size_t lod = 0; lod < lods.size(); lod++)
+		{
+			std::cout << "  LOD " << lod << ": " << lodFirstMeshlet[lod + 1] - lodFirstMeshlet[lod] << " meshlets" << std::endl;
+		}
+	}
+
+	/*
+	Fills visibleMeshlets with the meshlets of currentLod that intersect the view
+	frustum and are not entirely back facing. The frustum planes (Gribb/Hartmann,
+	with the 0..1 depth range of GLM_FORCE_DEPTH_ZERO_TO_ONE) and the camera are
+	moved into model space once, so the stored bounds are tested as they are.
+	*/
+	void cullMeshlets()
+	{
+		glm::mat4 clip{ viewProjection * modelMatrix };
+		auto row = [&clip](int i) { return glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]); };
+		std::array<glm::vec4, 6> planes{ row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(2), row(3) - row(2) };
+		for (glm::vec4& plane : planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+		glm::vec3 camera{ glm::inverse(modelMatrix) * glm::vec4(cameraPosition, 1.0f) };
+
+		visibleMeshlets.clear();
+		for (uint32_t i = lodFirstMeshlet[currentLod]; i < lodFirstMeshlet[currentLod + 1]; i++)
+		{
+			const Meshlet& meshlet{ meshletData.meshlets[i] };
+			meshletStats.triangles += meshlet.indexCount / 3;
+			bool outside{ std::any_of(planes.begin(), planes.end(), [&meshlet](const glm::vec4& plane)
+				{ return glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius; }) };
+			if (outside)
+			{
+				meshletStats.frustumCulledTriangles += meshlet.indexCount / 3;
+				continue;
+			}
+			if (glm::dot(glm::normalize(meshlet.coneApex - camera), meshlet.coneAxis) >= meshlet.coneCutoff)
+			{
+				meshletStats.coneCulledTriangles += meshlet.indexCount / 3;
+				continue;
+			}
+			visibleMeshlets.push_back(i);
+		}
+		meshletStats.frames++;
+		meshletStats.meshlets += lodFirstMeshlet[currentLod + 1] - lodFirstMeshlet[currentLod];
+		meshletStats.visibleMeshlets += visibleMeshlets.size();
+	}
+
+	void printMeshletReport()
+	{
+		if (meshletStats.frames == 0)
+		{
+			return;
+		}
+		double frames{ static_cast<double>(meshletStats.frames) };
+		std::cout << "Meshlet culling (" << (meshShadingSupported ? "mesh shader" : "index buffer draws") << "), per frame: "
+			<< meshletStats.visibleMeshlets / frames << " of " << meshletStats.meshlets / frames << " meshlets drawn, "
+			<< meshletStats.triangles / frames << " triangles of which " << meshletStats.frustumCulledTriangles / frames
+			<< " culled by the frustum and " << meshletStats.coneCulledTriangles / frames << " by the normal cones ("
+			<< (meshletStats.frustumCulledTriangles + meshletStats.coneCulledTriangles) * 100.0 / std::max<uint64_t>(meshletStats.triangles, 1)
+			<< "%), " << meshletStats.draws / frames << " draw(s)" << std::endl;
+	}
+
+	void printMemoryReport()
+	{
+		MemoryStats stats{ memoryAllocator.statistics() };
+		std::cout << "Device memory: " << stats.deviceMemoryCount << " VkDeviceMemory objects (peak "
+			<< stats.peakDeviceMemoryCount << " of maxMemoryAllocationCount " << memoryAllocator.deviceMemoryLimit() << "), "
+			<< stats.vkAllocateMemoryCalls << " vkAllocateMemory calls for " << stats.allocateCalls << " resources, peak "
+			<< stats.peakDeviceBytes / (1024.0 * 1024.0) << " MiB" << std::endl;
+		std::cout << "  " << stats.blockCount << " block(s) of " << stats.blockBytes / (1024.0 * 1024.0) << " MiB holding "
+			<< stats.subAllocationCount << " sub-allocations, " << stats.requestedBytes / 1024.0 << " KiB requested in "
+			<< stats.nodeBytes / 1024.0 << " KiB of buddy nodes; " << stats.dedicatedCount << " dedicated allocation(s) of "
+			<< stats.dedicatedBytes / (1024.0 * 1024.0) << " MiB" << std::endl;
+		const StagingStats& staging{ stagingRing.stats };
+		std::cout << "Staging ring (" << stagingRing.size() / (1024.0 * 1024.0) << " MiB): " << staging.uploads << " uploads, "
+			<< staging.bytesStaged / (1024.0 * 1024.0) << " MiB staged, peak " << staging.peakBytesInFlight / (1024.0 * 1024.0)
+			<< " MiB in flight, " << staging.wraps << " wrap(s), " << staging.stalls << " stall(s) waiting "
+			<< staging.stallMilliseconds << " ms, " << staging.oversizeUploads << " upload(s) too big for the ring" << std::endl;
+		const UniformArenaStats& uniforms{ uniformArena.stats };
+		std::cout << "Uniform arena (" << uniformArena.regionSize() / 1024.0 << " KiB per frame in flight): "
+			<< uniforms.allocations << " allocations in " << uniforms.frames << " frames, peak " << uniforms.peakFrameBytes
+			<< " bytes in one frame" << std::endl;
+		if (asyncUploadsSupported)
+		{
+			std::cout << "Async uploads (queue family " << uploadQueueFamily << ", graphics " << graphicsQueueFamily << "): "
+				<< uploadStats.submissions << " submissions, " << uploadStats.ownershipTransfers << " ownership transfer(s), "
+				<< uploadStats.frameWaits << " frame(s) waited for an upload" << std::endl;
+		}
+	}
+
+	/*
+	What the multisampled color and depth attachments cost at the current and a few
+	common resolutions, for every sample count up to the one in use: the memory they
+	take when backed by real memory (lazily allocated memory saves all of it), what D16
+	would save over the depth format in use, and the bytes the DONT_CARE stores keep
+	from being written back per frame. That last one is what a tile based GPU saves,
+	immediate mode GPUs write the samples while rendering anyway.
+	*/
+	void printAttachmentReport()
+	{
+		constexpr double mib{ 1024.0 * 1024.0 };
+		VkFormat depthFormat{ findDepthFormat() };
+		// swap chain formats are 32 bits per pixel in practice, chooseSwapSurfaceFormat prefers BGRA8
+		uint32_t colorBytes{ 4 };
+		uint32_t depthBytes{ depthFormatBytes(depthFormat) };
+		bool lazy{ (attachmentMemoryProperties() & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0 };
+		std::cout << "Attachments (" << swapChainExtent.width << "x" << swapChainExtent.height << ", " << msaaSamples
+			<< "x MSAA, " << depthFormatName(depthFormat) << "): ";
+		if (lazy)
+		{
+			VkDeviceSize colorCommitted;
+			VkDeviceSize depthCommitted;
+			vkGetDeviceMemoryCommitment(device, colorImageMemory.memory, &colorCommitted);
+			vkGetDeviceMemoryCommitment(device, depthImageMemory.memory, &depthCommitted);
+			std::cout << "transient in lazily allocated memory, " << (colorCommitted + depthCommitted) / mib << " MiB committed";
+		}
+		else
+		{
+			std::cout << (settings.transientAttachments ? "transient, but no lazily allocated memory type" : "device local");
+		}
+		std::cout << ", color and depth not stored" << std::endl;
+
+		std::array<VkExtent2D, 5> resolutions{ { swapChainExtent, { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } } };
+		for (const VkExtent2D& resolution : resolutions)
+		{
+			for (uint32_t samples{ 1 }; samples <= msaaSamples; samples *= 2)
+			{
+				double sampleCount{ static_cast<double>(resolution.width) * resolution.height * samples };
+				double memory{ sampleCount * (colorBytes + depthBytes) / mib };
+				std::cout << "  " << resolution.width << "x" << resolution.height << " " << samples << "x: " << memory
+					<< " MiB, lazy allocation saves " << (lazy ? memory : 0.0) << " MiB, D16 would save "
+					<< sampleCount * (depthBytes - 2) / mib << " MiB, the stores skipped save " << memory << " MiB per frame ("
+					<< memory * 60 / 1024.0 << " GiB/s at 60 fps)" << std::endl;
+			}
+		}
+	}
+
+	/*
+	What the per-draw transforms cost. On the CPU: updateUniformBuffer, which builds them,
+	and the draw recording, which pushes or binds them. On the GPU: the vertex shader
+	invocations the statistics queries counted, times the multiply-adds of the transform
+	as the shaders write it, 16 for the premultiplied matrix (one mat4 * vec4) and 144
+	for proj * view * model * position (two mat4 * mat4 and a mat4 * vec4).
+	*/
+	void printTransformReport()
+	{
+		if (transformStats.frames == 0)
+		{
+			return;
+		}
+		double frames{ static_cast<double>(transformStats.frames) };
+		double updateMicroseconds{ transformStats.updateSeconds * 1e6 / frames };
+		std::cout << "Transforms (" << (settings.pushTransforms ? "push constants" : "uniform buffers") << ", "
+			<< settings.objectCount << " object(s)): " << updateMicroseconds << " us/frame updating ("
+			<< updateMicroseconds / settings.objectCount << " us per object), " << transformStats.recordSeconds * 1e6 / frames
+			<< " us/frame recording " << transformStats.draws / frames << " draw(s)" << std::endl;
+		if (transformStats.queriedFrames > 0)
+		{
+			double vertices{ transformStats.vertexInvocations / static_cast<double>(transformStats.queriedFrames) };
+			uint32_t multiplyAdds{ settings.pushTransforms ? 16u : 144u };
+			std::cout << "  " << vertices << " vertex shader invocations/frame, " << multiplyAdds << " multiply-adds each for the transform, "
+				<< vertices * multiplyAdds / 1e6 << " M/frame (" << vertices * (settings.pushTransforms ? 144 : 16) / 1e6
+				<< " M with " << (settings.pushTransforms ? "uniform buffers" : "push constants") << ")" << std::endl;
+		}
+	}
+
+	/*
+	The CPU time drawFrame spends on its command buffer. With the cache every reused frame
+	skips a recording, so it saves the average recording minus the reuse check. The
+	recordings with one-off commands count towards that average too.
+	*/
+	void printCommandBufferReport()
+	{
+		if (commandBufferStats.frames == 0)
+		{
+			return;
+		}
+		double frames{ static_cast<double>(commandBufferStats.frames) };
+		double recordMicroseconds{ commandBufferStats.recordSeconds * 1e6 / std::max<uint64_t>(commandBufferStats.recorded, 1) };
+		std::cout << "Command buffers (" << (settings.cacheCommandBuffers ? "cached" : "recorded every frame");
+		if (recordingWorkers)
+		{
+			std::cout << ", draws in secondary command buffers on " << recordingWorkers->size() << " thread(s)";
+		}
+		std::cout << "): "
+			<< commandBufferStats.recorded << " recorded and " << commandBufferStats.reused << " reused in "
+			<< commandBufferStats.frames << " frames, " << recordMicroseconds << " us per recording";
+		if (settings.cacheCommandBuffers)
+		{
+			double reuseMicroseconds{ commandBufferStats.reuseSeconds * 1e6 / std::max<uint64_t>(commandBufferStats.reused, 1) };
+			std::cout << ", " << reuseMicroseconds << " us per reuse, saving "
+				<< (recordMicroseconds - reuseMicroseconds) * commandBufferStats.reused / frames << " us/frame";
+			if (settings.pushTransforms)
+			{
+				std::cout << " (the push constants are part of the commands, so none can be reused)";
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	/*
+	CPU time to record 1k, 10k and 100k draws, each with its own push constants: inline on
+	the calling thread, and split into secondary command buffers on 1 thread up to one per
+	core the way recordSecondaryDraws does it. Nothing is submitted. The draws all use the
+	first sub-mesh of the coarsest LOD, the cost of recording doesn't depend on its size.
+	Run with --bench-recording. The first line names the device, driver and core count,
+	since the scaling depends on all three.
+	*/
+	void benchmarkCommandRecording()
+	{
+		uint32_t maxThreads{ std::max(1u, std::thread::hardware_concurrency()) };
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		std::cout << "Command recording benchmark on " << properties.deviceName << " (driver version " << properties.driverVersion
+			<< "), " << maxThreads << " threads, best of 5 runs:" << std::endl;
+		WorkerPool workers{ maxThreads };
+		std::vector<VkCommandPool> pools(maxThreads + 1);
+		std::vector<VkCommandBuffer> secondaries(maxThreads);
+		for (uint32_t i = 0; i < maxThreads; i++)
+		{
+			createSecondaryCommandBuffer(pools[i], secondaries[i]);
+		}
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = graphicsQueueFamily;
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &pools[maxThreads]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command pool!");
+		}
+		VkCommandBuffer primary;
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = pools[maxThreads];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &primary) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command buffer!");
+		}
+
+		// recordDraws reads the draws and their transforms from the frame state, put back afterwards
+		std::vector<IndexedDraw> savedDraws{ std::move(frameDraws) };
+		std::vector<DrawPushConstants> savedPushConstants{ std::move(drawPushConstants) };
+		// recordDrawState binds the first object's uniforms, no frame has written any yet
+		std::vector<uint32_t> savedUniformOffsets{ std::exchange(drawUniformOffsets, { 0 }) };
+		bool savedPushTransforms{ settings.pushTransforms };
+		settings.pushTransforms = true;
+		const SubMesh& subMesh{ subMeshes[lodFirstSubMesh[lods.size() - 1]] };
+
+		std::array<VkClearValue, 2> clearValues{};
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		renderPassInfo.framebuffer = swapChainFramebuffers[0];
+		renderPassInfo.renderArea.extent = swapChainExtent;
+		renderPassInfo.clearValueCount = clearValues.size();
+		renderPassInfo.pClearValues = clearValues.data();
+		for (uint32_t drawCount : { 1000u, 10000u, 100000u })
+		{
+			frameDraws.clear();
+			drawPushConstants.clear();
+			for (uint32_t i = 0; i < drawCount; i++)
+			{
+				frameDraws.push_back({ i, subMesh.indexCount, subMesh.firstIndex, subMesh.vertexOffset });
+				drawPushConstants.push_back({ glm::mat4(1.0f), i });
+			}
+			std::cout << "Recording " << drawCount << " draws:" << std::endl;
+			double inlineMilliseconds{ 0.0 };
+			auto measure{ [&](const std::string& name, VkSubpassContents contents, auto&& record)
+				{
+					constexpr int runs{ 5 };
+					double best{ std::numeric_limits<double>::max() };
+					for (int run = 0; run < runs; run++)
+					{
+						auto start{ std::chrono::high_resolution_clock::now() };
+						vkResetCommandPool(device, pools[maxThreads], 0);
+						VkCommandBufferBeginInfo beginInfo{};
+						beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+						beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+						if (vkBeginCommandBuffer(primary, &beginInfo) != VK_SUCCESS)
+						{
+							throw std::runtime_error("failed to begin recording command buffer!");
+						}
+						vkCmdBeginRenderPass(primary, &renderPassInfo, contents);
+						record();
+						vkCmdEndRenderPass(primary);
+						if (vkEndCommandBuffer(primary) != VK_SUCCESS)
+						{
+							throw std::runtime_error("failed to record command buffer!");
+						}
+						best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+					}
+					if (inlineMilliseconds == 0.0)
+					{
+						inlineMilliseconds = best;
+					}
+					std::cout << "  " << name << ": " << best << " ms, " << drawCount / (best * 1000.0) << " Mdraws/s, "
+						<< inlineMilliseconds / best << "x inline" << std::endl;
+				} };
+			measure("inline, 1 thread", VK_SUBPASS_CONTENTS_INLINE, [&]()
+				{
+					recordDrawState(primary);
+					recordDraws(primary, 0, drawCount);
+				});
+			std::vector<uint32_t> threadCounts;
+			for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+			{
+				threadCounts.push_back(threads);
+			}
+			threadCounts.push_back(maxThreads);
+			for (uint32_t threads : threadCounts)
+			{
+				std::string name{ "secondary, " + std::to_string(threads) + (threads == 1 ? " thread" : " threads") };
+				measure(name, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS, [&]()
+					{
+						workers.run(threads, [&](uint32_t thread)
+							{
+								recordSecondary(pools[thread], secondaries[thread], swapChainFramebuffers[0],
+									size_t{ drawCount } * thread / threads, size_t{ drawCount } * (thread + 1) / threads, false);
+							});
+						vkCmdExecuteCommands(primary, threads, secondaries.data());
+					});
+			}
+		}
+
+		frameDraws = std::move(savedDraws);
+		drawPushConstants = std::move(savedPushConstants);
+		drawUniformOffsets = std::move(savedUniformOffsets);
+		settings.pushTransforms = savedPushTransforms;
+		for (VkCommandPool pool : pools)
+		{
+			vkDestroyCommandPool(device, pool, nullptr);
+		}
+	}
+
+	/*
+	The cache is valid when it was written by this version of the code for this Vertex
+	layout and its recorded source size/modification time still match MODEL_PATH. If
+	only the modification time changed (the file was touched, copied or checked out
+	again) the source is hashed and compared to the recorded content hash, so the
+	expensive parse only happens when the OBJ contents really changed.
+	*/
+	bool loadMeshCache()
+	{
+		std::error_code ec;
+		uint64_t sourceSize{ std::filesystem::file_size(MODEL_PATH, ec) };
+		if (ec)
+		{
+			return false;
+		}
+		int64_t sourceWriteTime{ std::filesystem::last_write_time(MODEL_PATH, ec).time_since_epoch().count() };
+		if (ec || !meshCacheFile.open(MESH_CACHE_PATH))
+		{
+			return false;
+		}
+
+		if (meshCacheFile.size < sizeof(MeshCacheHeader))
+		{
+			meshCacheFile.close();
+			return false;
+		}
+		MeshCacheHeader header;
+		memcpy(&header, meshCacheFile.data, sizeof(header));
+		uint64_t expectedSize{ sizeof(MeshCacheHeader) + header.vertexCount * static_cast<uint64_t>(sizeof(Vertex)) +
+			header.indexCount * sizeof(uint32_t) + header.lodCount * static_cast<uint64_t>(sizeof(MeshLod)) };
+		if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+			header.vertexSize != sizeof(Vertex) || expectedSize != meshCacheFile.size || header.lodCount == 0 ||
+			header.sourceSize != sourceSize)
+		{
+			meshCacheFile.close();
+			return false;
+		}
+		if (header.sourceWriteTime != sourceWriteTime)
+		{
+			MappedFile source;
+			if (!source.open(MODEL_PATH) || hashBytes(source.data, source.size) != header.sourceHash)
+			{
+				meshCacheFile.close();
+				return false;
+			}
+			// Same contents, only the timestamp moved: refresh it so the next start skips the hash.
+			meshCacheFile.close();
+			std::fstream file{ MESH_CACHE_PATH, std::ios::in | std::ios::out | std::ios::binary };
+			header.sourceWriteTime = sourceWriteTime;
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.close();
+			if (!meshCacheFile.open(MESH_CACHE_PATH))
+			{
+				return false;
+			}
+		}
+
+		const unsigned char* payload{ meshCacheFile.data + sizeof(MeshCacheHeader) };
+		vertexData = { reinterpret_cast<const Vertex*>(payload), header.vertexCount };
+		indexData = { reinterpret_cast<const uint32_t*>(payload + header.vertexCount * sizeof(Vertex)),
+			static_cast<size_t>(header.indexCount) };
+		indexCount = static_cast<uint32_t>(header.indexCount);
+		const MeshLod* lodData{ reinterpret_cast<const MeshLod*>(indexData.data() + indexData.size()) };
+		lods.assign(lodData, lodData + header.lodCount);
+		return true;
+	}
+
+	void writeMeshCache(uint64_t sourceLoadMicroseconds)
+	{
+		MappedFile source;
+		std::error_code ec;
+		if (!source.open(MODEL_PATH))
+		{
+			return;
+		}
+		MeshCacheHeader header{};
+		header.magic = MESH_CACHE_MAGIC;
+		header.version = MESH_CACHE_VERSION;
+		header.vertexSize = sizeof(Vertex);
+		header.vertexCount = static_cast<uint32_t>(vertexData.size());
+		header.indexCount = indexData.size();
+		header.sourceSize = source.size;
+		header.sourceWriteTime = std::filesystem::last_write_time(MODEL_PATH, ec).time_since_epoch().count();
+		header.sourceHash = hashBytes(source.data, source.size);
+		header.sourceLoadMicroseconds = sourceLoadMicroseconds;
+		header.lodCount = static_cast<uint32_t>(lods.size());
+
+		/*
+		Write to a temporary file and rename it over the old cache, so a crash halfway
+		through never leaves a truncated cache behind that passes the header checks.
+		*/
+		std::string tempPath{ MESH_CACHE_PATH + ".tmp" };
+		std::ofstream file{ tempPath, std::ios::binary | std::ios::trunc };
+		if (!file.is_open())
+		{
+			std::cerr << "failed to write mesh cache " << MESH_CACHE_PATH << std::endl;
+			return;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(vertexData.data()), vertexData.size_bytes());
+		file.write(reinterpret_cast<const char*>(indexData.data()), indexData.size_bytes());
+		file.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(MeshLod));
+		file.close();
+		if (!file)
+		{
+			std::filesystem::remove(tempPath, ec);
+			return;
+		}
+		std::filesystem::rename(tempPath, MESH_CACHE_PATH, ec);
+		if (ec)
+		{
+			std::filesystem::remove(tempPath, ec);
+		}
+	}
+
+	/*
+	Decides between 16 and 32-bit indices before anything is uploaded, since splitting
+	a large mesh into sub-meshes also reorders (and partly duplicates) its vertices.
+	*/
+	void chooseIndexType()
+	{
+		// every LOD gets its own sub-meshes, so a draw never has to cover two LODs
+		indexType = VK_INDEX_TYPE_UINT16;
+		indices16.resize(indexData.size());
+		subMeshes.clear();
+		lodFirstSubMesh.clear();
+		std::vector<uint32_t> vertexRemap;
+		for (const MeshLod& lod : lods)
+		{
+			IndexBufferLayout layout{ chooseIndexBufferLayout(indexData.subspan(lod.firstIndex, lod.indexCount),
+				vertexData.size(), enableIndexSplitting) };
+			if (layout.indexType == VK_INDEX_TYPE_UINT32)
+			{
+				// same vertex count for all LODs, so this happens for the first one already
+				indexType = VK_INDEX_TYPE_UINT32;
+				indices16 = {};
+				subMeshes.clear();
+				lodFirstSubMesh.clear();
+				for (const MeshLod& lod32 : lods)
 				{
-					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-					vertices.push_back(vertex);
+					lodFirstSubMesh.push_back(static_cast<uint32_t>(subMeshes.size()));
+					subMeshes.push_back({ lod32.firstIndex, lod32.indexCount, 0 });
 				}
-				
-				indices.push_back(uniqueVertices[vertex]);
+				break;
+			}
+			lodFirstSubMesh.push_back(static_cast<uint32_t>(subMeshes.size()));
+			for (SubMesh subMesh : layout.subMeshes)
+			{
+				subMesh.firstIndex += lod.firstIndex;
+				subMesh.vertexOffset += static_cast<int32_t>(vertexRemap.size());
+				subMeshes.push_back(subMesh);
+			}
+			std::copy(layout.indices16.begin(), layout.indices16.end(), indices16.begin() + lod.firstIndex);
+			vertexRemap.insert(vertexRemap.end(), layout.vertexRemap.begin(), layout.vertexRemap.end());
+		}
+		lodFirstSubMesh.push_back(static_cast<uint32_t>(subMeshes.size()));
+		size_t vertexCount{ vertexData.size() };
+		if (!vertexRemap.empty())
+		{
+			std::vector<Vertex> splitVertices(vertexRemap.size());
+			for (size_t i = 0; i < vertexRemap.size(); i++)
+			{
+				splitVertices[i] = vertexData[vertexRemap[i]];
 			}
+			vertices.swap(splitVertices);
+			vertexData = vertices;
+		}
+		std::cout << "chooseIndexType: " << indexData.size() << " indices as "
+			<< (indexType == VK_INDEX_TYPE_UINT16 ? "uint16" : "uint32") << " in " << subMeshes.size() << " draw(s) for "
+			<< lods.size() << " LODs, "
+			<< indexData.size() * (indexType == VK_INDEX_TYPE_UINT16 ? 2 : 4) / 1024.0 << " KB instead of "
+			<< indexData.size_bytes() / 1024.0 << " KB";
+		if (vertexData.size() != vertexCount)
+		{
+			std::cout << ", " << vertexData.size() - vertexCount << " vertices duplicated across sub-meshes";
+		}
+		std::cout << std::endl;
+	}
+
+	void quantizeModel()
+	{
+		if (!settings.compactVertices)
+		{
+			return;
 		}
+		quantizedMesh = quantizeVertices(vertexData);
+		positionDequantize = glm::scale(glm::translate(glm::mat4(1.0f), quantizedMesh.positionOffset), quantizedMesh.positionScale);
+		std::cout << "quantizeModel: " << vertexData.size_bytes() / 1024.0 << " KB -> "
+			<< quantizedMesh.vertices.size() * sizeof(PackedVertex) / 1024.0 << " KB of vertex data, max error position "
+			<< quantizedMesh.maxPositionError << " (" << quantizedMesh.maxPositionError /
+			std::max({ quantizedMesh.positionScale.x, quantizedMesh.positionScale.y, quantizedMesh.positionScale.z }) * 100.0f
+			<< "% of the bounding box), texCoord " << quantizedMesh.maxTexCoordError
+			<< (quantizedMesh.texCoordFormat == VK_FORMAT_R16G16_UNORM ? " (unorm16)" : " (half)") << std::endl;
+	}
+
+	void releaseModelData()
+	{
+		indices16 = {};
+		quantizedMesh.vertices = {};
+		meshletData.gpuMeshlets = {};
+		meshletData.vertices = {};
+		meshletData.triangles = {};
+		vertexData = {};
+		indexData = {};
+		meshCacheFile.close();
+		std::vector<Vertex>().swap(vertices);
+		std::vector<uint32_t>().swap(indices);
 	}
 
 	void createVertexBuffer()
 	{
-		VkDeviceSize bufferSize{ sizeof(vertices[0]) * vertices.size() };
+		std::span<const std::byte> vertexBytes{ settings.compactVertices ?
+			std::as_bytes(std::span<const PackedVertex>(quantizedMesh.vertices)) : std::as_bytes(vertexData) };
+		VkDeviceSize bufferSize{ vertexBytes.size() };
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
 		/*
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT: Buffer can be used as source in a
 		memory transfer operation.
+		Every upload stages its data in the same ring buffer created with that usage,
+		acquireStaging hands out the next free piece of it.
 		*/
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			stagingBuffer, stagingBufferMemory);
+		StagingRegion staging{ acquireStaging(bufferSize) };
 
 		/*
 		This function allows us to access a region of the specified memory resource defined
@@ -2784,9 +9404,10 @@ private:
 		flags, but there aren’t any available yet in the current API. It must be set to the
 		value 0. The last parameter specifies the output for the pointer to the mapped
 		memory.
+		The staging ring stays mapped for the whole run, so the region comes with a
+		pointer into that mapping instead.
 		*/
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+		void* data{ staging.mapped };
 		/*
 		You can now simply memcpy the vertex data to the mapped memory and unmap
 		it again using vkUnmapMemory. Unfortunately the driver may not immediately
@@ -2801,8 +9422,7 @@ private:
 		matches the contents of the allocated memory. Do keep in mind that this may
 		lead to slightly worse performance than explicit flushing
 		*/
-		memcpy(data, vertices.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
+		memcpy(data, vertexBytes.data(), (size_t)bufferSize);
 
 		/*
 		Flushing memory ranges or using a coherent memory heap means that the driver
@@ -2818,7 +9438,9 @@ private:
 		The vertexBuffer is now allocated from a memory type that is device local,
 		which generally means that we’re not able to use vkMapMemory.
 		*/
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		// shader.mesh fetches the vertices itself through a storage buffer binding
+		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+			(meshShadingSupported ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0),
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			vertexBuffer, vertexBufferMemory);
 
@@ -2832,15 +9454,56 @@ private:
 		data from the vertex array to, and the final vertex buffer in device local memory.
 		We’ll then use a buffer copy command to move the data from the staging buffer
 		to the actual vertex buffer.
+		The copy runs on the upload queue, only the frames drawing with the buffer wait for it.
 		*/
-		copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+		vertexBufferUpload = uploadBuffer(staging, vertexBuffer, bufferSize);
+	}
 
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+	// Device local buffer with the given contents, filled through the staging ring.
+	UploadToken createDeviceLocalBuffer(std::span<const std::byte> data, VkBufferUsageFlags usage,
+		VkBuffer& buffer, MemoryAllocation& bufferMemory)
+	{
+		VkDeviceSize bufferSize{ std::max<VkDeviceSize>(data.size(), 4) };
+		StagingRegion staging{ acquireStaging(bufferSize) };
+		memcpy(staging.mapped, data.data(), data.size());
+		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			buffer, bufferMemory);
+		return uploadBuffer(staging, buffer, bufferSize);
+	}
+
+	/*
+	The meshlet bounds stay on the CPU for culling, the mesh shader path additionally
+	needs the meshlets themselves and a list of visible ones per frame in flight.
+	*/
+	void createMeshletBuffers()
+	{
+		if (!meshShadingSupported)
+		{
+			return;
+		}
+		createDeviceLocalBuffer(std::as_bytes(std::span<const GpuMeshlet>(meshletData.gpuMeshlets)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletBuffer, meshletBufferMemory);
+		createDeviceLocalBuffer(std::as_bytes(std::span<const uint32_t>(meshletData.vertices)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletVertexBuffer, meshletVertexBufferMemory);
+		// uploads complete in order, the last one's token covers all three
+		meshletBufferUpload = createDeviceLocalBuffer(std::as_bytes(std::span<const uint8_t>(meshletData.triangles)),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletTriangleBuffer, meshletTriangleBufferMemory);
+
+		VkDeviceSize visibleListSize{ std::max<VkDeviceSize>(meshletData.meshlets.size() * sizeof(uint32_t), 4) };
+		visibleMeshletBuffers.resize(settings.framesInFlight);
+		visibleMeshletBuffersMemory.resize(settings.framesInFlight);
+		visibleMeshletBuffersMapped.resize(settings.framesInFlight);
+		for (size_t i{ 0 }; i < settings.framesInFlight; i++)
+		{
+			createBuffer(visibleListSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				visibleMeshletBuffers[i], visibleMeshletBuffersMemory[i]);
+			visibleMeshletBuffersMapped[i] = visibleMeshletBuffersMemory[i].mapped;
+		}
 	}
 
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
-		VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+		VkBuffer& buffer, MemoryAllocation& bufferMemory, bool sharedWithUploadQueue = false)
 	{
 		VkBufferCreateInfo bufferInfo{};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -2855,8 +9518,21 @@ private:
 		Just like the images in the swap chain, buffers can also be owned by a specific
 		queue family or be shared between multiple at the same time. The buffer will
 		only be used from the graphics queue, so we can stick to exclusive access.
+		Staging buffers are read by both queues when uploads run on a transfer family.
+		Sharing them concurrently saves an ownership transfer for data that is only
+		ever copied from.
 		*/
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		uint32_t sharingFamilies[]{ graphicsQueueFamily, uploadQueueFamily };
+		if (sharedWithUploadQueue && graphicsQueueFamily != uploadQueueFamily)
+		{
+			bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			bufferInfo.queueFamilyIndexCount = 2;
+			bufferInfo.pQueueFamilyIndices = sharingFamilies;
+		}
+		else
+		{
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		}
 
 		if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
 		{
@@ -2876,8 +9552,7 @@ private:
 		buffer.
 		Graphics cards
 		*/
-		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+		MemoryRequest request{ memoryAllocator.bufferRequest(buffer) };
 
 		/*
 		In a real world application, you’re not supposed
@@ -2888,23 +9563,14 @@ private:
 		allocate memory for a large number of objects at the same time is to create a
 		custom allocator that splits up a single allocation among many different objects
 		by using the offset parameters that we’ve seen in many functions.
-		You can either implement such an allocator yourself, or use the VulkanMemoryAllocator
-		library provided by the GPUOpen initiative. However, for this
-		tutorial it’s okay to use a separate allocation for every resource, because we
-		won’t come close to hitting any of these limits for now.
-		*/
-		VkMemoryAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-		if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
-		{
-			throw std::runtime_error("failed to allocated vertex buffer memory!");
-		}
-		//Since this memory is allocated specifically for this the vertex buffer, the offset is simply 0.
-		// If the offset is non - zero, then it is required to be divisible by memRequirements.alignment.
-		vkBindBufferMemory(device, buffer, bufferMemory, 0);
+		That is what DeviceMemoryAllocator does: the buffer gets a piece of a large block
+		of the memory type findMemoryType picks, and only goes to the driver on its own
+		when it is big or the driver asks for a dedicated allocation.
+		*/
+		request.memoryType = findMemoryType(request.requirements.memoryTypeBits, properties);
+		bufferMemory = memoryAllocator.allocate(request);
+		// The offset into the block is a multiple of the required alignment, buddy nodes are aligned to their size.
+		vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
 	}
 
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
@@ -2921,34 +9587,524 @@ private:
 		*/
 		for (uint32_t i{ 0 }; i < memProperties.memoryTypeCount; i++)
 		{
-			/*
-			The typeFilter parameter will be used to specify the bit field of memory types
-			that are suitable. That means that we can find the index of a suitable memory
-			type by simply iterating over them and checking if the corresponding bit is set
-			to 1.
-			However, we’re not just interested in a memory type that is suitable for the
-			vertex buffer. We also need to be able to write our vertex data to that memory.
-			The memoryTypes array consists of VkMemoryType structs that specify the heap
-			and properties of each type of memory. The properties define special features
-			of the memory, like being able to map it so we can write to it from the CPU.
-			This property is indicated with VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, but
-			we also need to use the VK_MEMORY_PROPERTY_HOST_COHERENT_BIT property.
-			*/
-			if (typeFilter & (1 << i) &&
-				(memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			/*
+			The typeFilter parameter will be used to specify the bit field of memory types
+			that are suitable. That means that we can find the index of a suitable memory
+			type by simply iterating over them and checking if the corresponding bit is set
+			to 1.
+			However, we’re not just interested in a memory type that is suitable for the
+			vertex buffer. We also need to be able to write our vertex data to that memory.
+			The memoryTypes array consists of VkMemoryType structs that specify the heap
+			and properties of each type of memory. The properties define special features
+			of the memory, like being able to map it so we can write to it from the CPU.
+			This property is indicated with VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, but
+			we also need to use the VK_MEMORY_PROPERTY_HOST_COHERENT_BIT property.
+			*/
+			if (typeFilter & (1 << i) &&
+				(memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			{
+				return i;
+			}
+		}
+		throw std::runtime_error("failed to find suitable memory type!");
+	}
+
+	/*
+	The ring is one buffer in readable host memory, createTextureImageFromSource decodes
+	into it and builds the CPU mip chain in place. It is mapped for as long as it
+	lives, like every host visible allocation.
+	*/
+	void createStagingRing()
+	{
+		createBuffer(STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, readableStagingProperties(),
+			stagingRingBuffer, stagingRingMemory, true);
+		stagingRing.init(device, stagingRingBuffer, static_cast<uint8_t*>(stagingRingMemory.mapped), STAGING_RING_SIZE);
+	}
+
+	/*
+	Staging memory for an upload of size bytes, from the ring unless the upload is bigger
+	than the whole ring. Hand it back with releaseStaging once the copy is submitted.
+	*/
+	StagingRegion acquireStaging(VkDeviceSize size)
+	{
+		if (size <= stagingRing.size())
+		{
+			// an open batch holds on to its staging, so it has to go before the ring waits for it
+			if (uploadBatchOpen() && !stagingRing.fits(size))
+			{
+				submitUploadBatch();
+				beginUploadBatch();
+			}
+			return stagingRing.allocate(size);
+		}
+		stagingRing.stats.oversizeUploads++;
+		return acquireTemporaryStaging(size);
+	}
+
+	/*
+	A staging buffer of its own, for uploads bigger than the ring and for staging held
+	longer than the ring can wait for, like the streamed texture levels. Handed back
+	with releaseStaging like a ring region.
+	*/
+	StagingRegion acquireTemporaryStaging(VkDeviceSize size)
+	{
+		StagingRegion region{};
+		region.size = size;
+		createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, readableStagingProperties(), region.buffer, region.memory, true);
+		region.mapped = static_cast<uint8_t*>(region.memory.mapped);
+		stagingRing.stats.uploads++;
+		stagingRing.stats.bytesStaged += size;
+		return region;
+	}
+
+	/*
+	The copy from region was submitted with fence or is the asynchronous upload with
+	token upload. Neither when it already finished, or when it went into the open
+	upload batch, which hands region back once it is submitted.
+	*/
+	void releaseStaging(StagingRegion& region, VkFence fence, UploadToken upload = 0)
+	{
+		releaseStaging(region, fence, upload != 0 ? uploadTimeline : VK_NULL_HANDLE, upload);
+	}
+
+	// the same for a copy that is done once the timeline semaphore reached value, like a frame's on frameTimeline
+	void releaseStaging(StagingRegion& region, VkFence fence, VkSemaphore semaphore, uint64_t value)
+	{
+		if (fence == VK_NULL_HANDLE && semaphore == VK_NULL_HANDLE && uploadBatchOpen())
+		{
+			uploadBatch.graphicsStaging.push_back(region);
+		}
+		else if (region.memory.memory == VK_NULL_HANDLE)
+		{
+			stagingRing.release(region, fence, semaphore, value);
+		}
+		else if (fence == VK_NULL_HANDLE && semaphore == VK_NULL_HANDLE)
+		{
+			vkDestroyBuffer(device, region.buffer, nullptr);
+			memoryAllocator.free(region.memory);
+		}
+		else
+		{
+			temporaryStaging.emplace_back(region, fence, semaphore, value);
+		}
+		region = {};
+	}
+
+	// region is read by the frame being recorded, and free again once that frame completed
+	void releaseStagingAfterFrame(StagingRegion& region)
+	{
+		if (settings.timelineFrameSync)
+		{
+			releaseStaging(region, VK_NULL_HANDLE, frameTimeline, frameSubmitValues[currentFrame]);
+		}
+		else
+		{
+			releaseStaging(region, inFlightFences[currentFrame]);
+		}
+	}
+
+	/*
+	Called after waiting for a frame: frees the staging memory of the copies that
+	finished, and whatever the finished upload batches held on to.
+	*/
+	void retireStaging()
+	{
+		// the staging lets go of a batch's fence before the fence is destroyed
+		auto finished{ std::partition(submittedUploadBatches.begin(), submittedUploadBatches.end(),
+			[this](const UploadBatch& batch) { return vkGetFenceStatus(device, batch.fence) != VK_SUCCESS; }) };
+		stagingRing.retire();
+		std::erase_if(temporaryStaging, [this](std::tuple<StagingRegion, VkFence, VkSemaphore, uint64_t>& staging)
+			{
+				auto& [region, fence, semaphore, value] = staging;
+				if (fence != VK_NULL_HANDLE ? vkGetFenceStatus(device, fence) != VK_SUCCESS : !timelineReached(semaphore, value))
+				{
+					return false;
+				}
+				vkDestroyBuffer(device, region.buffer, nullptr);
+				memoryAllocator.free(region.memory);
+				return true;
+			});
+		reclaimUploadCommandBuffers();
+		for (auto batch{ finished }; batch != submittedUploadBatches.end(); ++batch)
+		{
+			for (std::function<void()>& release : batch->onComplete)
+			{
+				release();
+			}
+			vkFreeCommandBuffers(device, commandPool, 1, &batch->graphicsCommands);
+			vkDestroyFence(device, batch->fence, nullptr);
+		}
+		submittedUploadBatches.erase(finished, submittedUploadBatches.end());
+	}
+
+	void createUploadObjects()
+	{
+		if (!asyncUploadsSupported)
+		{
+			return;
+		}
+		// every upload command buffer is recorded once and freed when its upload completed
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = uploadQueueFamily;
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &uploadCommandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload command pool!");
+		}
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &uploadTimeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload timeline semaphore!");
+		}
+	}
+
+	bool uploadComplete(UploadToken upload)
+	{
+		return upload == 0 || timelineReached(uploadTimeline, upload);
+	}
+
+	// whether the timeline semaphore got to value, true without one
+	bool timelineReached(VkSemaphore semaphore, uint64_t value)
+	{
+		if (semaphore == VK_NULL_HANDLE)
+		{
+			return true;
+		}
+		uint64_t counter;
+		vkGetSemaphoreCounterValue(device, semaphore, &counter);
+		return counter >= value;
+	}
+
+	// blocks the CPU until the upload finished, for code that needs the result on the host side
+	void waitForUpload(UploadToken upload)
+	{
+		if (upload == 0)
+		{
+			return;
+		}
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &uploadTimeline;
+		waitInfo.pValues = &upload;
+		vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+	}
+
+	void reclaimUploadCommandBuffers()
+	{
+		std::erase_if(uploadCommandBuffers, [this](std::pair<VkCommandBuffer, UploadToken>& upload)
+			{
+				if (!uploadComplete(upload.second))
+				{
+					return false;
+				}
+				vkFreeCommandBuffers(device, uploadCommandPool, 1, &upload.first);
+				return true;
+			});
+	}
+
+	bool uploadBatchOpen() const
+	{
+		return uploadBatch.graphicsCommands != VK_NULL_HANDLE;
+	}
+
+	/*
+	Until submitUploadBatch the single time commands and the uploads are recorded into
+	the batch instead of each being submitted on its own, and the staging they read is
+	held until the batch is submitted. The upload tokens handed out meanwhile are all the
+	batch's one. Startup uses it for all of its transfers, mip chains and layout changes.
+	*/
+	void beginUploadBatch()
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = commandPool;
+		allocInfo.commandBufferCount = 1;
+		vkAllocateCommandBuffers(device, &allocInfo, &uploadBatch.graphicsCommands);
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(uploadBatch.graphicsCommands, &beginInfo);
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (vkCreateFence(device, &fenceInfo, nullptr, &uploadBatch.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create upload batch fence!");
+		}
+	}
+
+	// the command buffer the open batch records uploads into, on the transfer family if there is one
+	VkCommandBuffer batchUploadCommands()
+	{
+		if (uploadQueueFamily == graphicsQueueFamily)
+		{
+			return uploadBatch.graphicsCommands;
+		}
+		if (uploadBatch.uploadCommands == VK_NULL_HANDLE)
+		{
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandPool = uploadCommandPool;
+			allocInfo.commandBufferCount = 1;
+			vkAllocateCommandBuffers(device, &allocInfo, &uploadBatch.uploadCommands);
+			VkCommandBufferBeginInfo beginInfo{};
+			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			vkBeginCommandBuffer(uploadBatch.uploadCommands, &beginInfo);
+		}
+		return uploadBatch.uploadCommands;
+	}
+
+	/*
+	Submits the open batch: the transfer family part signals the batch's upload value,
+	the graphics part the fence (and the upload value when the uploads are in it). No
+	wait, retireStaging cleans up after the batch once the fence signaled.
+	*/
+	void submitUploadBatch()
+	{
+		UploadBatch batch{ std::move(uploadBatch) };
+		uploadBatch = {};
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &batch.upload;
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &uploadTimeline;
+		if (batch.uploadCommands != VK_NULL_HANDLE)
+		{
+			vkEndCommandBuffer(batch.uploadCommands);
+			submitInfo.pCommandBuffers = &batch.uploadCommands;
+			if (vkQueueSubmit(uploadQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to submit upload batch!");
+			}
+			uploadCommandBuffers.emplace_back(batch.uploadCommands, batch.upload);
+			uploadStats.submissions++;
+			uploadStats.queueSubmits++;
+		}
+
+		/*
+		The frames after the batch are submitted to the same queue, so one barrier at its
+		end makes everything it wrote available to them. The single time commands relied
+		on vkQueueWaitIdle for that.
+		*/
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		vkCmdPipelineBarrier(batch.graphicsCommands, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+			1, &barrier, 0, nullptr, 0, nullptr);
+		vkEndCommandBuffer(batch.graphicsCommands);
+		bool signalUpload{ batch.upload != 0 && batch.uploadCommands == VK_NULL_HANDLE };
+		submitInfo.pNext = signalUpload ? &timelineInfo : nullptr;
+		submitInfo.signalSemaphoreCount = signalUpload ? 1 : 0;
+		submitInfo.pCommandBuffers = &batch.graphicsCommands;
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit upload batch!");
+		}
+		uploadStats.queueSubmits++;
+
+		for (StagingRegion& region : batch.graphicsStaging)
+		{
+			releaseStaging(region, batch.fence);
+		}
+		for (StagingRegion& region : batch.uploadStaging)
+		{
+			releaseStaging(region, VK_NULL_HANDLE, batch.upload);
+		}
+		batch.graphicsStaging.clear();
+		batch.uploadStaging.clear();
+		submittedUploadBatches.push_back(std::move(batch));
+	}
+
+	// runs release once the commands recorded so far completed, right away outside an upload batch
+	void whenUploadsComplete(std::function<void()> release)
+	{
+		if (uploadBatchOpen())
+		{
+			uploadBatch.onComplete.push_back(std::move(release));
+		}
+		else
+		{
+			release();
+		}
+	}
+
+	/*
+	Records the commands of one upload with record, submits them to the upload queue
+	without waiting and hands staging back to the ring until they finished. The
+	submission signals the next value of uploadTimeline, which is returned. Uploads
+	complete in submission order, so a token also stands for every upload before it.
+	*/
+	template<typename Record>
+	UploadToken submitUpload(StagingRegion& staging, Record&& record)
+	{
+		if (uploadBatchOpen())
+		{
+			record(batchUploadCommands());
+			uploadStats.operations++;
+			if (uploadBatch.upload == 0)
+			{
+				uploadBatch.upload = ++uploadTimelineValue;
+			}
+			uploadBatch.uploadStaging.push_back(staging);
+			staging = {};
+			return uploadBatch.upload;
+		}
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = uploadCommandPool;
+		allocInfo.commandBufferCount = 1;
+		VkCommandBuffer commandBuffer;
+		vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		record(commandBuffer);
+		vkEndCommandBuffer(commandBuffer);
+
+		UploadToken upload{ ++uploadTimelineValue };
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &upload;
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &uploadTimeline;
+		if (vkQueueSubmit(uploadQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to submit upload command buffer!");
+		}
+		uploadCommandBuffers.emplace_back(commandBuffer, upload);
+		uploadStats.submissions++;
+		uploadStats.operations++;
+		uploadStats.queueSubmits++;
+		releaseStaging(staging, VK_NULL_HANDLE, upload);
+		return upload;
+	}
+
+	/*
+	The stages the frames use uploaded resources in, the upload waits and acquire barriers
+	use them. Transfer is for the texture streaming copies into the uploaded image.
+	*/
+	VkPipelineStageFlags uploadConsumerStages() const
+	{
+		return VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | (meshShadingSupported ? VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT : 0);
+	}
+
+	/*
+	Copies the first size bytes of staging into buffer and hands staging back. With async
+	uploads the copy runs on the upload queue and the returned token says when it is
+	done, otherwise the copy has finished when this returns 0. A buffer copied on the
+	transfer family is released there, the next frame acquires it, see recordUploadAcquires.
+	*/
+	UploadToken uploadBuffer(StagingRegion& staging, VkBuffer buffer, VkDeviceSize size)
+	{
+		if (!asyncUploadsSupported)
+		{
+			copyBuffer(staging.buffer, buffer, size, staging.offset);
+			releaseStaging(staging, VK_NULL_HANDLE);
+			return 0;
+		}
+		bool transferOwnership{ uploadQueueFamily != graphicsQueueFamily };
+		VkBufferMemoryBarrier ownership{};
+		ownership.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		ownership.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		ownership.srcQueueFamilyIndex = uploadQueueFamily;
+		ownership.dstQueueFamilyIndex = graphicsQueueFamily;
+		ownership.buffer = buffer;
+		ownership.offset = 0;
+		ownership.size = VK_WHOLE_SIZE;
+		UploadToken upload{ submitUpload(staging, [&](VkCommandBuffer commandBuffer)
+			{
+				VkBufferCopy copyRegion{};
+				copyRegion.srcOffset = staging.offset;
+				copyRegion.size = size;
+				vkCmdCopyBuffer(commandBuffer, staging.buffer, buffer, 1, &copyRegion);
+				// the release half of the ownership transfer, the destination access is up to the acquire
+				if (transferOwnership)
+				{
+					vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+						0, nullptr, 1, &ownership, 0, nullptr);
+				}
+			}) };
+		if (transferOwnership)
+		{
+			ownership.srcAccessMask = 0;
+			ownership.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+			pendingBufferAcquires.push_back(ownership);
+			pendingAcquireUpload = upload;
+			uploadStats.ownershipTransfers++;
+		}
+		return upload;
+	}
+
+	/*
+	Called at the start of a frame's command buffer, before anything uses the uploaded
+	resources: the acquire half of their ownership transfers. The frame's submission
+	waits for pendingAcquireUpload at uploadConsumerStages, which the barriers start from.
+	*/
+	// returns whether there were barriers to record
+	bool recordUploadAcquires(VkCommandBuffer commandBuffer)
+	{
+		if (pendingBufferAcquires.empty() && pendingImageAcquires.empty())
+		{
+			return false;
+		}
+		vkCmdPipelineBarrier(commandBuffer, uploadConsumerStages(), uploadConsumerStages(), 0,
+			0, nullptr, static_cast<uint32_t>(pendingBufferAcquires.size()), pendingBufferAcquires.data(),
+			static_cast<uint32_t>(pendingImageAcquires.size()), pendingImageAcquires.data());
+		pendingBufferAcquires.clear();
+		pendingImageAcquires.clear();
+		return true;
+	}
+
+	/*
+	The upload this frame has to wait for: the latest one of the resources it draws with
+	that did not complete yet, and the one the acquire barriers recorded into it belong to.
+	Uploads of resources the frame doesn't use never hold it up.
+	*/
+	UploadToken frameUploadWait(UploadToken acquireUpload)
+	{
+		UploadToken wait{ acquireUpload };
+		for (UploadToken* upload : { &vertexBufferUpload, &indexBufferUpload, &textureUpload, &meshletBufferUpload })
+		{
+			if (uploadComplete(*upload))
 			{
-				return i;
+				*upload = 0;
 			}
+			wait = std::max(wait, *upload);
 		}
-		throw std::runtime_error("failed to find suitable memory type!");
+		return wait;
 	}
 
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0)
 	{
 		VkCommandBuffer commandBuffer{ beginSingleTimeCommands() };
 
 		VkBufferCopy copyRegion{};
-		copyRegion.srcOffset = 0;
+		copyRegion.srcOffset = srcOffset;
 		copyRegion.dstOffset = 0;
 		copyRegion.size = size;
 		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
@@ -2957,6 +10113,11 @@ private:
 
 	VkCommandBuffer beginSingleTimeCommands()
 	{
+		// recorded after whatever the open upload batch holds, see beginUploadBatch
+		if (uploadBatchOpen())
+		{
+			return uploadBatch.graphicsCommands;
+		}
 		VkCommandBufferAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -2982,6 +10143,11 @@ private:
 
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer)
 	{
+		uploadStats.operations++;
+		if (commandBuffer == uploadBatch.graphicsCommands)
+		{
+			return;
+		}
 		vkEndCommandBuffer(commandBuffer);
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -2995,6 +10161,7 @@ private:
 		implementation is not required to explicitly list it in queueFlags in those cases.
 		*/
 		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		uploadStats.queueSubmits++;
 		/*
 		Unlike the draw commands, there are no events we need to wait on this time.
 		We just want to execute the transfer on the buffers immediately. There are
@@ -3011,73 +10178,70 @@ private:
 
 	void createIndexBuffer()
 	{
-		VkDeviceSize bufferSize{ sizeof(indices[0]) * indices.size() };
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
+		std::span<const std::byte> indexBytes{ indexType == VK_INDEX_TYPE_UINT16 ?
+			std::as_bytes(std::span<const uint16_t>(indices16)) : std::as_bytes(indexData) };
+		VkDeviceSize bufferSize{ indexBytes.size() };
 
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			stagingBuffer, stagingBufferMemory);
-
-		void* data;
-		vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+		StagingRegion staging{ acquireStaging(bufferSize) };
 
-		memcpy(data, indices.data(), (size_t)bufferSize);
-		vkUnmapMemory(device, stagingBufferMemory);
+		memcpy(staging.mapped, indexBytes.data(), (size_t)bufferSize);
 
 		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			indexBuffer, indexBufferMemory);
 
-		copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-		vkDestroyBuffer(device, stagingBuffer, nullptr);
-		vkFreeMemory(device, stagingBufferMemory, nullptr);
+		indexBufferUpload = uploadBuffer(staging, indexBuffer, bufferSize);
 	}
 
+	/*
+	One buffer for the uniform data of every frame in flight instead of one per frame,
+	each frame allocates its uniforms from its own region of it, see UniformArena.
+	*/
 	void createUniformBuffers()
 	{
-		VkDeviceSize bufferSize{ sizeof(UniformBufferObject) };
-		uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-		uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-		uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
-
-		for (size_t i{ 0 }; i < MAX_FRAMES_IN_FLIGHT; i++)
-		{
-			createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-				uniformBuffers[i], uniformBuffersMemory[i]);
-			/*
-			We map the buffer right after creation using vkMapMemory to get a pointer
-			to which we can write the data later on. The buffer stays mapped to this
-			pointer for the application’s whole lifetime. This technique is called “persistent
-			mapping” and works on all Vulkan implementations. Not having to map the
-			buffer every time we need to update it increases performances, as mapping is
-			not free.
-			*/
-			vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
-		}
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		VkDeviceSize alignment{ properties.limits.minUniformBufferOffsetAlignment };
+		// a frame takes one FrameUniforms and, without push constants, the DrawUniforms of every object
+		VkDeviceSize frameUniformsSize{ (sizeof(FrameUniforms) + alignment - 1) & ~(alignment - 1) };
+		VkDeviceSize objectSize{ (sizeof(DrawUniforms) + alignment - 1) & ~(alignment - 1) };
+		VkDeviceSize frameSize{ std::max(UNIFORM_ARENA_FRAME_SIZE & ~(alignment - 1), frameUniformsSize + settings.objectCount * objectSize) };
+		createBuffer(frameSize * settings.framesInFlight, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			uniformArenaBuffer, uniformArenaMemory);
+		/*
+		The allocator maps the buffer's memory block right after creation to get a pointer
+		to which we can write the data later on. The buffer stays mapped to this
+		pointer for the application’s whole lifetime. This technique is called “persistent
+		mapping” and works on all Vulkan implementations. Not having to map the
+		buffer every time we need to update it increases performances, as mapping is
+		not free.
+		*/
+		uniformArena.init(static_cast<uint8_t*>(uniformArenaMemory.mapped), frameSize, alignment);
 	}
 
 	void createDescriptorPool()
 	{
-		std::array< VkDescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+		std::array< VkDescriptorPoolSize, 3> poolSizes{};
+		// FrameUniforms and DrawUniforms
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSizes[0].descriptorCount = 2 * settings.framesInFlight;
 		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+		poolSizes[1].descriptorCount = settings.framesInFlight;
+		// the five storage buffers of the mesh shader path
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[2].descriptorCount = 5 * settings.framesInFlight;
 
 		VkDescriptorPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = 1;
+		poolInfo.poolSizeCount = meshShadingSupported ? 3 : 2;
 		poolInfo.pPoolSizes = poolSizes.data();
 		/*
 		Aside from the maximum number of individual descriptors that are available,
 		we also need to specify the maximum number of descriptor sets that may be
 		allocated:
 		*/
-		poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+		poolInfo.maxSets = settings.framesInFlight;
 		/*
 		The structure has an optional flag similar to command pools that determines if
 		individual descriptor sets can be freed or not: VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT.
@@ -3095,7 +10259,7 @@ private:
 	void createDescriptorSets()
 	{
 		//In our case we will create one descriptor set for each frame in flight, all with the same layout.
-		std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+		std::vector<VkDescriptorSetLayout> layouts(settings.framesInFlight, descriptorSetLayout);
 		/*
 		A descriptor set allocation is described with a VkDescriptorSetAllocateInfo
 		struct. You need to specify the descriptor pool to allocate from, the number of
@@ -3104,10 +10268,11 @@ private:
 		VkDescriptorSetAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+		allocInfo.descriptorSetCount = settings.framesInFlight;
 		allocInfo.pSetLayouts = layouts.data();
 
-		descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+		descriptorSets.resize(settings.framesInFlight);
+		descriptorSetTextureLevel.assign(settings.framesInFlight, streamingUploadedLevel);
 		if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to create descriptor sets!");
@@ -3119,7 +10284,7 @@ private:
 		uniform buffer descriptor
 		*/
 
-		for (size_t i{0}; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (size_t i{0}; i < settings.framesInFlight; i++)
 		{
 			/*
 			Descriptors that refer to buffers, like our uniform buffer descriptor, are configured
@@ -3127,25 +10292,26 @@ private:
 			and the region within it that contains the data for the descriptor.
 			*/
 			VkDescriptorBufferInfo bufferInfo{};
-			bufferInfo.buffer = uniformBuffers[i];
-			bufferInfo.offset = 0;
+			bufferInfo.buffer = uniformArenaBuffer;
 			/*
-			If you’re overwriting the whole buffer, like we are in this case, then it is also
-			possible to use the VK_WHOLE_SIZE value for the range.
+			The binding is dynamic, the offset of the FrameUniforms a draw reads is given
+			when the set is bound and added to this one. So is the one of its DrawUniforms.
 			*/
-			bufferInfo.range = sizeof(UniformBufferObject);
+			bufferInfo.offset = 0;
+			bufferInfo.range = sizeof(FrameUniforms);
+			VkDescriptorBufferInfo drawBufferInfo{ uniformArenaBuffer, 0, sizeof(DrawUniforms) };
 
 			VkDescriptorImageInfo imageInfo{};
 			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 			imageInfo.imageView = textureImageView;
-			imageInfo.sampler = textureSampler;
+			imageInfo.sampler = streamingUploadedLevel == 0 ? textureSampler : textureLodSamplers[streamingUploadedLevel];
 
 			/*
 			The configuration of descriptors
 			is updated using the vkUpdateDescriptorSets function, which takes
 			an array of VkWriteDescriptorSet structs as parameter.
 			*/
-			std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+			std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
 			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 			/*
 			We gave our uniform buffer binding index 0. Remember that descriptors can be
@@ -3156,85 +10322,531 @@ private:
 			descriptorWrites[0].dstBinding = 0;
 			descriptorWrites[0].dstArrayElement = 0;
 
-			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptorWrites[0].descriptorCount = 1;
-			/*
-			The last field references an array with descriptorCount structs that actually
-			configure the descriptors. It depends on the type of descriptor which one of the
-			three you actually need to use. The pBufferInfo field is used for descriptors
-			that refer to buffer data, pImageInfo is used for descriptors that refer to image
-			data, and pTexelBufferView is used for descriptors that refer to buffer views.
-			Our descriptor is based on buffers, so we’re using pBufferInfo.
-			*/
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
+			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			descriptorWrites[0].descriptorCount = 1;
+			/*
+			The last field references an array with descriptorCount structs that actually
+			configure the descriptors. It depends on the type of descriptor which one of the
+			three you actually need to use. The pBufferInfo field is used for descriptors
+			that refer to buffer data, pImageInfo is used for descriptors that refer to image
+			data, and pTexelBufferView is used for descriptors that refer to buffer views.
+			Our descriptor is based on buffers, so we’re using pBufferInfo.
+			*/
+			descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[1].dstSet = descriptorSets[i];
+			descriptorWrites[1].dstBinding = 1;
+			descriptorWrites[1].dstArrayElement = 0;
+			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptorWrites[1].descriptorCount = 1;
+			descriptorWrites[1].pImageInfo = &imageInfo;
+
+			descriptorWrites[2] = descriptorWrites[0];
+			descriptorWrites[2].dstBinding = 7;
+			descriptorWrites[2].pBufferInfo = &drawBufferInfo;
+
+			/*
+			The updates are applied using vkUpdateDescriptorSets. It accepts two kinds
+			of arrays as parameters: an array of VkWriteDescriptorSet and an array of
+			VkCopyDescriptorSet. The latter can be used to copy descriptors to each other,
+			as its name implies.
+			*/
+			vkUpdateDescriptorSets(device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+
+			if (meshShadingSupported)
+			{
+				std::array<VkDescriptorBufferInfo, 5> storageInfos{ {
+					{ meshletBuffer, 0, VK_WHOLE_SIZE },
+					{ meshletVertexBuffer, 0, VK_WHOLE_SIZE },
+					{ meshletTriangleBuffer, 0, VK_WHOLE_SIZE },
+					{ vertexBuffer, 0, VK_WHOLE_SIZE },
+					{ visibleMeshletBuffers[i], 0, VK_WHOLE_SIZE }
+				} };
+				std::array<VkWriteDescriptorSet, 5> storageWrites{};
+				for (uint32_t j = 0; j < storageWrites.size(); j++)
+				{
+					storageWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					storageWrites[j].dstSet = descriptorSets[i];
+					storageWrites[j].dstBinding = 2 + j;
+					storageWrites[j].dstArrayElement = 0;
+					storageWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					storageWrites[j].descriptorCount = 1;
+					storageWrites[j].pBufferInfo = &storageInfos[j];
+				}
+				vkUpdateDescriptorSets(device, storageWrites.size(), storageWrites.data(), 0, nullptr);
+			}
+		}
+	}
+
+	void createCommandBuffers()
+	{
+		commandBuffers.resize(settings.framesInFlight);
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		/*
+		The level parameter specifies if the allocated command buffers are primary or
+		secondary command buffers.
+		• VK_COMMAND_BUFFER_LEVEL_PRIMARY: Can be submitted to a queue for
+		execution, but cannot be called from other command buffers.
+		• VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly,
+		but can be called from primary command buffers. Is helpful to reuse
+		common operations from primary command buffers.
+		*/
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
+
+		if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command buffer!");
+		}
+		allocateRecordedCommandBuffers();
+	}
+
+	/*
+	One command buffer per frame in flight and swap chain image, all empty. Also frees
+	the previous ones, so only call it while none of them is pending.
+	*/
+	void allocateRecordedCommandBuffers()
+	{
+		for (RecordedCommandBuffer& recorded : recordedCommandBuffers)
+		{
+			vkFreeCommandBuffers(device, commandPool, 1, &recorded.commandBuffer);
+		}
+		recordedCommandBuffers.clear();
+		if (!settings.cacheCommandBuffers)
+		{
+			return;
+		}
+		std::vector<VkCommandBuffer> allocated(settings.framesInFlight * swapChainImages.size());
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = static_cast<uint32_t>(allocated.size());
+		if (vkAllocateCommandBuffers(device, &allocInfo, allocated.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command buffer!");
+		}
+		for (VkCommandBuffer commandBuffer : allocated)
+		{
+			recordedCommandBuffers.push_back({ commandBuffer });
+		}
+	}
+
+	/*
+	A pool and a secondary command buffer for every recording thread of every frame in
+	flight. Cached command buffers are recorded inline: a reused primary would still
+	point at secondaries that the next recording of its frame resets.
+	*/
+	void createRecordingCommandPools()
+	{
+		if (settings.recordThreads == 0 || settings.cacheCommandBuffers)
+		{
+			return;
+		}
+		recordingWorkers = std::make_unique<WorkerPool>(settings.recordThreads);
+		recordingCommandPools.resize(settings.framesInFlight * settings.recordThreads);
+		recordingCommandBuffers.resize(recordingCommandPools.size());
+		for (size_t i = 0; i < recordingCommandPools.size(); i++)
+		{
+			createSecondaryCommandBuffer(recordingCommandPools[i], recordingCommandBuffers[i]);
+		}
+	}
+
+	// reset as a whole every time, so the pool doesn't need per buffer resets
+	void createSecondaryCommandBuffer(VkCommandPool& pool, VkCommandBuffer& commandBuffer)
+	{
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		poolInfo.queueFamilyIndex = graphicsQueueFamily;
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command pool!");
+		}
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = pool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+		allocInfo.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create command buffer!");
+		}
+	}
+
+	/*
+	Whether the command buffer recorded for this frame and image can be submitted again.
+	Push constants carry this frame's matrices in the commands, and one-off commands like
+	the upload acquires or a streamed level need a fresh recording.
+	*/
+	bool canReuseCommandBuffer(const RecordedCommandBuffer& recorded)
+	{
+		return !settings.pushTransforms && recorded.generation == commandBufferGeneration && recorded.lod == currentLod &&
+			recorded.frameUniformOffset == frameUniformOffset && recorded.drawUniformOffsets == drawUniformOffsets &&
+			pendingBufferAcquires.empty() && pendingImageAcquires.empty() && !textureStreamingPending();
+	}
+
+	void createSyncObjects()
+	{
+		frameInputTimes.assign(settings.framesInFlight, {});
+		frameSubmitValues.assign(settings.framesInFlight, 0);
+		imageAvailableSemaphores.resize(settings.framesInFlight);
+		renderFinishedSemaphores.resize(settings.framesInFlight);
+		inFlightFences.resize(settings.timelineFrameSync ? 0 : settings.framesInFlight);
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		// so that the draw call does not wait on the frame which doesn't exits when doing the 1st frame
+		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		for (size_t i{ 0 }; i < settings.framesInFlight; i++)
+		{
+			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+				vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+				(!settings.timelineFrameSync && vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS))
+			{
+				throw std::runtime_error("failed to create semaphores!");
+			}
+		}
+
+		/*
+		The acquire and present semaphores have to stay binary, only the completion of
+		the frames moves to the timeline. It starts at 0, which no frame waits for, so
+		like the signaled fences the first frames don't wait.
+		*/
+		if (settings.timelineFrameSync)
+		{
+			VkSemaphoreTypeCreateInfo typeInfo{};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			typeInfo.initialValue = 0;
+			semaphoreInfo.pNext = &typeInfo;
+			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &frameTimeline) != VK_SUCCESS)
+			{
+				throw std::runtime_error("failed to create frame timeline semaphore!");
+			}
+		}
+	}
+
+	// whether frame number frame of the run completed on the GPU, any frame and not only the ones in flight
+	bool frameComplete(uint64_t frame)
+	{
+		if (settings.timelineFrameSync)
+		{
+			return timelineReached(frameTimeline, frame);
+		}
+		for (uint32_t slot = 0; slot < settings.framesInFlight; slot++)
+		{
+			if (frameSubmitValues[slot] == frame)
+			{
+				return vkGetFenceStatus(device, inFlightFences[slot]) == VK_SUCCESS;
+			}
+		}
+		// a frame that left its slot was waited for before the next one took it
+		return frame <= frameTimelineValue;
+	}
+
+	// blocks the CPU until frame number frame completed, 0 returns right away
+	void waitForFrame(uint64_t frame)
+	{
+		if (frame == 0)
+		{
+			return;
+		}
+		if (settings.timelineFrameSync)
+		{
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &frameTimeline;
+			waitInfo.pValues = &frame;
+			vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+			return;
+		}
+		for (uint32_t slot = 0; slot < settings.framesInFlight; slot++)
+		{
+			if (frameSubmitValues[slot] == frame)
+			{
+				vkWaitForFences(device, 1, &inFlightFences[slot], VK_TRUE, UINT64_MAX);
+			}
+		}
+	}
+
+	// one pipeline statistics query per frame in flight, around its render pass
+	void createStatisticsQueryPool()
+	{
+		if (!pipelineStatisticsSupported)
+		{
+			return;
+		}
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		queryPoolInfo.queryCount = settings.framesInFlight;
+		statisticsQueryPending.assign(settings.framesInFlight, false);
+		queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT;
+		if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &statisticsQueryPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create query pool!");
+		}
+	}
+
+	// after the frame's fence, so the query of its last submission is available
+	void readStatisticsQuery(uint32_t frame)
+	{
+		if (!statisticsQueryPending[frame])
+		{
+			return;
+		}
+		uint64_t vertexInvocations{ 0 };
+		if (vkGetQueryPoolResults(device, statisticsQueryPool, frame, 1, sizeof(vertexInvocations), &vertexInvocations,
+			sizeof(vertexInvocations), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		{
+			transformStats.vertexInvocations += vertexInvocations;
+			transformStats.queriedFrames++;
+		}
+		statisticsQueryPending[frame] = false;
+	}
+
+	// the dynamic offsets of bindings 0 and 7 for drawing object
+	std::array<uint32_t, 2> uniformOffsets(uint32_t object) const
+	{
+		return { frameUniformOffset, drawUniformOffsets[object] };
+	}
+
+	// points the vertex shader at the transform of object, see updateUniformBuffer
+	void bindObjectTransform(VkCommandBuffer commandBuffer, uint32_t object)
+	{
+		if (settings.pushTransforms)
+		{
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+				sizeof(DrawPushConstants), &drawPushConstants[object]);
+		}
+		else
+		{
+			std::array<uint32_t, 2> offsets{ uniformOffsets(object) };
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+				0, 1, &descriptorSets[currentFrame], offsets.size(), offsets.data());
+		}
+	}
+
+	// the state every draw needs, recorded by the primary or by each secondary command buffer
+	void recordDrawState(VkCommandBuffer commandBuffer)
+	{
+		//The second parameter specifies if the pipeline object is a graphics or compute pipeline.
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+
+		VkBuffer vertexBuffers[] = { vertexBuffer };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+		/*
+		You can only have a single index buffer. It’s unfortunately
+		not possible to use different indices for each vertex attribute, so we do still
+		have to completely duplicate vertex data even if just one attribute varies.
+		*/
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, indexType);
+
+		/*
+		we did specify viewport and scissor
+		state for this pipeline to be dynamic. So we need to set them in the command
+		buffer before issuing our draw command:
+		*/
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = swapChainExtent.width;
+		viewport.height = swapChainExtent.height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor{};
+		scissor.offset = { 0, 0 };
+		scissor.extent = swapChainExtent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		/*
+		bind the right descriptor set for each frame to the descriptors in the
+		shader with vkCmdBindDescriptorSets. This needs to be done before the
+		vkCmdDrawIndexed call
+
+		Unlike vertex and index buffers, descriptor sets are not unique to graphics
+		pipelines. Therefore we need to specify if we want to bind descriptor sets to
+		the graphics or compute pipeline. The next parameter is the layout that the
+		descriptors are based on. The next three parameters specify the index of the
+		first descriptor set, the number of sets to bind, and the array of sets to bind.
+		The last two parameters specify an array
+		of offsets that are used for dynamic descriptors. We’ll look at these in a future
+		chapter.
+		The uniform buffer bindings are two of those, their offsets pick this frame's
+		FrameUniforms and the first object's DrawUniforms out of the uniform arena.
+		*/
+		std::array<uint32_t, 2> offsets{ uniformOffsets(0) };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+			0, 1, &descriptorSets[currentFrame], offsets.size(), offsets.data());
+	}
 
-			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pImageInfo = &imageInfo;
+	/*
+	Otherwise the meshlets of the one object are culled, see collectDraws. The culled
+	meshlets are also the only thing the mesh shader draws, so more objects or cached
+	command buffers go back to index buffer draws even with settings.meshShading.
+	*/
+	bool drawsWholeLods()
+	{
+		return !enableMeshletCulling || settings.objectCount > 1 || settings.cacheCommandBuffers;
+	}
 
-			/*
-			The updates are applied using vkUpdateDescriptorSets. It accepts two kinds
-			of arrays as parameters: an array of VkWriteDescriptorSet and an array of
-			VkCopyDescriptorSet. The latter can be used to copy descriptors to each other,
-			as its name implies.
-			*/
-			vkUpdateDescriptorSets(device, descriptorWrites.size(), descriptorWrites.data(), 0, nullptr);
+	// the visible meshlets go to the mesh shader instead of into index buffer draws
+	bool drawsMeshTasks()
+	{
+		return !drawsWholeLods() && meshShadingSupported;
+	}
+
+	/*
+	Fills frameDraws with this frame's index buffer draws. The meshlets are culled against
+	the model at the origin, so a grid of objects draws every one of them with the whole
+	LOD instead, each with its own transform. So do cached command buffers: the culling
+	result changes with every frame's rotation. With one object the visible meshlets that
+	follow each other in the index buffer go into one draw.
+	*/
+	void collectDraws()
+	{
+		frameDraws.clear();
+		if (drawsWholeLods())
+		{
+			for (uint32_t object = 0; object < settings.objectCount; object++)
+			{
+				for (uint32_t i = lodFirstSubMesh[currentLod]; i < lodFirstSubMesh[currentLod + 1]; i++)
+				{
+					const SubMesh& subMesh{ subMeshes[i] };
+					frameDraws.push_back({ object, subMesh.indexCount, subMesh.firstIndex, subMesh.vertexOffset });
+				}
+			}
+		}
+		else
+		{
+			cullMeshlets();
+			const std::vector<Meshlet>& meshlets{ meshletData.meshlets };
+			for (size_t i = 0; i < visibleMeshlets.size();)
+			{
+				const Meshlet& first{ meshlets[visibleMeshlets[i]] };
+				uint32_t drawIndexCount{ first.indexCount };
+				for (i++; i < visibleMeshlets.size(); i++)
+				{
+					const Meshlet& next{ meshlets[visibleMeshlets[i]] };
+					if (next.vertexOffset != first.vertexOffset || next.firstIndex != first.firstIndex + drawIndexCount)
+					{
+						break;
+					}
+					drawIndexCount += next.indexCount;
+				}
+				frameDraws.push_back({ 0, drawIndexCount, first.firstIndex, first.vertexOffset });
+			}
+			meshletStats.draws += frameDraws.size();
 		}
+		transformStats.draws += frameDraws.size();
 	}
 
-	void createCommandBuffers()
+	// frameDraws[begin] up to (excluding) frameDraws[end], after recordDrawState
+	void recordDraws(VkCommandBuffer commandBuffer, size_t begin, size_t end)
 	{
-		commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
 		/*
-		The level parameter specifies if the allocated command buffers are primary or
-		secondary command buffers.
-		• VK_COMMAND_BUFFER_LEVEL_PRIMARY: Can be submitted to a queue for
-		execution, but cannot be called from other command buffers.
-		• VK_COMMAND_BUFFER_LEVEL_SECONDARY: Cannot be submitted directly,
-		but can be called from primary command buffers. Is helpful to reuse
-		common operations from primary command buffers.
+		The first two parameters
+		specify the number of indices and the number of instances. We’re not using
+		instancing, so just specify 1 instance. The number of indices represents the
+		number of vertices that will be passed to the vertex shader. The next parameter
+		specifies an offset into the index buffer, using a value of 1 would cause the
+		graphics card to start reading at the second index. The second to last parameter
+		specifies an offset to add to the indices in the index buffer. The final parameter
+		specifies an offset for instancing, which we’re not using.
 		*/
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
-
-		if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+		uint32_t boundObject{ UINT32_MAX };
+		for (size_t i = begin; i < end; i++)
 		{
-			throw std::runtime_error("failed to create command buffer!");
+			const IndexedDraw& draw{ frameDraws[i] };
+			if (draw.object != boundObject)
+			{
+				bindObjectTransform(commandBuffer, draw.object);
+				boundObject = draw.object;
+			}
+			vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, draw.vertexOffset, 0);
 		}
 	}
 
-	void createSyncObjects()
+	bool recordsSecondaryDraws()
 	{
-		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-		VkSemaphoreCreateInfo semaphoreInfo{};
-		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-		
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		// so that the draw call does not wait on the frame which doesn't exits when doing the 1st frame
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		return recordingWorkers && !drawsMeshTasks();
+	}
+
+	// secondary command buffers can only run within the query when they inherit it
+	bool statisticsQueryActive()
+	{
+		return statisticsQueryPool != VK_NULL_HANDLE && (!recordsSecondaryDraws() || inheritedQueriesSupported);
+	}
 
-		for (size_t i{ 0 }; i < MAX_FRAMES_IN_FLIGHT; i++)
+	/*
+	Records frameDraws[begin] up to (excluding) frameDraws[end] into commandBuffer, a
+	secondary command buffer of pool that continues the render pass in framebuffer.
+	Only touches the pool and the command buffer, so it runs on any thread.
+	*/
+	void recordSecondary(VkCommandPool pool, VkCommandBuffer commandBuffer, VkFramebuffer framebuffer,
+		size_t begin, size_t end, bool inheritStatisticsQuery)
+	{
+		vkResetCommandPool(device, pool, 0);
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		// optional, but lets the driver know the attachments up front
+		inheritanceInfo.framebuffer = framebuffer;
+		if (inheritStatisticsQuery)
 		{
-			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS)
-			{
-				throw std::runtime_error("failed to create semaphores!");
-			}
+			inheritanceInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT;
+		}
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording command buffer!");
 		}
+		// nothing carries over from the primary, every secondary sets up the state itself
+		recordDrawState(commandBuffer);
+		recordDraws(commandBuffer, begin, end);
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to record command buffer!");
+		}
+	}
+
+	/*
+	Splits frameDraws into one contiguous range per recording thread, has every thread
+	record its range into its secondary command buffer of this frame and executes them
+	in order, so the draws keep the order they would have inline.
+	*/
+	void recordSecondaryDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	{
+		uint32_t threadCount{ recordingWorkers->size() };
+		size_t first{ currentFrame * static_cast<size_t>(threadCount) };
+		size_t drawCount{ frameDraws.size() };
+		bool inheritStatisticsQuery{ statisticsQueryActive() };
+		recordingWorkers->run(threadCount, [&](uint32_t thread)
+			{
+				recordSecondary(recordingCommandPools[first + thread], recordingCommandBuffers[first + thread],
+					swapChainFramebuffers[imageIndex], drawCount * thread / threadCount, drawCount * (thread + 1) / threadCount,
+					inheritStatisticsQuery);
+			});
+		vkCmdExecuteCommands(commandBuffer, threadCount, &recordingCommandBuffers[first]);
 	}
 
-	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+	// returns whether it recorded one-off commands, see canReuseCommandBuffer
+	bool recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
 	{
 		/*
 		We always begin recording a command buffer by calling vkBeginCommandBuffer
@@ -3265,6 +10877,15 @@ private:
 		{
 			throw std::runtime_error("failed to begin recording command buffer!");
 		}
+		bool oneOff{ recordUploadAcquires(commandBuffer) };
+		oneOff = recordTextureStreaming(commandBuffer) || oneOff;
+		// the draws go into secondary command buffers recorded by recordSecondaryDraws
+		bool secondary{ recordsSecondaryDraws() };
+		if (statisticsQueryActive())
+		{
+			vkCmdResetQueryPool(commandBuffer, statisticsQueryPool, currentFrame, 1);
+			vkCmdBeginQuery(commandBuffer, statisticsQueryPool, currentFrame, 0);
+		}
 
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -3310,73 +10931,48 @@ private:
 		• VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS: The render pass
 		commands will be executed from secondary command buffers.
 		*/
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-		//The second parameter specifies if the pipeline object is a graphics or compute pipeline.
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
-		VkBuffer vertexBuffers[] = { vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-		/*
-		You can only have a single index buffer. It’s unfortunately
-		not possible to use different indices for each vertex attribute, so we do still
-		have to completely duplicate vertex data even if just one attribute varies.
-		*/
-		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-
-		/*
-		we did specify viewport and scissor
-		state for this pipeline to be dynamic. So we need to set them in the command
-		buffer before issuing our draw command:
-		*/
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = swapChainExtent.width;
-		viewport.height = swapChainExtent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = swapChainExtent;
-		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-		/*
-		bind the right descriptor set for each frame to the descriptors in the
-		shader with vkCmdBindDescriptorSets. This needs to be done before the
-		vkCmdDrawIndexed call
-
-		Unlike vertex and index buffers, descriptor sets are not unique to graphics
-		pipelines. Therefore we need to specify if we want to bind descriptor sets to
-		the graphics or compute pipeline. The next parameter is the layout that the
-		descriptors are based on. The next three parameters specify the index of the
-		first descriptor set, the number of sets to bind, and the array of sets to bind.
-		The last two parameters specify an array
-		of offsets that are used for dynamic descriptors. We’ll look at these in a future
-		chapter.
-		*/
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-			0, 1, &descriptorSets[currentFrame], 0, nullptr);
-		/*
-		The first two parameters
-		specify the number of indices and the number of instances. We’re not using
-		instancing, so just specify 1 instance. The number of indices represents the
-		number of vertices that will be passed to the vertex shader. The next parameter
-		specifies an offset into the index buffer, using a value of 1 would cause the
-		graphics card to start reading at the second index. The second to last parameter
-		specifies an offset to add to the indices in the index buffer. The final parameter
-		specifies an offset for instancing, which we’re not using.
-		*/
-		vkCmdDrawIndexed(commandBuffer, indices.size(), 1, 0, 0, 0);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+			secondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+		auto drawStart{ std::chrono::high_resolution_clock::now() };
+		if (drawsMeshTasks())
+		{
+			// one mesh shader workgroup per visible meshlet, the pipeline layout is shared
+			recordDrawState(commandBuffer);
+			cullMeshlets();
+			memcpy(visibleMeshletBuffersMapped[currentFrame], visibleMeshlets.data(), visibleMeshlets.size() * sizeof(uint32_t));
+			if (!visibleMeshlets.empty())
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+				cmdDrawMeshTasks(commandBuffer, static_cast<uint32_t>(visibleMeshlets.size()), 1, 1);
+				meshletStats.draws++;
+			}
+		}
+		else
+		{
+			collectDraws();
+			if (secondary)
+			{
+				recordSecondaryDraws(commandBuffer, imageIndex);
+			}
+			else
+			{
+				recordDrawState(commandBuffer);
+				recordDraws(commandBuffer, 0, frameDraws.size());
+			}
+		}
+		transformStats.recordSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - drawStart).count();
 
 		vkCmdEndRenderPass(commandBuffer);
+		if (statisticsQueryActive())
+		{
+			vkCmdEndQuery(commandBuffer, statisticsQueryPool, currentFrame);
+		}
 
 		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to record command buffer!");
 		}
+		return oneOff;
 	}
 
 	/*
@@ -3389,6 +10985,19 @@ private:
 	*/
 	void drawFrame()
 	{
+		// frame time, i.e. the interval between two drawFrame calls, booked on the LOD drawn last
+		auto frameStart{ std::chrono::high_resolution_clock::now() };
+		if (lastFrameTime.time_since_epoch().count() != 0)
+		{
+			lodFrameStats.resize(lods.size());
+			lodFrameStats[currentLod].seconds += std::chrono::duration<double>(frameStart - lastFrameTime).count();
+			lodFrameStats[currentLod].frames++;
+			frameTimingStats.frames++;
+			frameTimingStats.frameSeconds += std::chrono::duration<double>(frameStart - lastFrameTime).count();
+		}
+		lastFrameTime = frameStart;
+		observeFinishedFrames(frameStart);
+
 		/*
 		At the start of the frame, we want to wait until the previous frame has finished,
 		so that the command buffer and semaphores are available to use.
@@ -3396,8 +11005,20 @@ private:
 		single one it doesn’t matter. This function also has a timeout parameter that
 		we set to the maximum value of a 64 bit unsigned integer, UINT64_MAX, which
 		effectively disables the timeout.
-		*/
-		vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+		With the frame timeline the wait is for the number of the frame that used this
+		slot last, see waitForFrame.
+		*/
+		auto frameWaitStart{ std::chrono::high_resolution_clock::now() };
+		waitForFrame(frameSubmitValues[currentFrame]);
+		auto frameWaitEnd{ std::chrono::high_resolution_clock::now() };
+		frameTimingStats.frameWaitSeconds += std::chrono::duration<double>(frameWaitEnd - frameWaitStart).count();
+		finishLatencySample(currentFrame, frameWaitEnd);
+		// the last submission reading this frame's uniforms is done
+		uniformArena.reset(currentFrame);
+		readStatisticsQuery(currentFrame);
+		// before the fence is reset, so no staging region is left pointing at it
+		retireStaging();
+		finishTextureStreaming();
 
 		uint32_t imageIndex;
 		/*
@@ -3406,10 +11027,12 @@ private:
 		in our swapChainImages array. We’re going to use that index to pick the
 		VkFrameBuffer
 		*/
+		auto acquireStart{ std::chrono::high_resolution_clock::now() };
 		VkResult result{ 
 			vkAcquireNextImageKHR(device, swapChain, UINT32_MAX, imageAvailableSemaphores[currentFrame],
 				VK_NULL_HANDLE, &imageIndex)
 		};
+		frameTimingStats.acquireSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - acquireStart).count();
 
 		/*
 		The vkAcquireNextImageKHR and vkQueuePresentKHR functions can return the following
@@ -3431,13 +11054,59 @@ private:
 			throw std::runtime_error("failed to acquire swap chain image!");
 		}
 		// Only reset the fence if we are submitting work
-		vkResetFences(device, 1, &inFlightFences[currentFrame]);
-
-		vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-		recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+		if (!settings.timelineFrameSync)
+		{
+			vkResetFences(device, 1, &inFlightFences[currentFrame]);
+		}
+		// the number this frame signals, releaseStagingAfterFrame ties staging to it
+		frameSubmitValues[currentFrame] = ++frameTimelineValue;
 
 		//This function will generate a new transformation every frame to make the geometry spin around.
+		//It runs before the LOD selection, which uses this frame's camera.
+		frameInputTimes[currentFrame] = std::chrono::high_resolution_clock::now();
 		updateUniformBuffer(currentFrame);
+		currentLod = selectLod();
+		// before recording, which takes the pending acquire barriers
+		UploadToken uploadWait{ asyncUploadsSupported ? frameUploadWait(pendingBufferAcquires.empty() &&
+			pendingImageAcquires.empty() ? 0 : pendingAcquireUpload) : 0 };
+		VkCommandBuffer commandBuffer{ commandBuffers[currentFrame] };
+		auto recordStart{ std::chrono::high_resolution_clock::now() };
+		if (settings.cacheCommandBuffers)
+		{
+			RecordedCommandBuffer& recorded{ recordedCommandBuffers[currentFrame * swapChainImages.size() + imageIndex] };
+			commandBuffer = recorded.commandBuffer;
+			if (canReuseCommandBuffer(recorded))
+			{
+				transformStats.draws += recorded.draws;
+				commandBufferStats.reused++;
+				commandBufferStats.reuseSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - recordStart).count();
+			}
+			else
+			{
+				vkResetCommandBuffer(commandBuffer, 0);
+				uint64_t draws{ transformStats.draws };
+				bool oneOff{ recordCommandBuffer(commandBuffer, imageIndex) };
+				recorded.generation = oneOff || settings.pushTransforms ? 0 : commandBufferGeneration;
+				recorded.lod = currentLod;
+				recorded.frameUniformOffset = frameUniformOffset;
+				recorded.drawUniformOffsets = drawUniformOffsets;
+				recorded.draws = transformStats.draws - draws;
+				commandBufferStats.recorded++;
+				commandBufferStats.recordSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - recordStart).count();
+			}
+		}
+		else
+		{
+			vkResetCommandBuffer(commandBuffer, 0);
+			recordCommandBuffer(commandBuffer, imageIndex);
+			commandBufferStats.recorded++;
+			commandBufferStats.recordSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - recordStart).count();
+		}
+		commandBufferStats.frames++;
+		if (statisticsQueryActive())
+		{
+			statisticsQueryPending[currentFrame] = true;
+		}
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -3451,25 +11120,49 @@ private:
 		and such while the image is not yet available. Each entry in the waitStages
 		array corresponds to the semaphore with the same index in pWaitSemaphores.
 		*/
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame]};
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], uploadTimeline };
+		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, uploadConsumerStages() };
 		submitInfo.waitSemaphoreCount = 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
+		/*
+		A frame that draws with an upload still in flight waits for it on the GPU, only at
+		the stages that read it. The value for the binary semaphore is ignored.
+		*/
+		uint64_t waitValues[] = { 0, uploadWait };
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.pWaitSemaphoreValues = waitValues;
+		if (uploadWait != 0)
+		{
+			submitInfo.pNext = &timelineInfo;
+			submitInfo.waitSemaphoreCount = 2;
+			uploadStats.frameWaits++;
+		}
+		timelineInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
 
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+		submitInfo.pCommandBuffers = &commandBuffer;
 
 		/*
 		The signalSemaphoreCount and pSignalSemaphores parameters specify which
 		semaphores to signal once the command buffer(s) have finished execution. In
 		our case we’re using the renderFinishedSemaphore for that purpose.
 		*/
-		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame]};
+		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame], frameTimeline };
 		submitInfo.signalSemaphoreCount = 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
+		// the frame timeline takes the place of the fence, again the binary semaphore's value is ignored
+		uint64_t signalValues[] = { 0, frameSubmitValues[currentFrame] };
+		if (settings.timelineFrameSync)
+		{
+			submitInfo.pNext = &timelineInfo;
+			submitInfo.signalSemaphoreCount = 2;
+			timelineInfo.signalSemaphoreValueCount = 2;
+			timelineInfo.pSignalSemaphoreValues = signalValues;
+		}
 
-		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, settings.timelineFrameSync ? VK_NULL_HANDLE : inFlightFences[currentFrame]) != VK_SUCCESS)
 		{
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
@@ -3503,20 +11196,99 @@ private:
 
 		//The vkQueuePresentKHR function submits the request to present an image to the swap chain.
 		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		reportStartupTimes();
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
 		{
 			framebufferResized = false;
 			recreateSwapChain();
 		}
-		else if (result != VK_SUCCESS)
+		else if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to present swap chain image!");
+		}
+
+		//By using the modulo (%) operator, we ensure that the frame index loops around
+		//after every settings.framesInFlight enqueued frames.
+		currentFrame = (currentFrame + 1) % settings.framesInFlight;
+	}
+
+	// ends the latency samples of the frames that completed by now
+	void observeFinishedFrames(std::chrono::high_resolution_clock::time_point now)
+	{
+		for (uint32_t frame = 0; frame < settings.framesInFlight; frame++)
+		{
+			if (frameInputTimes[frame].time_since_epoch().count() != 0 && frameComplete(frameSubmitValues[frame]))
+			{
+				finishLatencySample(frame, now);
+			}
+		}
+	}
+
+	void finishLatencySample(uint32_t frame, std::chrono::high_resolution_clock::time_point finished)
+	{
+		if (frameInputTimes[frame].time_since_epoch().count() == 0)
+		{
+			return;
+		}
+		double latency{ std::chrono::duration<double>(finished - frameInputTimes[frame]).count() };
+		frameTimingStats.latencySamples++;
+		frameTimingStats.latencySeconds += latency;
+		frameTimingStats.maxLatencySeconds = std::max(frameTimingStats.maxLatencySeconds, latency);
+		frameInputTimes[frame] = {};
+	}
+
+	/*
+	Where the CPU waits each frame, to pick --frames-in-flight, --swapchain-images and
+	--present-mode from data. The frame wait, on the fence or the frame timeline, is the
+	CPU being all frames in flight ahead of the GPU, the acquire wait the presentation
+	engine holding on to every image. The latency estimate runs from updateUniformBuffer
+	sampling a frame's input to the CPU seeing it complete. That is checked at the start
+	of every frame, so it can be up to a frame late, and it leaves out the time until the
+	image is on screen.
+	*/
+	void printFrameTimingReport()
+	{
+		if (frameTimingStats.frames == 0)
+		{
+			return;
+		}
+		double frames{ static_cast<double>(frameTimingStats.frames) };
+		double frameMilliseconds{ frameTimingStats.frameSeconds * 1000.0 / frames };
+		std::cout << "Frame pacing (" << settings.framesInFlight << " frame(s) in flight, " << swapChainImages.size()
+			<< " swap chain images, " << presentModeName(swapChainPresentMode) << "): " << frameMilliseconds << " ms/frame ("
+			<< 1000.0 / frameMilliseconds << " fps), waiting " << frameTimingStats.frameWaitSeconds * 1000.0 / frames
+			<< (settings.timelineFrameSync ? " ms/frame on the frame timeline and " : " ms/frame for fences and ") << frameTimingStats.acquireSeconds * 1000.0 / frames << " ms/frame in acquire";
+		if (frameTimingStats.latencySamples > 0)
+		{
+			std::cout << ", estimated input to GPU done latency " << frameTimingStats.latencySeconds * 1000.0 / frameTimingStats.latencySamples
+				<< " ms (max " << frameTimingStats.maxLatencySeconds * 1000.0 << " ms)";
+		}
+		std::cout << std::endl;
+	}
+
+	/*
+	Time from run() to the first frame handed to the presentation engine, and to the
+	first one sampling every texture level. The GPU may still be busy with the frame,
+	so both are the CPU side of the story.
+	*/
+	void reportStartupTimes()
+	{
+		if (fullQualityPresented)
+		{
+			return;
+		}
+		double ms{ std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - runStart).count() };
+		if (!firstFramePresented)
+		{
+			firstFramePresented = true;
+			std::cout << "time to first frame: " << ms << " ms (texture level " << streamingUploadedLevel << " and up)" << std::endl;
+		}
+		if (streamingUploadedLevel == 0)
 		{
-			throw std::runtime_error("failed to present swap chain image!");
+			fullQualityPresented = true;
+			std::cout << "time to full texture quality: " << ms << " ms" << std::endl;
 		}
-
-		//By using the modulo (%) operator, we ensure that the frame index loops around
-		//after every MAX_FRAMES_IN_FLIGHT enqueued frames.
-		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 	}
 
 	void recreateSwapChain()
@@ -3545,6 +11317,8 @@ private:
 		createColorResources();
 		createDepthResources();
 		createFramebuffers();
+		// they draw into the old framebuffers, and the image count may have changed
+		allocateRecordedCommandBuffers();
 	}
 
 	void updateUniformBuffer(uint32_t currentImage)
@@ -3555,6 +11329,7 @@ private:
 		*/
 		static auto startTime{ std::chrono::high_resolution_clock::now() };
 		auto currentTime{ std::chrono::high_resolution_clock::now() };
+		auto updateStart{ currentTime };
 		float time{ std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count() };
 
 		/*
@@ -3562,34 +11337,36 @@ private:
 		buffer object. The model rotation will be a simple rotation around the
 		Z-axis using the time variable:
 		*/
-		UniformBufferObject ubo{};
+		FrameUniforms frame{};
 		/*
 		The glm::rotate function takes an existing transformation, rotation angle and
 		rotation axis as parameters. The glm::mat4(1.0f) constructor returns an identity
 		matrix. Using a rotation angle of time * glm::radians(90.0f) accomplishes
 		the purpose of rotation 90 degrees per second.
 		*/
-		ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		modelMatrix = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		frame.color = glm::vec4(1.0f);
 		/*
 		For the view transformation we look at the geometry from above
 		at a 45 degree angle. The glm::lookAt function takes the eye position, center
 		position and up axis as parameters.
 		*/
-		ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		frame.view = glm::lookAt(cameraPosition, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 		/*
 		perspective projection with a 45 degree vertical field-ofview.
 		The other parameters are the aspect ratio, near and far view planes. It
 		is important to use the current swap chain extent to calculate the aspect ratio
 		to take into account the new width and height of the window after a resize.
 		*/
-		ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
+		frame.proj = glm::perspective(cameraFovY, swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
 		/*
 		GLM was originally designed for OpenGL, where the Y coordinate of the clip
 		coordinates is inverted. The easiest way to compensate for that is to flip the
 		sign on the scaling factor of the Y axis in the projection matrix. If you don’t
 		do this, then the image will be rendered upside down.
 		*/
-		ubo.proj[1][1] *= -1;
+		frame.proj[1][1] *= -1;
+		viewProjection = frame.proj * frame.view;
 		/*
 		All of the transformations are defined now, so we can copy the data in the
 		uniform buffer object to the current uniform buffer. This happens in exactly
@@ -3597,7 +11374,34 @@ private:
 		noted earlier, we only map the uniform buffer once, so we can directly write to
 		it without having to map again:
 		*/
-		memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+		UniformAllocation uniforms{ uniformArena.allocate(sizeof(frame)) };
+		memcpy(uniforms.mapped, &frame, sizeof(frame));
+		frameUniformOffset = uniforms.offset;
+		/*
+		Every object gets its own transform. With push constants that is one matrix,
+		premultiplied here instead of in every vertex; without, its DrawUniforms in the
+		arena. The first object's DrawUniforms are written either way for the mesh shader.
+		*/
+		drawPushConstants.clear();
+		drawUniformOffsets.clear();
+		for (uint32_t object = 0; object < settings.objectCount; object++)
+		{
+			glm::mat4 model{ objectPlacements[object] * modelMatrix * positionDequantize };
+			if (settings.pushTransforms)
+			{
+				drawPushConstants.push_back({ viewProjection * model, object });
+			}
+			if (settings.pushTransforms && object != 0)
+			{
+				continue;
+			}
+			DrawUniforms draw{ model };
+			UniformAllocation objectUniforms{ uniformArena.allocate(sizeof(draw)) };
+			memcpy(objectUniforms.mapped, &draw, sizeof(draw));
+			drawUniformOffsets.push_back(objectUniforms.offset);
+		}
+		transformStats.frames++;
+		transformStats.updateSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - updateStart).count();
 	}
 
 	/*
@@ -3690,9 +11494,685 @@ private:
 	}
 };
 
-int main()
+/*
+Throughput of loadObjParallel against tinyobj::LoadObj, on the bundled model and on a
+generated grid that is big enough to keep every thread busy. Run with --bench-obj.
+*/
+void writeSyntheticObj(const std::string& path, uint32_t gridSize)
+{
+	std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+	std::string line;
+	for (uint32_t y = 0; y < gridSize; y++)
+	{
+		for (uint32_t x = 0; x < gridSize; x++)
+		{
+			float u{ static_cast<float>(x) / (gridSize - 1) };
+			float v{ static_cast<float>(y) / (gridSize - 1) };
+			line = "v " + std::to_string(u * 10.0f - 5.0f) + " " + std::to_string(v * 10.0f - 5.0f) + " " +
+				std::to_string(0.25f * std::sin(u * 20.0f) * std::cos(v * 20.0f)) + "\n" +
+				"vt " + std::to_string(u) + " " + std::to_string(v) + "\n";
+			file << line;
+		}
+	}
+	for (uint32_t y = 0; y + 1 < gridSize; y++)
+	{
+		for (uint32_t x = 0; x + 1 < gridSize; x++)
+		{
+			uint32_t i{ y * gridSize + x + 1 };
+			std::string a{ std::to_string(i) }, b{ std::to_string(i + 1) };
+			std::string c{ std::to_string(i + gridSize + 1) }, d{ std::to_string(i + gridSize) };
+			file << "f " << a << "/" << a << " " << b << "/" << b << " " << c << "/" << c << " " << d << "/" << d << "\n";
+		}
+	}
+}
+
+void benchmarkObjFile(const std::string& path)
+{
+	double megabytes{ std::filesystem::file_size(path) / (1024.0 * 1024.0) };
+	std::cout << path << " (" << megabytes << " MB)" << std::endl;
+	auto report{ [&](const char* name, double seconds, size_t faces) {
+		std::cout << "  " << name << ": " << seconds * 1000.0 << " ms, " << megabytes / seconds << " MB/s, "
+			<< faces / seconds / 1e6 << " Mfaces/s" << std::endl;
+	} };
+
+	size_t referenceCorners{ 0 };
+	{
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warn, err;
+		auto start{ std::chrono::high_resolution_clock::now() };
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str()))
+		{
+			throw std::runtime_error(warn + err);
+		}
+		double seconds{ std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() };
+		for (const auto& shape : shapes)
+		{
+			referenceCorners += shape.mesh.indices.size();
+		}
+		report("tinyobj::LoadObj   ", seconds, referenceCorners / 3);
+	}
+
+	uint32_t maxThreads{ std::max(1u, std::thread::hardware_concurrency()) };
+	for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+	{
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::string err;
+		auto start{ std::chrono::high_resolution_clock::now() };
+		if (!loadObjParallel(attrib, shapes, err, path, threads))
+		{
+			throw std::runtime_error(err);
+		}
+		double seconds{ std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() };
+		std::string name{ "loadObjParallel x" + std::to_string(threads) };
+		name.resize(19, ' ');
+		report(name.c_str(), seconds, shapes[0].mesh.indices.size() / 3);
+		if (shapes[0].mesh.indices.size() != referenceCorners)
+		{
+			std::cout << "  mismatch: " << shapes[0].mesh.indices.size() << " corners, tinyobj produced "
+				<< referenceCorners << std::endl;
+		}
+		if (threads == maxThreads)
+		{
+			break;
+		}
+	}
+}
+
+void runObjBenchmark()
+{
+	benchmarkObjFile(MODEL_PATH);
+	std::string syntheticPath{ (std::filesystem::temp_directory_path() / "vulkan_tutorial_synthetic.obj").string() };
+	writeSyntheticObj(syntheticPath, 1500);
+	benchmarkObjFile(syntheticPath);
+	std::filesystem::remove(syntheticPath);
+}
+
+/*
+Vertex welding with the old std::unordered_map (three lookups per corner), with
+VertexWeldTable and with weldVerticesParallel, on the corners of the bundled model
+and of a flat grid, whose regular positions used to collide a lot in the XOR/shift
+std::hash<Vertex>. Run with --bench-weld.
+*/
+void benchmarkWeld(const char* name, const std::vector<Vertex>& corners)
+{
+	std::cout << name << " (" << corners.size() << " corners)" << std::endl;
+	auto time{ [](auto&& work) {
+		auto start{ std::chrono::high_resolution_clock::now() };
+		work();
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	} };
+	auto report{ [&](const std::string& variant, double seconds, size_t uniqueCount) {
+		std::cout << "  " << variant << std::string(variant.size() < 28 ? 28 - variant.size() : 0, ' ') << seconds * 1000.0
+			<< " ms, " << corners.size() / seconds / 1e6 << " Mcorners/s, " << uniqueCount << " unique" << std::endl;
+	} };
+
+	std::vector<Vertex> referenceVertices;
+	std::vector<uint32_t> referenceIndices;
+	double seconds{ time([&]() {
+		std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+		for (const Vertex& vertex : corners)
+		{
+			if (uniqueVertices.count(vertex) == 0)
+			{
+				uniqueVertices[vertex] = static_cast<uint32_t>(referenceVertices.size());
+				referenceVertices.push_back(vertex);
+			}
+			referenceIndices.push_back(uniqueVertices[vertex]);
+		}
+	}) };
+	report("std::unordered_map", seconds, referenceVertices.size());
+
+	auto check{ [&](const std::vector<Vertex>& weldedVertices, const std::vector<uint32_t>& cornerIndices) {
+		if (weldedVertices != referenceVertices || cornerIndices != referenceIndices)
+		{
+			std::cout << "  mismatch against std::unordered_map" << std::endl;
+		}
+	} };
+
+	{
+		std::vector<Vertex> weldedVertices;
+		std::vector<uint32_t> cornerIndices;
+		seconds = time([&]() {
+			VertexWeldTable table{ corners.size() };
+			cornerIndices.reserve(corners.size());
+			for (const Vertex& vertex : corners)
+			{
+				cornerIndices.push_back(table.weld(vertex, weldedVertices));
+			}
+		});
+		report("VertexWeldTable", seconds, weldedVertices.size());
+		check(weldedVertices, cornerIndices);
+	}
+
+	uint32_t maxThreads{ std::max(1u, std::thread::hardware_concurrency()) };
+	for (uint32_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+	{
+		std::vector<Vertex> weldedVertices;
+		std::vector<uint32_t> cornerIndices;
+		seconds = time([&]() { weldVerticesParallel(corners, weldedVertices, cornerIndices, threads); });
+		report("weldVerticesParallel x" + std::to_string(threads), seconds, weldedVertices.size());
+		check(weldedVertices, cornerIndices);
+		if (threads == maxThreads)
+		{
+			break;
+		}
+	}
+}
+
+// One Vertex per triangle corner of an OBJ file, built the same way parseModel does.
+std::vector<Vertex> loadObjCorners(const std::string& path)
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::string err;
+	if (!loadObjParallel(attrib, shapes, err, path))
+	{
+		throw std::runtime_error(err);
+	}
+	std::vector<Vertex> corners;
+	corners.reserve(shapes[0].mesh.indices.size());
+	for (const auto& index : shapes[0].mesh.indices)
+	{
+		Vertex vertex{};
+		vertex.pos = { attrib.vertices[3 * index.vertex_index + 0], attrib.vertices[3 * index.vertex_index + 1],
+			attrib.vertices[3 * index.vertex_index + 2] };
+		vertex.texCoord = { attrib.texcoords[2 * index.texcoord_index + 0], 1.0f - attrib.texcoords[2 * index.texcoord_index + 1] };
+		vertex.color = { 1.0f, 1.0f, 1.0f };
+		corners.push_back(vertex);
+	}
+	return corners;
+}
+
+void runWeldBenchmark()
+{
+	std::vector<Vertex> corners{ loadObjCorners(MODEL_PATH) };
+	benchmarkWeld(MODEL_PATH.c_str(), corners);
+
+	const uint32_t gridSize{ 1024 };
+	corners.clear();
+	auto gridVertex{ [&](uint32_t x, uint32_t y) {
+		Vertex vertex{};
+		vertex.pos = { static_cast<float>(x), static_cast<float>(y), 0.0f };
+		vertex.texCoord = { static_cast<float>(x) / gridSize, static_cast<float>(y) / gridSize };
+		vertex.color = { 1.0f, 1.0f, 1.0f };
+		return vertex;
+	} };
+	for (uint32_t y = 0; y < gridSize; y++)
+	{
+		for (uint32_t x = 0; x < gridSize; x++)
+		{
+			for (auto [dx, dy] : { std::pair{ 0u, 0u }, { 1u, 0u }, { 1u, 1u }, { 1u, 1u }, { 0u, 1u }, { 0u, 0u } })
+			{
+				corners.push_back(gridVertex(x + dx, y + dy));
+			}
+		}
+	}
+	benchmarkWeld("1024x1024 grid", corners);
+}
+
+/*
+Runs the vertex cache / vertex fetch optimization of loadModel on the CPU only and
+checks the result: the optimized index buffer must contain the same triangles (up to
+rotation) and every corner must still see the same vertex. Run with --bench-vcache.
+*/
+void benchmarkVertexCache(const char* name, const std::vector<Vertex>& corners)
+{
+	std::vector<Vertex> weldedVertices;
+	std::vector<uint32_t> cornerIndices;
+	weldVerticesParallel(corners, weldedVertices, cornerIndices);
+	std::cout << name << " (" << cornerIndices.size() / 3 << " triangles, " << weldedVertices.size() << " vertices)" << std::endl;
+
+	auto canonicalTriangles{ [](const std::vector<uint32_t>& indexArray) {
+		std::vector<std::array<uint32_t, 3>> triangles;
+		for (size_t i = 0; i < indexArray.size(); i += 3)
+		{
+			std::array<uint32_t, 3> triangle{ indexArray[i], indexArray[i + 1], indexArray[i + 2] };
+			// rotating keeps the winding, the smallest index goes first
+			std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	} };
+
+	for (uint32_t cacheSize : { 16u, 32u })
+	{
+		VertexCacheStats before{ analyzeVertexCache(cornerIndices, weldedVertices.size(), cacheSize) };
+		std::vector<uint32_t> optimizedIndices{ cornerIndices };
+		auto start{ std::chrono::high_resolution_clock::now() };
+		optimizeVertexCache(optimizedIndices, weldedVertices.size(), cacheSize);
+		double cacheMs{ std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() };
+		bool valid{ canonicalTriangles(optimizedIndices) == canonicalTriangles(cornerIndices) };
+
+		std::vector<Vertex> optimizedVertices{ weldedVertices };
+		std::vector<uint32_t> cacheOrder{ optimizedIndices };
+		start = std::chrono::high_resolution_clock::now();
+		optimizeVertexFetch(optimizedVertices, optimizedIndices);
+		double fetchMs{ std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() };
+		for (size_t i = 0; i < optimizedIndices.size(); i++)
+		{
+			valid &= optimizedVertices[optimizedIndices[i]] == weldedVertices[cacheOrder[i]];
+		}
+
+		VertexCacheStats after{ analyzeVertexCache(optimizedIndices, optimizedVertices.size(), cacheSize) };
+		std::cout << "  FIFO " << cacheSize << ": ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr
+			<< " -> " << after.atvr << ", tipsify " << cacheMs << " ms, fetch remap " << fetchMs << " ms"
+			<< (valid ? "" : ", MISMATCH") << std::endl;
+	}
+}
+
+void runVertexCacheBenchmark()
+{
+	benchmarkVertexCache(MODEL_PATH.c_str(), loadObjCorners(MODEL_PATH));
+
+	// a grid emitted in a scrambled triangle order, the worst case for the cache
+	const uint32_t gridSize{ 512 };
+	std::vector<std::array<Vertex, 3>> triangles;
+	auto gridVertex{ [&](uint32_t x, uint32_t y) {
+		Vertex vertex{};
+		vertex.pos = { static_cast<float>(x), static_cast<float>(y), 0.0f };
+		vertex.texCoord = { static_cast<float>(x) / gridSize, static_cast<float>(y) / gridSize };
+		vertex.color = { 1.0f, 1.0f, 1.0f };
+		return vertex;
+	} };
+	for (uint32_t y = 0; y < gridSize; y++)
+	{
+		for (uint32_t x = 0; x < gridSize; x++)
+		{
+			triangles.push_back({ gridVertex(x, y), gridVertex(x + 1, y), gridVertex(x + 1, y + 1) });
+			triangles.push_back({ gridVertex(x + 1, y + 1), gridVertex(x, y + 1), gridVertex(x, y) });
+		}
+	}
+	uint64_t state{ 12345 };
+	for (size_t i = triangles.size() - 1; i > 0; i--)
+	{
+		state = state * 6364136223846793005ull + 1442695040888963407ull;
+		std::swap(triangles[i], triangles[(state >> 33) % (i + 1)]);
+	}
+	std::vector<Vertex> corners;
+	for (const auto& triangle : triangles)
+	{
+		corners.insert(corners.end(), triangle.begin(), triangle.end());
+	}
+	benchmarkVertexCache("512x512 grid, shuffled", corners);
+}
+
+// Size and accuracy of the compact vertex layout for the bundled model. Run with --bench-quantize.
+void runQuantizeReport()
+{
+	std::vector<Vertex> weldedVertices;
+	std::vector<uint32_t> cornerIndices;
+	weldVerticesParallel(loadObjCorners(MODEL_PATH), weldedVertices, cornerIndices);
+	QuantizedMesh mesh{ quantizeVertices(weldedVertices) };
+	float extent{ std::max({ mesh.positionScale.x, mesh.positionScale.y, mesh.positionScale.z }) };
+	std::cout << MODEL_PATH << ": " << weldedVertices.size() << " vertices, " << weldedVertices.size() * sizeof(Vertex)
+		<< " -> " << mesh.vertices.size() * sizeof(PackedVertex) << " bytes ("
+		<< 100.0 - 100.0 * sizeof(PackedVertex) / sizeof(Vertex) << "% less vertex memory and fetch bandwidth)" << std::endl;
+	std::cout << "  max position error " << mesh.maxPositionError << " (" << mesh.maxPositionError / extent * 100.0f
+		<< "% of the largest bounding box side, quantization step " << extent / 65535.0f << ")" << std::endl;
+	std::cout << "  max texCoord error " << mesh.maxTexCoordError << " ("
+		<< (mesh.texCoordFormat == VK_FORMAT_R16G16_UNORM ? "unorm16" : "half") << ", "
+		<< mesh.maxTexCoordError * 4096.0f << " texels at 4096x4096)" << std::endl;
+}
+
+/*
+Quality and size of every format the baker can write, for the bundled texture. Each
+level of the RGBA8 mip chain is encoded, decoded again and compared to its input; the
+PSNR is over all texels of all levels, the size over the whole chain. Run with
+--bench-texture.
+*/
+void runTextureReport()
+{
+	int width;
+	int height;
+	int channels;
+	stbi_uc* pixels{ stbi_load(TEXTURE_PATH.c_str(), &width, &height, &channels, STBI_rgb_alpha) };
+	if (!pixels)
+	{
+		throw std::runtime_error("failed to load texture image!");
+	}
+	std::vector<std::vector<uint8_t>> levels{ buildMipChainRgba8Srgb(
+		std::vector<uint8_t>(pixels, pixels + static_cast<size_t>(width) * height * 4), width, height) };
+	stbi_image_free(pixels);
+
+	std::cout << TEXTURE_PATH << ": " << width << "x" << height << ", " << levels.size() << " levels" << std::endl;
+	uint64_t rgba8Size{ 0 };
+	for (const auto& level : levels)
+	{
+		rgba8Size += level.size();
+	}
+	auto psnr{ [](double squaredError, uint64_t count)
+		{
+			return squaredError == 0.0 ? std::numeric_limits<double>::infinity() :
+				10.0 * std::log10(255.0 * 255.0 * count / squaredError);
+		} };
+	for (VkFormat format : { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_BC1_RGB_SRGB_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK })
+	{
+		double colorError{ 0.0 };
+		double alphaError{ 0.0 };
+		uint64_t texelCount{ 0 };
+		uint64_t size{ 0 };
+		double encodeMs{ 0.0 };
+		for (uint32_t i = 0; i < levels.size(); i++)
+		{
+			uint32_t levelWidth{ std::max(static_cast<uint32_t>(width) >> i, 1u) };
+			uint32_t levelHeight{ std::max(static_cast<uint32_t>(height) >> i, 1u) };
+			auto start{ std::chrono::high_resolution_clock::now() };
+			std::vector<uint8_t> encoded{ encodeTextureLevel(format, levels[i], levelWidth, levelHeight) };
+			encodeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			std::vector<uint8_t> decoded{ decodeTextureLevel(format, encoded, levelWidth, levelHeight) };
+			for (size_t t = 0; t < decoded.size(); t += 4)
+			{
+				for (size_t c = 0; c < 4; c++)
+				{
+					double delta{ static_cast<double>(decoded[t + c]) - levels[i][t + c] };
+					(c < 3 ? colorError : alphaError) += delta * delta;
+				}
+			}
+			texelCount += static_cast<uint64_t>(levelWidth) * levelHeight;
+			size += encoded.size();
+		}
+		std::cout << "  " << textureFormatName(format) << ": " << size / 1024.0 << " KiB (" << 100.0 * size / rgba8Size
+			<< "%), RGB PSNR " << psnr(colorError, texelCount * 3) << " dB, alpha PSNR " << psnr(alphaError, texelCount)
+			<< " dB, encode " << encodeMs << " ms (" << texelCount / (encodeMs * 1000.0) << " MPix/s)" << std::endl;
+	}
+}
+
+/*
+Throughput of the CPU mip chain builder on the bundled texture and on a 4096x4096 tiling
+of it, for the reference downsampler and for downsampleRgba8Srgb on 1 thread up to one
+per core. MPix/s counts the source texels of every level. Also checks that the fast
+path stays within one step of the reference. Run with --bench-mipmaps.
+*/
+void runMipmapBenchmark()
+{
+	int width;
+	int height;
+	int channels;
+	stbi_uc* pixels{ stbi_load(TEXTURE_PATH.c_str(), &width, &height, &channels, STBI_rgb_alpha) };
+	if (!pixels)
+	{
+		throw std::runtime_error("failed to load texture image!");
+	}
+	std::vector<uint8_t> texture(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	stbi_image_free(pixels);
+	const uint32_t tiledSize{ 4096 };
+	std::vector<uint8_t> tiled(static_cast<size_t>(tiledSize) * tiledSize * 4);
+	for (uint32_t y = 0; y < tiledSize; y++)
+	{
+		for (uint32_t x = 0; x < tiledSize; x++)
+		{
+			memcpy(&tiled[(static_cast<size_t>(y) * tiledSize + x) * 4],
+				&texture[(static_cast<size_t>(y % height) * width + x % width) * 4], 4);
+		}
+	}
+
+	uint32_t maxThreads{ std::max(1u, std::thread::hardware_concurrency()) };
+	auto benchmark{ [&](const std::vector<uint8_t>& level0, uint32_t levelWidth, uint32_t levelHeight)
+		{
+			std::cout << levelWidth << "x" << levelHeight << ":" << std::endl;
+			constexpr int runs{ 3 };
+			auto measure{ [&](const char* name, auto&& downsample)
+				{
+					double best{ std::numeric_limits<double>::max() };
+					std::vector<std::vector<uint8_t>> levels;
+					uint64_t sourceTexels{ 0 };
+					for (int run = 0; run < runs; run++)
+					{
+						levels.assign(1, level0);
+						sourceTexels = 0;
+						uint32_t w{ levelWidth };
+						uint32_t h{ levelHeight };
+						auto start{ std::chrono::high_resolution_clock::now() };
+						while (w > 1 || h > 1)
+						{
+							levels.push_back(downsample(levels.back(), w, h));
+							sourceTexels += static_cast<uint64_t>(w) * h;
+							w = std::max(w / 2, 1u);
+							h = std::max(h / 2, 1u);
+						}
+						best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+					}
+					std::cout << "  " << name << ": " << best << " ms, " << sourceTexels / (best * 1000.0) << " MPix/s" << std::endl;
+					return levels;
+				} };
+			std::vector<std::vector<uint8_t>> reference{ measure("reference, 1 thread",
+				[](const std::vector<uint8_t>& source, uint32_t w, uint32_t h) { return downsampleRgba8SrgbReference(source, w, h); }) };
+			std::vector<uint32_t> threadCounts;
+			for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+			{
+				threadCounts.push_back(threads);
+			}
+			threadCounts.push_back(maxThreads);
+			for (uint32_t threads : threadCounts)
+			{
+				std::string name{ "fast, " + std::to_string(threads) + (threads == 1 ? " thread" : " threads") };
+				std::vector<std::vector<uint8_t>> fast{ measure(name.c_str(),
+					[threads](const std::vector<uint8_t>& source, uint32_t w, uint32_t h) { return downsampleRgba8Srgb(source, w, h, threads); }) };
+				int maxDifference{ 0 };
+				uint64_t differentValues{ 0 };
+				for (size_t i = 1; i < fast.size(); i++)
+				{
+					for (size_t t = 0; t < fast[i].size(); t++)
+					{
+						int difference{ std::abs(fast[i][t] - reference[i][t]) };
+						maxDifference = std::max(maxDifference, difference);
+						differentValues += difference != 0;
+					}
+				}
+				if (maxDifference > 0)
+				{
+					std::cout << "    " << differentValues << " values differ from the reference, by at most " << maxDifference << std::endl;
+				}
+			}
+		} };
+	benchmark(texture, width, height);
+	benchmark(tiled, tiledSize, tiledSize);
+}
+
+int main(int argc, char** argv)
 {
-	HelloTriangleApplication app;
+	std::vector<std::string_view> args(argv + 1, argv + argc);
+	auto hasArg{ [&](std::string_view arg) { return std::find(args.begin(), args.end(), arg) != args.end(); } };
+	/*
+	--bake-ktx2 <input> [output] [--format rgba8|bc1|bc3|bc7] converts a PNG/JPG into a
+	KTX2 file with the full mip chain, by default RGBA8 next to the input with the
+	extension replaced.
+	*/
+	if (!args.empty() && args[0] == "--bake-ktx2")
+	{
+		VkFormat format{ VK_FORMAT_R8G8B8A8_SRGB };
+		std::vector<std::string_view> paths;
+		for (size_t i = 1; i < args.size(); i++)
+		{
+			if (args[i] == "--format" && i + 1 < args.size())
+			{
+				i++;
+				format = VK_FORMAT_UNDEFINED;
+				for (VkFormat candidate : { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_BC1_RGB_SRGB_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK })
+				{
+					if (args[i] == textureFormatName(candidate))
+					{
+						format = candidate;
+					}
+				}
+			}
+			else
+			{
+				paths.push_back(args[i]);
+			}
+		}
+		if (paths.empty() || paths.size() > 2 || format == VK_FORMAT_UNDEFINED)
+		{
+			std::cerr << "usage: --bake-ktx2 <input> [output] [--format rgba8|bc1|bc3|bc7]" << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::string input{ paths[0] };
+		std::string output{ paths.size() > 1 ? std::string{ paths[1] } :
+			std::filesystem::path{ input }.replace_extension(".ktx2").string() };
+		return bakeKtx2(input, output, format) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	if (hasArg("--bench-obj") || hasArg("--bench-weld") || hasArg("--bench-vcache") ||
+		hasArg("--bench-quantize") || hasArg("--bench-texture") || hasArg("--bench-mipmaps"))
+	{
+		try {
+			if (hasArg("--bench-obj"))
+			{
+				runObjBenchmark();
+			}
+			if (hasArg("--bench-weld"))
+			{
+				runWeldBenchmark();
+			}
+			if (hasArg("--bench-vcache"))
+			{
+				runVertexCacheBenchmark();
+			}
+			if (hasArg("--bench-quantize"))
+			{
+				runQuantizeReport();
+			}
+			if (hasArg("--bench-texture"))
+			{
+				runTextureReport();
+			}
+			if (hasArg("--bench-mipmaps"))
+			{
+				runMipmapBenchmark();
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	RenderSettings settings;
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		if (args[i] == "--lod" && i + 1 < args.size())
+		{
+			std::from_chars(args[i + 1].data(), args[i + 1].data() + args[i + 1].size(), settings.forcedLod);
+			i++;
+		}
+		else if (args[i] == "--lod-sweep")
+		{
+			settings.lodSweep = true;
+		}
+		else if (args[i] == "--compare-texture-load")
+		{
+			settings.compareTextureLoading = true;
+			if (i + 1 < args.size() && !args[i + 1].starts_with("--"))
+			{
+				settings.decodeTexturePath = args[i + 1];
+				i++;
+			}
+		}
+		else if (args[i] == "--no-texture-streaming")
+		{
+			settings.textureStreaming = false;
+		}
+		else if (args[i] == "--blit-mipmaps")
+		{
+			settings.mipmapGenerator = MipmapGenerator::Blit;
+		}
+		else if (args[i] == "--cpu-mipmaps")
+		{
+			settings.mipmapGenerator = MipmapGenerator::Cpu;
+		}
+		else if (args[i] == "--no-upload-batch")
+		{
+			settings.batchStartupUploads = false;
+		}
+		else if (args[i] == "--no-transient-attachments")
+		{
+			settings.transientAttachments = false;
+		}
+		else if (args[i] == "--d16-depth")
+		{
+			settings.d16Depth = true;
+		}
+		else if (args[i] == "--mesh-shading")
+		{
+			settings.meshShading = true;
+		}
+		else if (args[i] == "--compact-vertices")
+		{
+			settings.compactVertices = true;
+		}
+		else if (args[i] == "--push-transforms")
+		{
+			settings.pushTransforms = true;
+		}
+		else if (args[i] == "--ubo-transforms")
+		{
+			settings.pushTransforms = false;
+		}
+		else if (args[i] == "--cache-command-buffers")
+		{
+			settings.cacheCommandBuffers = true;
+		}
+		else if (args[i] == "--record-threads" && i + 1 < args.size())
+		{
+			std::from_chars(args[i + 1].data(), args[i + 1].data() + args[i + 1].size(), settings.recordThreads);
+			i++;
+		}
+		else if (args[i] == "--bench-recording")
+		{
+			settings.benchmarkRecording = true;
+		}
+		else if (args[i] == "--frames-in-flight" && i + 1 < args.size())
+		{
+			std::from_chars(args[i + 1].data(), args[i + 1].data() + args[i + 1].size(), settings.framesInFlight);
+			settings.framesInFlight = std::max(settings.framesInFlight, 1u);
+			i++;
+		}
+		else if (args[i] == "--swapchain-images" && i + 1 < args.size())
+		{
+			std::from_chars(args[i + 1].data(), args[i + 1].data() + args[i + 1].size(), settings.swapChainImageCount);
+			i++;
+		}
+		else if (args[i] == "--present-mode" && i + 1 < args.size())
+		{
+			bool recognized{ false };
+			std::string accepted;
+			for (VkPresentModeKHR mode : { VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR })
+			{
+				if (args[i + 1] == presentModeName(mode))
+				{
+					settings.presentMode = mode;
+					recognized = true;
+				}
+				accepted += (accepted.empty() ? "" : ", ") + std::string{ presentModeName(mode) };
+			}
+			if (!recognized)
+			{
+				std::cout << "unknown present mode " << args[i + 1] << " (accepted: " << accepted
+					<< "), ignoring it" << std::endl;
+			}
+			i++;
+		}
+		else if (args[i] == "--timeline-frame-sync")
+		{
+			settings.timelineFrameSync = true;
+		}
+		else if (args[i] == "--fence-frame-sync")
+		{
+			settings.timelineFrameSync = false;
+		}
+		else if (args[i] == "--objects" && i + 1 < args.size())
+		{
+			std::from_chars(args[i + 1].data(), args[i + 1].data() + args[i + 1].size(), settings.objectCount);
+			settings.objectCount = std::max(settings.objectCount, 1u);
+			i++;
+		}
+	}
+	HelloTriangleApplication app{ settings };
 
 	try {
 		app.run();
@@ -1,3 +1,6 @@
 C:\lib\VulkanSDK\1.4.313.0\Bin\glslc.exe shader.vert -o vert.spv
+C:\lib\VulkanSDK\1.4.313.0\Bin\glslc.exe shader_compact.vert -o vert_compact.spv
 C:\lib\VulkanSDK\1.4.313.0\Bin\glslc.exe shader.frag -o frag.spv
+C:\lib\VulkanSDK\1.4.313.0\Bin\glslc.exe --target-env=vulkan1.2 shader.mesh -o mesh.spv
+C:\lib\VulkanSDK\1.4.313.0\Bin\glslc.exe mipmap.comp -o mipmap.spv
 pause
\ No newline at end of file
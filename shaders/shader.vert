@@ -2,11 +2,24 @@
 
 //The binding directive is similar to the location directive for attributes. Were going
 //to reference this binding in the descriptor layout.
-layout(binding = 0) uniform UniformBufferObject {
-	mat4 model;
+layout(binding = 0) uniform FrameUniforms {
 	mat4 view;
 	mat4 proj;
-} ubo;
+	vec4 color;
+} frame;
+// the transform of the object being drawn, bound at a dynamic offset per object
+layout(binding = 7) uniform DrawUniforms {
+	mat4 model;
+} object;
+
+// With PUSH_TRANSFORMS the matrix comes premultiplied per draw instead, see
+// enablePushConstantTransforms, and DrawUniforms isn't read.
+layout(constant_id = 0) const bool PUSH_TRANSFORMS = false;
+layout(push_constant) uniform PushConstants {
+	mat4 modelViewProjection;
+	// index of the draw, for per-draw data a shader looks up
+	uint drawId;
+} draw;
 
 // declare input
 layout(location = 0) in vec3 inPosition;
@@ -18,7 +31,11 @@ layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
 	// sets position of each vertex
-	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+	if (PUSH_TRANSFORMS) {
+		gl_Position = draw.modelViewProjection * vec4(inPosition, 1.0);
+	} else {
+		gl_Position = frame.proj * frame.view * object.model * vec4(inPosition, 1.0);
+	}
 	// Passes the per-vertex color to the next stage (fragment shader)
 	fragColor = inColor;
 	fragTexCoord = inTexCoord;
@@ -0,0 +1,39 @@
+#version 450
+
+// Same uniform blocks as shader.vert. For the compact vertex layout model also
+// contains the AABB transform that turns the normalized positions back into
+// object space, and the color that used to be repeated in every vertex lives in
+// the frame block.
+layout(binding = 0) uniform FrameUniforms {
+	mat4 view;
+	mat4 proj;
+	vec4 color;
+} frame;
+layout(binding = 7) uniform DrawUniforms {
+	mat4 model;
+} object;
+
+// Same push constants as shader.vert, model then also contains the AABB transform.
+layout(constant_id = 0) const bool PUSH_TRANSFORMS = false;
+layout(push_constant) uniform PushConstants {
+	mat4 modelViewProjection;
+	uint drawId;
+} draw;
+
+// R16G16B16A16_UNORM and R16G16_UNORM/R16G16_SFLOAT are converted to floats by the
+// vertex fetch, the shader sees the same types as with the float layout
+layout(location = 0) in vec3 inPosition;
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+void main() {
+	if (PUSH_TRANSFORMS) {
+		gl_Position = draw.modelViewProjection * vec4(inPosition, 1.0);
+	} else {
+		gl_Position = frame.proj * frame.view * object.model * vec4(inPosition, 1.0);
+	}
+	fragColor = frame.color.rgb;
+	fragTexCoord = inTexCoord;
+}
\ No newline at end of file